@@ -0,0 +1,109 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Headless batch mode +++##########
+//# Without a terminal the debugger prompt would wait forever. In
+//# batch mode the debugger commands come from a script file (or
+//# stdin) instead of readline, and the end of the script quits.
+//# With --exit-on-stop any stop of the CPU quits right away, so a
+//# breakpoint or an illegal instruction cannot hang a CI job.
+//#
+//# The status file describes how the run ended as a single JSON
+//# object, for example:
+//#   {"exit_code": 0, "stop": "exit", "error": "none",
+//#    "pc": "0xC02A", "cycles": 1234, "instructions": 600}
+//################################################
+
+#include "batch.h"
+#include "io.h"
+
+/**
+ * @brief Read debugger commands from a file, '-' is stdin
+ */
+bool batch_open_script(Emulator* const emu, const char* spec)
+{
+  emu->script = strcmp(spec, "-") ? fopen(spec, "r") : stdin;
+  return emu->script != NULL;
+}
+
+void batch_close_script(Emulator* const emu)
+{
+  if (emu->script != NULL && emu->script != stdin)
+    fclose(emu->script);
+  emu->script = NULL;
+}
+
+/**
+ * @brief Run the next script command while the CPU is stopped
+ */
+void batch_handle_stop(Emulator* const emu)
+{
+  Debugger* const deb = emu->debugger;
+  char line[Batch_MaxLineLength];
+
+  if (emu->exit_on_stop && deb->stop_reason != StopReason_None)
+  {
+    emu->exit_code = Batch_StoppedExitCode;
+    deb->quit = true;
+    return;
+  }
+
+  while (emu->script != NULL && fgets(line, sizeof line, emu->script) != NULL)
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+    exec_cmd(emu, line, (int)strlen(line));
+    return;
+  }
+  deb->quit = true; // End of the script, or no script at all
+}
+
+static const char* error_name(const StopReason reason)
+{
+  switch (reason) {
+    case StopReason_IllegalInstruction: return "illegal_instruction";
+    case StopReason_LowPowerStuck: return "low_power_stuck";
+    case StopReason_IdleLoopStuck: return "idle_loop_stuck";
+    default: return "none";
+  }
+}
+
+/**
+ * @brief Write how the run ended as JSON, '-' is stdout
+ */
+bool batch_write_status(Emulator* const emu, const char* file_name)
+{
+  const Cpu* const cpu = emu->cpu;
+  const StopReason reason = emu->debugger->stop_reason;
+  FILE* const file = strcmp(file_name, "-") ? fopen(file_name, "w") : stdout;
+
+  if (file == NULL)
+    return false;
+
+  fprintf(file, "{\"exit_code\": %d, \"stop\": \"%s\", \"error\": \"%s\", "
+          "\"pc\": \"0x%04X\", \"cycles\": %llu, \"instructions\": %llu}\n",
+          emu->exit_code, stop_reason_name(reason), error_name(reason), cpu->pc,
+          (unsigned long long)cpu->cycles,
+          (unsigned long long)cpu->stats.instructions.executed);
+
+  if (file != stdout)
+    return fclose(file) == 0;
+  fflush(file);
+  return true;
+}
@@ -0,0 +1,32 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "../main.h"
+
+enum { Batch_MaxLineLength = 256 };
+enum { Batch_StoppedExitCode = 2 }; // --exit-on-stop ended a run early
+
+bool batch_open_script(Emulator* const emu, const char* spec);
+void batch_close_script(Emulator* const emu);
+void batch_handle_stop(Emulator* const emu);
+bool batch_write_status(Emulator* const emu, const char* file_name);
+
+#endif
@@ -0,0 +1,357 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Co-simulation bridge +++##########
+//# An external simulator (a radio model, a SystemC platform) owns
+//# time. It connects the emulator to its Unix domain socket and
+//# advances the MSP430 in quanta of cycles: every Advance request
+//# runs the machine for that many cycles, see machine_run(), and
+//# is answered once the quantum ended. Both sides only synchronize
+//# at these barriers, one round trip per quantum and none per
+//# instruction, so the quantum size trades timing accuracy
+//# against overhead.
+//#
+//# Mailboxes are RAM ranges shared with the simulator through a
+//# mapped file, e.g. in /dev/shm. In lock step only one side runs
+//# at a time, so the file is copied into memory when a quantum
+//# starts and back when it ends, and the firmware accesses plain
+//# memory in between. A firmware waiting for the simulator may
+//# poll a mailbox flag,
+//#
+//#   wait: tst.b &MAILBOX
+//#         jz    wait
+//#
+//# which the idle loop detection skips to the end of the quantum
+//# at no cost, see idle_loop.c. An Interrupt request lets the
+//# simulator raise an edge triggered interrupt, for vectors which
+//# none of the device's peripherals use.
+//#
+//# A CPU off without a wake-up source sleeps through its quanta,
+//# the simulator may still raise an interrupt. Each reply says
+//# when the CPU needs time again, so a simulator can park a
+//# sleeping or idle looping node instead of advancing it quantum
+//# by quantum.
+//#
+//# With --cosim-uart the UART is linked to the simulator: bytes
+//# sent in a quantum follow its reply, UartInput requests queue
+//# bytes for reception, see network.c.
+//################################################
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "cosim.h"
+#include "io.h"
+#include "../devices/machine.h"
+#include "../devices/cpu/interrupts.h"
+#include "../devices/cpu/idle_loop.h"
+#include "../devices/peripherals/usci.h"
+
+extern uint8_t* MEMSPACE;
+
+Cosim* cosim_get(Emulator* const emu)
+{
+  if (emu->cosim == NULL)
+  {
+    emu->cosim = (Cosim*) calloc(1, sizeof(Cosim));
+    emu->cosim->fd = -1;
+  }
+  return emu->cosim;
+}
+
+/**
+ * @brief Add a mailbox given as ADDR:SIZE:FILE, ADDR in hex
+ */
+bool cosim_add_mailbox(Cosim* const cosim, const char* spec)
+{
+  char* end;
+  const unsigned long address = strtoul(spec, &end, 16);
+  unsigned long size;
+
+  if (*end != ':' || cosim->numMailboxes == Cosim_MaxMailboxes)
+    return false;
+  size = strtoul(end + 1, &end, 0);
+  if (*end != ':' || end[1] == '\0' || size == 0 ||
+      address + size > ADDRESS_SPACE_SIZE)
+    return false;
+
+  CosimMailbox* const mailbox = &cosim->mailboxes[cosim->numMailboxes++];
+  mailbox->address = (uint16_t)address;
+  mailbox->size = (uint16_t)size;
+  mailbox->path = end + 1;
+  return true;
+}
+
+static bool map_mailbox(CosimMailbox* const mailbox)
+{
+  const int fd = open(mailbox->path, O_RDWR | O_CREAT, 0644);
+  struct stat status;
+
+  if (fd < 0)
+    return false;
+  if (fstat(fd, &status) < 0 ||
+      (status.st_size < mailbox->size && ftruncate(fd, mailbox->size) < 0))
+  {
+    close(fd);
+    return false;
+  }
+
+  void* const data = mmap(NULL, mailbox->size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  mailbox->data = (uint8_t*)data;
+  return true;
+}
+
+static int connect_simulator(const char* spec)
+{
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+  // A socket inherited from the simulator
+  if (!strncmp(spec, COSIM_FD_PREFIX, strlen(COSIM_FD_PREFIX)))
+    return atoi(spec + strlen(COSIM_FD_PREFIX));
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (!strncmp(spec, COSIM_SOCKET_PREFIX, strlen(COSIM_SOCKET_PREFIX)))
+    spec += strlen(COSIM_SOCKET_PREFIX);
+  if (fd < 0 || strlen(spec) >= sizeof address.sun_path)
+  {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+
+  strcpy(address.sun_path, spec);
+  if (connect(fd, (struct sockaddr*)&address, sizeof address) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool transfer_all(const int fd, void* data, size_t length,
+                         const bool output)
+{
+  uint8_t* bytes = (uint8_t*)data;
+
+  while (length > 0)
+  {
+    const ssize_t done = output ? write(fd, bytes, length) :
+      read(fd, bytes, length);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0)
+      return false;
+    bytes += done;
+    length -= (size_t)done;
+  }
+  return true;
+}
+
+/**
+ * @brief Take over what the simulator wrote while the MSP430 waited
+ */
+static void load_mailboxes(Cosim* const cosim)
+{
+  for (uint8_t i = 0; i < cosim->numMailboxes; i++)
+  {
+    const CosimMailbox* const mailbox = &cosim->mailboxes[i];
+    uint8_t* const memory = MEMSPACE + mailbox->address;
+
+    // Unchanged memory keeps idle loops skippable, see idle_loop.c
+    if (memcmp(memory, mailbox->data, mailbox->size) != 0)
+    {
+      memcpy(memory, mailbox->data, mailbox->size);
+      memory_mark_dirty(mailbox->address, mailbox->size);
+    }
+  }
+}
+
+static void store_mailboxes(Cosim* const cosim)
+{
+  for (uint8_t i = 0; i < cosim->numMailboxes; i++)
+  {
+    const CosimMailbox* const mailbox = &cosim->mailboxes[i];
+    memcpy(mailbox->data, MEMSPACE + mailbox->address, mailbox->size);
+  }
+}
+
+/**
+ * @return The cycle from which the CPU makes progress again: the current
+ * one if it is awake, else its next wake-up event, SCHEDULER_NO_EVENT if
+ * only the simulator can wake it up. An idle loop counts as asleep.
+ */
+uint64_t cosim_wake_cycle(Emulator* const emu)
+{
+  const Cpu* const cpu = emu->cpu;
+  const uint32_t pending = cpu->interrupts.pending;
+  const bool asleep = (cpu->sr & StatusRegister_CPUOFF) ||
+    idle_loop_spinning(emu);
+
+  if (emu->debugger->quit)
+    return SCHEDULER_NO_EVENT;
+  if (!asleep || (pending & (1u << Interrupt_Nmi)) ||
+      ((cpu->sr & StatusRegister_GIE) && pending != 0))
+    return cpu->cycles;
+  if (!(cpu->sr & StatusRegister_GIE))
+    return SCHEDULER_NO_EVENT;
+  return scheduler_next_wakeup_cycle(emu->scheduler);
+}
+
+static CosimStatus run_quantum(Emulator* const emu, const uint64_t cycles)
+{
+  Cpu* const cpu = emu->cpu;
+  const uint64_t end = cpu->cycles + cycles;
+
+  if (cycles == 0)
+    return emu->debugger->quit ? CosimStatus_Exited : CosimStatus_Completed;
+
+  const StopReason reason = machine_run(emu, 0, cycles);
+  switch (reason)
+  {
+    case StopReason_CycleLimit:
+      return CosimStatus_Completed;
+    case StopReason_Exit:
+      return CosimStatus_Exited;
+    case StopReason_LowPowerStuck:
+      // Only the simulator can end this low power mode, sleep until then
+      if (end > cpu->cycles)
+      {
+        cpu->lowPowerCycles += end - cpu->cycles;
+        cpu->cycles = end;
+      }
+      scheduler_run_due(emu);
+      return CosimStatus_Completed;
+    case StopReason_IdleLoopStuck:
+      // Polling a mailbox the simulator has yet to write, spin until then
+      if (end > cpu->cycles)
+      {
+        cpu->idleLoopCycles += end - cpu->cycles;
+        cpu->cycles = end;
+      }
+      scheduler_run_due(emu);
+      return CosimStatus_Completed;
+    default:
+      return CosimStatus_Halted;
+  }
+}
+
+/**
+ * @brief Serve the simulator until it quits or disconnects
+ * @return The exit code of the firmware, 1 if the bridge failed
+ */
+int cosim_main(Emulator* const emu)
+{
+  Cosim* const cosim = emu->cosim;
+  CosimRequest request;
+
+  if (cosim->spec == NULL)
+  {
+    printf("Mailboxes need a simulator, see --cosim\n");
+    return 1;
+  }
+  for (uint8_t i = 0; i < cosim->numMailboxes; i++)
+  {
+    if (!map_mailbox(&cosim->mailboxes[i]))
+    {
+      printf("Could not map mailbox %s\n", cosim->mailboxes[i].path);
+      return 1;
+    }
+  }
+  cosim->fd = connect_simulator(cosim->spec);
+  if (cosim->fd < 0)
+  {
+    printf("Could not connect to the simulator at %s\n", cosim->spec);
+    return 1;
+  }
+
+  if (cosim->uartLink)
+  {
+    if (emu->cpu->usci == NULL)
+    {
+      printf("%s has no UART\n", emu->device->name);
+      return 1;
+    }
+    usci_link(emu);
+    cosim->uart = (uint8_t*) malloc(Usci_BufferSize);
+  }
+
+  // Messages of a CPU sleeping through its quanta would repeat forever
+  emu->quiet = true;
+  while (transfer_all(cosim->fd, &request, sizeof request, false))
+  {
+    if (request.command == CosimCommand_Quit)
+      break;
+    if (request.command == CosimCommand_Interrupt)
+    {
+      interrupt_request(emu, (uint8_t)request.argument);
+      continue;
+    }
+    if (request.command == CosimCommand_UartInput && cosim->uartLink &&
+        request.argument <= Usci_BufferSize)
+    {
+      if (!transfer_all(cosim->fd, cosim->uart, request.argument, false))
+        break;
+      usci_link_receive(emu, cosim->uart, request.argument);
+      continue;
+    }
+    if (request.command != CosimCommand_Advance)
+    {
+      printf("Unknown co-simulation command %u\n", request.command);
+      return 1;
+    }
+
+    load_mailboxes(cosim);
+    CosimReply reply = { .status = run_quantum(emu, request.cycles) };
+    store_mailboxes(cosim);
+
+    reply.exitCode = (uint32_t)emu->exit_code;
+    reply.cycle = emu->cpu->cycles;
+    reply.instructions = emu->cpu->stats.instructions.executed;
+    reply.wakeCycle = cosim_wake_cycle(emu);
+    if (cosim->uartLink)
+      reply.uartLength = usci_link_transmitted(emu, cosim->uart);
+    if (!transfer_all(cosim->fd, &reply, sizeof reply, true) ||
+        !transfer_all(cosim->fd, cosim->uart, reply.uartLength, true))
+      break;
+  }
+  return emu->exit_code;
+}
+
+void cosim_destroy(Emulator* const emu)
+{
+  Cosim* const cosim = emu->cosim;
+
+  if (cosim == NULL)
+    return;
+  for (uint8_t i = 0; i < cosim->numMailboxes; i++)
+  {
+    if (cosim->mailboxes[i].data != NULL)
+      munmap(cosim->mailboxes[i].data, cosim->mailboxes[i].size);
+  }
+  if (cosim->fd >= 0)
+    close(cosim->fd);
+  free(cosim->uart);
+  free(cosim);
+  emu->cosim = NULL;
+}
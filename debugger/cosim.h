@@ -0,0 +1,85 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COSIM_H_
+#define _COSIM_H_
+
+#include "../main.h"
+
+#define COSIM_SOCKET_PREFIX "unix:"
+#define COSIM_FD_PREFIX "fd:"
+
+enum { Cosim_MaxMailboxes = 8 };
+
+// Requests of the simulator, a CosimRequest each //
+typedef enum {
+  CosimCommand_Advance = 1,   // Run for cycles, answered with a CosimReply
+  CosimCommand_Interrupt = 2, // Request vector argument before the next quantum
+  CosimCommand_Quit = 3,
+  CosimCommand_UartInput = 4, // Followed by argument bytes for the linked UART
+} CosimCommand;
+
+// How a quantum ended //
+typedef enum {
+  CosimStatus_Completed = 0,  // All cycles passed, possibly asleep
+  CosimStatus_Exited = 1,     // Emulator call 0x0000, see exitCode
+  CosimStatus_Halted = 2,     // Stopped early: illegal instruction, CONTROL-c
+} CosimStatus;
+
+// Messages in host byte order, both ends run on the same machine //
+typedef struct CosimRequest {
+  uint32_t command;
+  uint32_t argument;
+  uint64_t cycles;
+} CosimRequest;
+
+typedef struct CosimReply {
+  uint32_t status;
+  uint32_t exitCode;
+  uint64_t cycle;             // CPU cycle at the end of the quantum
+  uint64_t instructions;      // Executed instructions since power up
+  uint64_t wakeCycle;         // Earliest wake-up, see cosim_wake_cycle()
+  uint32_t uartLength;        // Transmitted bytes following the reply
+  uint32_t reserved;
+} CosimReply;
+
+// RAM shared with the simulator through a mapped file //
+typedef struct CosimMailbox {
+  uint16_t address;
+  uint16_t size;
+  const char* path;
+  uint8_t* data;              // The mapping, NULL until connected
+} CosimMailbox;
+
+// Lock-step co-simulation with an external simulator //
+typedef struct Cosim {
+  const char* spec;           // Simulator socket, unix:PATH, PATH or fd:N
+  int fd;
+  bool uartLink;              // The UART talks to the simulator
+  uint8_t* uart;              // Bytes of a UART message
+  CosimMailbox mailboxes[Cosim_MaxMailboxes];
+  uint8_t numMailboxes;
+} Cosim;
+
+Cosim* cosim_get(Emulator* const emu);
+bool cosim_add_mailbox(Cosim* const cosim, const char* spec);
+uint64_t cosim_wake_cycle(Emulator* const emu);
+int cosim_main(Emulator* const emu);
+void cosim_destroy(Emulator* const emu);
+
+#endif
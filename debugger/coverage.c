@@ -0,0 +1,419 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Instruction and branch coverage +++##########
+//# Executed instructions and the outcome of every Format III
+//# jump are recorded in bitmaps holding one bit per word address.
+//# Bitmaps of several runs are merged with a bitwise OR, the lcov
+//# tracefile is only produced from the merged bitmaps.
+//############################################################
+
+#include "coverage.h"
+#include "io.h"
+
+#define COVERAGE_FILE_MAGIC "M430COV"
+#define COVERAGE_FILE_VERSION 1u
+
+enum { Coverage_MaxRangeWords = 64 };
+
+extern uint8_t* IVT;
+extern uint8_t* MEMSPACE;
+
+// Source location of an address range, from the line map file //
+typedef struct LineMapEntry {
+  uint16_t address;
+  uint16_t file;
+  uint32_t line;
+} LineMapEntry;
+
+// Coverage of a single instruction, attributed to a source line //
+typedef struct InstructionRecord {
+  uint16_t file;
+  uint16_t address;
+  uint32_t line;
+  bool executed;
+  bool isJump;
+  bool taken;
+  bool notTaken;
+} InstructionRecord;
+
+// Collection of swept instructions and the source files they belong to //
+typedef struct CoverageReport {
+  InstructionRecord* records;
+  uint32_t numRecords;
+  uint32_t capacity;
+  char** files;
+  uint16_t numFiles;
+} CoverageReport;
+
+Coverage* coverage_create()
+{
+  return (Coverage*) calloc(1, sizeof(Coverage));
+}
+
+void coverage_destroy(Coverage* const coverage)
+{
+  free(coverage);
+}
+
+/**
+ * @brief OR the bitmaps stored in a coverage file into the current ones
+ * @param coverage The coverage to merge into
+ * @param path The bitmap file written by coverage_write_bitmap_file()
+ * @return true on success, false if the file is missing or malformed
+ */
+bool coverage_merge_bitmap_file(Coverage* const coverage, const char* path)
+{
+  char magic[sizeof COVERAGE_FILE_MAGIC] = {0};
+  uint32_t version = 0, size = 0;
+  uint8_t bitmaps[3][Coverage_BitmapSize];
+  uint8_t* const targets[] = {
+    coverage->executed, coverage->branchTaken, coverage->branchNotTaken
+  };
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  bool ok = fread(magic, sizeof magic, 1, file) == 1 &&
+    memcmp(magic, COVERAGE_FILE_MAGIC, sizeof magic) == 0 &&
+    fread(&version, sizeof version, 1, file) == 1 &&
+    version == COVERAGE_FILE_VERSION &&
+    fread(&size, sizeof size, 1, file) == 1 &&
+    size == Coverage_BitmapSize;
+
+  // Nothing is merged unless the whole file is valid
+  ok = ok && fread(bitmaps, sizeof bitmaps, 1, file) == 1 &&
+    fgetc(file) == EOF;
+  fclose(file);
+
+  for (int i = 0; ok && i < 3; i++) {
+    for (uint32_t j = 0; j < Coverage_BitmapSize; j++)
+      targets[i][j] |= bitmaps[i][j];
+  }
+  return ok;
+}
+
+bool coverage_write_bitmap_file(const Coverage* const coverage,
+                                const char* path)
+{
+  const uint32_t version = COVERAGE_FILE_VERSION;
+  const uint32_t size = Coverage_BitmapSize;
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+
+  bool ok = fwrite(COVERAGE_FILE_MAGIC, sizeof COVERAGE_FILE_MAGIC, 1, file) == 1 &&
+    fwrite(&version, sizeof version, 1, file) == 1 &&
+    fwrite(&size, sizeof size, 1, file) == 1 &&
+    fwrite(coverage->executed, Coverage_BitmapSize, 1, file) == 1 &&
+    fwrite(coverage->branchTaken, Coverage_BitmapSize, 1, file) == 1 &&
+    fwrite(coverage->branchNotTaken, Coverage_BitmapSize, 1, file) == 1;
+
+  return (fclose(file) == 0) && ok;
+}
+
+static uint16_t intern_file(CoverageReport* const report, const char* name)
+{
+  for (uint16_t i = 0; i < report->numFiles; i++) {
+    if (strcmp(report->files[i], name) == 0)
+      return i;
+  }
+
+  report->files = realloc(report->files,
+    (report->numFiles + 1) * sizeof(char*));
+  report->files[report->numFiles] = strdup(name);
+  return report->numFiles++;
+}
+
+static int compare_line_map_entries(const void* a, const void* b)
+{
+  const LineMapEntry* x = a;
+  const LineMapEntry* y = b;
+  return (int)x->address - (int)y->address;
+}
+
+/**
+ * @brief Read an address to source line map. Every line of the form
+ * "FILE LINE 0xADDRESS [...]" is used, which matches the output of
+ * "msp430-elf-objdump --dwarf=decodedline", all other lines are skipped.
+ * @return The number of entries read into *entries
+ */
+static uint32_t read_line_map(CoverageReport* const report, const char* path,
+                              LineMapEntry** entries)
+{
+  char text[1024], name[512];
+  unsigned long line, address;
+  uint32_t count = 0, capacity = 0;
+
+  *entries = NULL;
+  FILE* file = fopen(path, "r");
+  if (file == NULL)
+    return 0;
+
+  while (fgets(text, sizeof text, file) != NULL) {
+    if (sscanf(text, "%511s %lu 0x%lx", name, &line, &address) != 3 ||
+        address >= ADDRESS_SPACE_SIZE)
+      continue;
+
+    if (count == capacity) {
+      capacity = capacity == 0 ? 1024 : capacity * 2;
+      *entries = realloc(*entries, capacity * sizeof(LineMapEntry));
+    }
+    (*entries)[count].address = (uint16_t)address;
+    (*entries)[count].line = (uint32_t)line;
+    (*entries)[count].file = intern_file(report, name);
+    count++;
+  }
+
+  fclose(file);
+  qsort(*entries, count, sizeof(LineMapEntry), compare_line_map_entries);
+  return count;
+}
+
+static void add_instruction(CoverageReport* const report,
+                            const Coverage* const coverage,
+                            const uint16_t file, const uint32_t line,
+                            const uint16_t address, const uint16_t instruction)
+{
+  if (report->numRecords == report->capacity) {
+    report->capacity = report->capacity == 0 ? 4096 : report->capacity * 2;
+    report->records = realloc(report->records,
+      report->capacity * sizeof(InstructionRecord));
+  }
+
+  InstructionRecord* const record = &report->records[report->numRecords++];
+  record->file = file;
+  record->line = line;
+  record->address = address;
+  record->executed = coverage_test(coverage->executed, address);
+  record->isJump = (instruction >> 13) == 0x1;
+  record->taken = coverage_test(coverage->branchTaken, address);
+  record->notTaken = coverage_test(coverage->branchNotTaken, address);
+}
+
+/**
+ * @brief Walk the instructions in [start, end) and add them to the report.
+ * When line is zero every instruction is attributed to its own address.
+ */
+static void sweep_range(CoverageReport* const report,
+                        const Coverage* const coverage, const uint16_t file,
+                        const uint32_t line, const uint32_t start,
+                        const uint32_t end, const bool skip_erased)
+{
+  uint32_t address = start & ~1u;
+  while (address < end) {
+    const uint16_t instruction = *get_addr_ptr((uint16_t)address);
+    if (skip_erased && instruction == 0xFFFF) {
+      address += 2;
+      continue;
+    }
+
+    add_instruction(report, coverage, file, line ? line : address,
+                    (uint16_t)address, instruction);
+    address += 2 * instruction_length(instruction);
+  }
+}
+
+static void build_report(Emulator* const emu, CoverageReport* const report)
+{
+  const Coverage* const coverage = emu->coverage;
+  const uint32_t vectors = (uint32_t)(IVT - MEMSPACE);
+  LineMapEntry* entries = NULL;
+  uint32_t count = 0;
+
+  if (coverage->lineMapFile != NULL)
+    count = read_line_map(report, coverage->lineMapFile, &entries);
+
+  if (count > 0) {
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t end = entries[i].address + 2;
+      if (i + 1 < count && entries[i + 1].address > entries[i].address)
+        end = entries[i + 1].address;
+      if (end - entries[i].address > 2 * Coverage_MaxRangeWords)
+        end = entries[i].address + 2 * Coverage_MaxRangeWords;
+      if (i + 1 < count && entries[i + 1].address == entries[i].address)
+        continue;
+
+      sweep_range(report, coverage, entries[i].file, entries[i].line,
+                  entries[i].address, end, false);
+    }
+    free(entries);
+    return;
+  }
+
+  if (coverage->lineMapFile != NULL) {
+    print_console(emu, "Coverage line map is empty, using addresses\n");
+  }
+
+  // No line information, every instruction of the loaded images is a line
+  for (uint8_t i = 0; i < emu->num_images; i++) {
+    const FirmwareImage* const image = &emu->images[i];
+    uint32_t end = (uint32_t)image->address + image->size;
+    if (image->address < vectors && end > vectors)
+      end = vectors;
+    if (end > ADDRESS_SPACE_SIZE)
+      end = ADDRESS_SPACE_SIZE;
+
+    sweep_range(report, coverage, intern_file(report, image->file_name), 0,
+                image->address, end, true);
+  }
+}
+
+static int compare_records(const void* a, const void* b)
+{
+  const InstructionRecord* x = a;
+  const InstructionRecord* y = b;
+  if (x->file != y->file)
+    return (int)x->file - (int)y->file;
+  if (x->line != y->line)
+    return x->line < y->line ? -1 : 1;
+  return (int)x->address - (int)y->address;
+}
+
+static void write_file_record(FILE* out, const CoverageReport* const report,
+                              uint32_t first, const uint32_t last)
+{
+  uint32_t lines = 0, linesHit = 0, branches = 0, branchesHit = 0;
+
+  fprintf(out, "SF:%s\n", report->files[report->records[first].file]);
+
+  while (first < last) {
+    const uint32_t line = report->records[first].line;
+    uint32_t branch = 0;
+    bool executed = false;
+
+    for (uint32_t i = first; i < last && report->records[i].line == line; i++)
+      executed |= report->records[i].executed;
+
+    for (; first < last && report->records[first].line == line; first++) {
+      const InstructionRecord* const record = &report->records[first];
+      if (!record->isJump)
+        continue;
+
+      if (executed) {
+        fprintf(out, "BRDA:%u,0,%u,%d\n", line, branch, record->taken);
+        fprintf(out, "BRDA:%u,0,%u,%d\n", line, branch + 1, record->notTaken);
+      }
+      else {
+        fprintf(out, "BRDA:%u,0,%u,-\n", line, branch);
+        fprintf(out, "BRDA:%u,0,%u,-\n", line, branch + 1);
+      }
+      branches += 2;
+      branchesHit += record->taken + record->notTaken;
+      branch += 2;
+    }
+
+    fprintf(out, "DA:%u,%d\n", line, executed);
+    lines++;
+    linesHit += executed;
+  }
+
+  fprintf(out, "BRF:%u\nBRH:%u\nLF:%u\nLH:%u\nend_of_record\n",
+          branches, branchesHit, lines, linesHit);
+}
+
+/**
+ * @brief Write the coverage as an lcov tracefile. Lines come from the line
+ * map when one was given, otherwise every instruction address of the loaded
+ * firmware images is reported as a line of the image file.
+ */
+bool coverage_write_lcov(Emulator* const emu, const char* path)
+{
+  CoverageReport report = {0};
+
+  FILE* out = fopen(path, "w");
+  if (out == NULL)
+    return false;
+
+  build_report(emu, &report);
+  qsort(report.records, report.numRecords, sizeof(InstructionRecord),
+        compare_records);
+
+  fprintf(out, "TN:\n");
+  uint32_t first = 0;
+  while (first < report.numRecords) {
+    uint32_t last = first;
+    while (last < report.numRecords &&
+           report.records[last].file == report.records[first].file)
+      last++;
+    write_file_record(out, &report, first, last);
+    first = last;
+  }
+
+  for (uint16_t i = 0; i < report.numFiles; i++)
+    free(report.files[i]);
+  free(report.files);
+  free(report.records);
+
+  return fclose(out) == 0;
+}
+
+/**
+ * @brief Write the configured coverage outputs, called at emulator exit.
+ * The bitmap file is merged with its previous contents first, so a batch of
+ * runs can accumulate into a single file.
+ */
+void coverage_finish(Emulator* const emu)
+{
+  Coverage* const coverage = emu->coverage;
+  char str[STRING_BUFFER_SIZE];
+
+  if (coverage == NULL)
+    return;
+
+  if (coverage->bitmapFile != NULL) {
+    coverage_merge_bitmap_file(coverage, coverage->bitmapFile);
+    if (!coverage_write_bitmap_file(coverage, coverage->bitmapFile)) {
+      sprintf(str, "Could not write coverage bitmap %s\n", coverage->bitmapFile);
+      print_console(emu, str);
+    }
+  }
+
+  if (coverage->lcovFile != NULL &&
+      !coverage_write_lcov(emu, coverage->lcovFile)) {
+    sprintf(str, "Could not write lcov tracefile %s\n", coverage->lcovFile);
+    print_console(emu, str);
+  }
+}
+
+static uint32_t count_bits(const uint8_t* const bitmap)
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < Coverage_BitmapSize; i++)
+    count += __builtin_popcount(bitmap[i]);
+  return count;
+}
+
+void display_coverage(Emulator* const emu)
+{
+  const Coverage* const coverage = emu->coverage;
+  char str[STRING_BUFFER_SIZE];
+
+  if (coverage == NULL) {
+    print_console(emu, "Coverage is not enabled.\n");
+    return;
+  }
+
+  sprintf(str, "Coverage:\n \tInstructions executed - %u\n"
+    " \tBranches taken - %u\n \tBranches not taken - %u\n",
+    count_bits(coverage->executed), count_bits(coverage->branchTaken),
+    count_bits(coverage->branchNotTaken));
+  print_console(emu, str);
+}
@@ -0,0 +1,59 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COVERAGE_H_
+#define _COVERAGE_H_
+
+#include "../main.h"
+
+// One bit per word aligned address of the 64 KB address space
+enum { Coverage_BitmapSize = 0x10000 / 16 };
+
+// Structure containing the coverage bitmaps and their output files //
+typedef struct Coverage {
+  uint8_t executed[Coverage_BitmapSize];       // Executed instructions
+  uint8_t branchTaken[Coverage_BitmapSize];    // Format III jumps taken
+  uint8_t branchNotTaken[Coverage_BitmapSize]; // Format III jumps not taken
+
+  const char* lcovFile;    // lcov tracefile written at exit
+  const char* bitmapFile;  // Accumulated bitmap written at exit
+  const char* lineMapFile; // Address to source line map
+} Coverage;
+
+static inline void coverage_mark(uint8_t* const bitmap, const uint16_t address)
+{
+  bitmap[address >> 4] |= (uint8_t)(1u << ((address >> 1) & 7));
+}
+
+static inline bool coverage_test(const uint8_t* const bitmap,
+                                 const uint16_t address)
+{
+  return (bitmap[address >> 4] >> ((address >> 1) & 7)) & 1;
+}
+
+Coverage* coverage_create();
+void coverage_destroy(Coverage* const coverage);
+
+bool coverage_merge_bitmap_file(Coverage* const coverage, const char* path);
+bool coverage_write_bitmap_file(const Coverage* const coverage,
+                                const char* path);
+bool coverage_write_lcov(Emulator* const emu, const char* path);
+void coverage_finish(Emulator* const emu);
+void display_coverage(Emulator* const emu);
+
+#endif
@@ -18,6 +18,12 @@
 
 #include "debugger.h"
 #include "io.h"
+#include "../devices/snapshot.h"
+#include "../devices/machine.h"
+#include "../devices/cpu/interrupts.h"
+#include "../devices/peripherals/usci.h"
+#include "../devices/peripherals/port1.h"
+#include "../devices/peripherals/flash.h"
 extern uint8_t* MEMSPACE;
 
 Emulator *local_emu = NULL;
@@ -52,6 +58,7 @@ bool exec_cmd (Emulator *emu, char *line, int len)
 
       reset_cpu_stats(emu);
       reset_call_tracer(emu);
+      reset_interrupts(emu);
       display_registers(emu);
       disassemble(emu, cpu->pc, 1);
     }
@@ -69,11 +76,18 @@ bool exec_cmd (Emulator *emu, char *line, int len)
 
       for (i = 0;i < steps;i++) {
         // Let's handle breakpoints - except the one we are stopped on.
+        if (service_interrupts(emu) && handle_breakpoints(emu))
+          break;
         if (handle_breakpoints(emu) && i > 0)
           break;
-        decode(emu, fetch(emu, true), EXECUTE);
+        const LowPowerState lowPower = handle_low_power_mode(emu);
+        if (lowPower == LowPower_Stuck)
+          break;
+        if (lowPower == LowPower_Active)
+          decode(emu, fetch(emu, true), EXECUTE);
+        scheduler_run_due(emu);
 
-        if (emu->debugger->error != 0)
+        if (emu->debugger->error != 0 || deb->quit)
           break;
       }
 
@@ -93,8 +107,28 @@ bool exec_cmd (Emulator *emu, char *line, int len)
   else if ( !strncasecmp("run", cmd, sizeof "run") ||
       !strncasecmp("r", cmd, sizeof "r"))
     {
-      cpu->running = true;
-      deb->debug_mode = false;
+      // run N [cycles|instructions], a quantum of instructions or cycles
+      if (ops >= 2) {
+        char unit[16] = {0};
+        char str[100] = {0};
+        sscanf(line, "%*s %*u %15s", unit);
+        const bool cycles = !strcasecmp("cycles", unit);
+        if (!cycles && unit[0] != 0 && strcasecmp("instructions", unit)) {
+          print_console(emu, "Unit must be cycles or instructions\n");
+          return true;
+        }
+        const StopReason reason = machine_run(emu, cycles ? 0 : op1,
+                                              cycles ? op1 : 0);
+        sprintf(str, "\n\t[Stopped: %s]\n\n", stop_reason_name(reason));
+        print_console(emu, str);
+        display_registers(emu);
+        disassemble(emu, cpu->pc, 1);
+      }
+      else {
+        cpu->running = true;
+        deb->debug_mode = false;
+        deb->stop_reason = StopReason_None;
+      }
 
       //update_register_display(emu);
     }
@@ -174,10 +208,14 @@ bool exec_cmd (Emulator *emu, char *line, int len)
         addr_str = reg_name_or_addr;
         printf("In addr part...\n");
 
-        uint16_t virtual_addr = (uint16_t) strtol(addr_str, NULL, 0);
+        // Word access ignores bit 0, as on the CPU
+        uint16_t virtual_addr = (uint16_t) strtol(addr_str, NULL, 0) & ~1;
 
-        uint16_t *p = get_addr_ptr(virtual_addr);
-        *p = value;
+        // Store directly like the GDB stub, the flash controller would
+        // drop a plain write to flash
+        memory_hook_range(virtual_addr, 2);
+        ((uint16_t*)MEMSPACE)[virtual_addr / 2] = (uint16_t)value;
+        memory_mark_dirty(virtual_addr, 2);
       }
     }
 
@@ -193,10 +231,9 @@ bool exec_cmd (Emulator *emu, char *line, int len)
       char entry[100] = {0};
 
       if (ops == 2) {
-        sscanf(line, "%s %X", bogus1, (unsigned int *)&deb->bp_addresses[deb->num_bps]);
-        sprintf(entry, "\n\t[Breakpoint PC[%d] Set]\n", deb->num_bps + 1);
+        add_breakpoint(emu, (uint16_t) bogus2);
+        sprintf(entry, "\n\t[Breakpoint PC[%d] Set]\n", deb->num_bps);
         print_console(emu, entry);
-        ++deb->num_bps;
       }
       else {
         print_console(emu, "error\n");
@@ -215,10 +252,10 @@ bool exec_cmd (Emulator *emu, char *line, int len)
       char entry[100] = {0};
 
       if (ops == 2) {
-        sscanf(line, "%s %X", bogus1, (unsigned int *)&deb->memory_bp_addresses[deb->num_memory_bps]);
-        sprintf(entry, "\n\t[Breakpoint MEM[%d] Set]\n", deb->num_memory_bps + 1);
+        add_memory_breakpoint(emu, (uint16_t) bogus2,
+                              MemoryCell_Flag_Written | MemoryCell_Flag_Read);
+        sprintf(entry, "\n\t[Breakpoint MEM[%d] Set]\n", deb->num_memory_bps);
         print_console(emu, entry);
-        ++deb->num_memory_bps;
       }
       else {
         print_console(emu, "error\n");
@@ -274,6 +311,184 @@ bool exec_cmd (Emulator *emu, char *line, int len)
     display_cpu_stats(emu);
   }
 
+  // Show coverage summary or write coverage files //
+  else if (!strncasecmp("coverage", cmd, sizeof "coverage"))
+  {
+    char action[100] = {0}, path[512] = {0};
+    sscanf(line, "%s %99s %511s", bogus1, action, path);
+
+    if (emu->coverage == NULL || action[0] == 0) {
+      display_coverage(emu);
+    }
+    else if (!strncasecmp("lcov", action, sizeof "lcov") && path[0] != 0) {
+      if (!coverage_write_lcov(emu, path))
+        print_console(emu, "Could not write lcov tracefile.\n");
+    }
+    else if (!strncasecmp("save", action, sizeof "save") && path[0] != 0) {
+      if (!coverage_write_bitmap_file(emu->coverage, path))
+        print_console(emu, "Could not write coverage bitmap.\n");
+    }
+    else {
+      print_console(emu, "error\n");
+    }
+  }
+
+  // snapshot save|load [FILE], in memory without a file name //
+  else if (!strncasecmp("snapshot", cmd, sizeof "snapshot"))
+  {
+    char action[100] = {0}, path[512] = {0};
+    const int args = sscanf(line, "%s %99s %511s", bogus1, action, path);
+    bool ok = true;
+
+    if (args < 2) {
+      print_console(emu, "error\n");
+      return true;
+    }
+
+    if (emu->snapshot == NULL)
+      emu->snapshot = snapshot_create();
+
+    if (!strncasecmp("save", action, sizeof "save")) {
+      if (args == 3)
+        ok = snapshot_write_file(emu, path);
+      else
+        snapshot_save(emu, emu->snapshot);
+    }
+    else if (!strncasecmp("load", action, sizeof "load")) {
+      if (args == 3)
+        ok = snapshot_read_file(emu, path);
+      else
+        ok = snapshot_restore(emu, emu->snapshot);
+
+      if (ok) {
+        journal_clear(emu->journal);
+        display_registers(emu);
+        disassemble(emu, cpu->pc, 1);
+      }
+    }
+    else {
+      print_console(emu, "error\n");
+      return true;
+    }
+
+    print_console(emu, ok ? "\t[Snapshot done]\n" : "\t[Snapshot failed]\n");
+  }
+
+  // journal on [N]|off, record history for reverse execution //
+  else if (!strncasecmp("journal", cmd, sizeof "journal"))
+  {
+    char action[100] = {0};
+    unsigned int steps = Journal_DefaultSteps;
+    char buffer[128];
+    sscanf(line, "%s %99s %u", bogus1, action, &steps);
+
+    if (!strncasecmp("on", action, sizeof "on"))
+      journal_enable(emu, steps);
+    else if (!strncasecmp("off", action, sizeof "off"))
+      journal_disable(emu);
+    else if (action[0] != 0) {
+      print_console(emu, "error\n");
+      return true;
+    }
+
+    if (emu->journal == NULL) {
+      print_console(emu, "Journal is off\n");
+    }
+    else {
+      sprintf(buffer, "Journal is on, %llu of %u steps recorded\n",
+              (unsigned long long)journal_available_steps(emu->journal),
+              emu->journal->stepCapacity);
+      print_console(emu, buffer);
+    }
+  }
+
+  // rs [NUM], rstep [NUM], step NUM instructions backward //
+  // rc, rcontinue, run backward to the previous breakpoint //
+  else if ( !strncasecmp("rs", cmd, sizeof "rs") ||
+      !strncasecmp("rstep", cmd, sizeof "rstep") ||
+      !strncasecmp("rc", cmd, sizeof "rc") ||
+      !strncasecmp("rcontinue", cmd, sizeof "rcontinue"))
+  {
+    const bool toBreakpoint = !strncasecmp("rc", cmd, sizeof "rc") ||
+      !strncasecmp("rcontinue", cmd, sizeof "rcontinue");
+    uint64_t steps = 1, undone;
+    char buffer[128];
+
+    if (emu->journal == NULL) {
+      print_console(emu, "Journal is off, use 'journal on' first\n");
+      return true;
+    }
+    if (!toBreakpoint && ops == 2)
+      steps = (uint64_t) op1;
+
+    undone = toBreakpoint ? journal_reverse_continue(emu) :
+      journal_reverse_step(emu, steps);
+    deb->error = 0;
+
+    if (undone == 0) {
+      print_console(emu, "\t[Start of journal reached]\n");
+    }
+    else {
+      sprintf(buffer, "\t[%llu steps back]\n", (unsigned long long)undone);
+      print_console(emu, buffer);
+    }
+    display_registers(emu);
+    disassemble(emu, cpu->pc, 1);
+  }
+
+  // irq [N], show the interrupt state or request vector N //
+  else if (!strncasecmp("irq", cmd, sizeof "irq"))
+  {
+    if (ops == 2) {
+      if (op1 >= Interrupt_Reset) {
+        print_console(emu, "error\n");
+        return true;
+      }
+      interrupt_request(emu, (uint8_t) op1);
+    }
+    display_interrupts(emu);
+  }
+
+  // Show the UART state //
+  else if (!strncasecmp("uart", cmd, sizeof "uart"))
+  {
+    if (cpu->usci == NULL) {
+      print_console(emu, "The device has no UART\n");
+      return true;
+    }
+    display_usci(emu);
+  }
+
+  // p1 [LEVELS], show port 1 or drive its input pins //
+  else if (!strncasecmp("p1", cmd, sizeof "p1"))
+  {
+    if (cpu->p1 == NULL) {
+      print_console(emu, "The device has no port 1\n");
+      return true;
+    }
+    if (sscanf(line, "%s %X", bogus1, &bogus2) == 2)
+      port_1_drive_inputs(emu, (uint8_t) bogus2);
+    display_port_1(emu);
+  }
+
+  // Show the flash controller state //
+  else if (!strncasecmp("flash", cmd, sizeof "flash"))
+  {
+    if (cpu->flash == NULL) {
+      print_console(emu, "The device has no flash controller\n");
+      return true;
+    }
+    display_flash(emu);
+  }
+
+  // Show the emulated part //
+  else if (!strncasecmp("device", cmd, sizeof "device"))
+  {
+    char buffer[256];
+    device_describe(emu->device, buffer, sizeof buffer);
+    print_console(emu, buffer);
+  }
+
   // help, display a list of debugger cmds //
   else if ( !strncasecmp("help", cmd, sizeof "help") ||
       !strncasecmp("h", cmd, sizeof "h") )
@@ -342,6 +557,7 @@ void setup_debugger(Emulator *emu)
   memset(deb->bp_addresses, 0, sizeof(deb->bp_addresses));
   deb->num_bps = 0;
   deb->num_memory_bps = 0;
+  deb->memory_bp_hit = -1;
 }
 
 void handle_sigint(int sig)
@@ -350,6 +566,7 @@ void handle_sigint(int sig)
 
   local_emu->cpu->running = false;
   local_emu->debugger->debug_mode = true;
+  local_emu->debugger->stop_reason = StopReason_Interrupt;
 }
 
 void register_signal(int sig)
@@ -379,14 +596,20 @@ bool handle_breakpoints (Emulator *emu)
     if (cpu->pc == deb->bp_addresses[i]) {
       sprintf(str, "\n\t[Breakpoint PC[%d] hit]\n\n", i + 1);
       print_console(emu, str);
+      deb->stop_reason = StopReason_Breakpoint;
       handle_breakpoint_hit(emu);
       return true;
     }
   }
 
   for (i = 0;i < deb->num_memory_bps;i++) {
-    if (memory_get_flags_of_virtual_address(
-          (void*)((uintptr_t)(deb->memory_bp_addresses[i]))) != 0) {
+    const uint16_t address = deb->memory_bp_addresses[i];
+    if (memory_get_flags_of_virtual_address((void*)((uintptr_t)address)) &
+        deb->memory_bp_flags[i]) {
+      // Stop again on the next access only
+      memory_clear_flags(get_addr_ptr(address));
+      deb->memory_bp_hit = i;
+      deb->stop_reason = StopReason_Watchpoint;
       sprintf(str, "\n\t[Breakpoint MEM[%d] hit]\n\n", i + 1);
       print_console(emu, str);
       handle_breakpoint_hit(emu);
@@ -395,3 +618,104 @@ bool handle_breakpoints (Emulator *emu)
   }
   return false;
 }
+
+/**
+ * @brief Stop before the instruction at address
+ * @return false if the breakpoints are full
+ */
+bool add_breakpoint(Emulator* const emu, const uint16_t address)
+{
+  Debugger* const deb = emu->debugger;
+
+  if (deb->num_bps >= MAX_BREAKPOINTS)
+    return false;
+  deb->bp_addresses[deb->num_bps++] = address;
+  return true;
+}
+
+/**
+ * @return false if there is no breakpoint at address
+ */
+bool remove_breakpoint(Emulator* const emu, const uint16_t address)
+{
+  Debugger* const deb = emu->debugger;
+
+  for (uint32_t i = 0; i < deb->num_bps; i++) {
+    if (deb->bp_addresses[i] == address) {
+      deb->bp_addresses[i] = deb->bp_addresses[--deb->num_bps];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Stop after an instruction read or wrote the byte at address
+ * @param flags MemoryCell_Flag_Read and/or MemoryCell_Flag_Written
+ * @return false if the breakpoints are full
+ */
+bool add_memory_breakpoint(Emulator* const emu, const uint16_t address,
+                           const uint8_t flags)
+{
+  Debugger* const deb = emu->debugger;
+
+  if (deb->num_memory_bps >= MAX_BREAKPOINTS)
+    return false;
+  memory_clear_flags(get_addr_ptr(address));
+  deb->memory_bp_addresses[deb->num_memory_bps] = address;
+  deb->memory_bp_flags[deb->num_memory_bps] = flags;
+  deb->num_memory_bps++;
+  return true;
+}
+
+/**
+ * @return false if there is no such memory breakpoint
+ */
+bool remove_memory_breakpoint(Emulator* const emu, const uint16_t address,
+                              const uint8_t flags)
+{
+  Debugger* const deb = emu->debugger;
+
+  for (uint16_t i = 0; i < deb->num_memory_bps; i++) {
+    if (deb->memory_bp_addresses[i] == address &&
+        deb->memory_bp_flags[i] == flags) {
+      --deb->num_memory_bps;
+      deb->memory_bp_addresses[i] = deb->memory_bp_addresses[deb->num_memory_bps];
+      deb->memory_bp_flags[i] = deb->memory_bp_flags[deb->num_memory_bps];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Forget accesses to watched memory made before the CPU resumes
+ */
+void rearm_memory_breakpoints(Emulator* const emu)
+{
+  Debugger* const deb = emu->debugger;
+
+  for (uint16_t i = 0; i < deb->num_memory_bps; i++)
+    memory_clear_flags(get_addr_ptr(deb->memory_bp_addresses[i]));
+  deb->memory_bp_hit = -1;
+}
+
+/**
+ * @return A lower case name of the stop reason, as used by batch status files
+ */
+const char* stop_reason_name(const StopReason reason)
+{
+  switch (reason) {
+    case StopReason_Exit: return "exit";
+    case StopReason_Breakpoint: return "breakpoint";
+    case StopReason_Watchpoint: return "watchpoint";
+    case StopReason_IllegalInstruction: return "illegal_instruction";
+    case StopReason_LowPowerStuck: return "low_power_stuck";
+    case StopReason_Interrupt: return "interrupt";
+    case StopReason_InstructionLimit: return "instruction_limit";
+    case StopReason_CycleLimit: return "cycle_limit";
+    case StopReason_Timeout: return "timeout";
+    case StopReason_IdleLoopStuck: return "idle_loop_stuck";
+    default: return "none";
+  }
+}
@@ -29,6 +29,21 @@ enum { MAX_BREAKPOINTS = 100 };
 
 enum { ERROR_ILLEGAL_INSTRUCTION = 1 };
 
+// Why the CPU last stopped running //
+typedef enum {
+  StopReason_None,               // Not stopped since the last run
+  StopReason_Exit,               // Emulator call 0x0000
+  StopReason_Breakpoint,
+  StopReason_Watchpoint,         // Memory breakpoint
+  StopReason_IllegalInstruction, // ERROR_ILLEGAL_INSTRUCTION
+  StopReason_LowPowerStuck,      // CPU off without a wake-up source
+  StopReason_Interrupt,          // CONTROL-c or a GDB interrupt
+  StopReason_InstructionLimit,   // --max-instructions, see limits.c
+  StopReason_CycleLimit,         // --max-cycles
+  StopReason_Timeout,            // --timeout
+  StopReason_IdleLoopStuck,      // Idle loop without a wake-up source
+} StopReason;
+
 typedef struct Debugger
 {
   bool disassemble_mode;
@@ -40,8 +55,11 @@ typedef struct Debugger
 
   uint16_t bp_addresses[MAX_BREAKPOINTS];
   uint16_t memory_bp_addresses[MAX_BREAKPOINTS];
+  uint8_t memory_bp_flags[MAX_BREAKPOINTS]; // MemoryCell_Flag accesses to stop on
   uint16_t num_memory_bps;
   uint32_t num_bps;
+  int32_t memory_bp_hit; // Memory breakpoint which stopped the CPU, -1 if none
+  StopReason stop_reason;
 
 } Debugger;
 
@@ -56,6 +74,15 @@ void handle_sigint(int signal);
 
 bool exec_cmd (Emulator *emu, char *buf, int len);
 
+const char* stop_reason_name(const StopReason reason);
+
 bool handle_breakpoints (Emulator *emu);
+bool add_breakpoint(Emulator* const emu, const uint16_t address);
+bool remove_breakpoint(Emulator* const emu, const uint16_t address);
+bool add_memory_breakpoint(Emulator* const emu, const uint16_t address,
+                           const uint8_t flags);
+bool remove_memory_breakpoint(Emulator* const emu, const uint16_t address,
+                              const uint8_t flags);
+void rearm_memory_breakpoints(Emulator* const emu);
 
 #endif
@@ -0,0 +1,712 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ In-process coverage-guided fuzzing +++##########
+//# The firmware runs from reset once, up to the entry of a harness
+//# function, and the machine state there is saved in a snapshot.
+//# Each input is then copied into a RAM buffer, the harness is run
+//# with the buffer address in R12 and the input size in R13 (the
+//# msp430-elf-gcc calling convention) until it returns, and the
+//# snapshot is restored. Only the pages the run dirtied are copied
+//# back, so an input costs about as much as the code it executes.
+//#
+//# Edge coverage goes into an AFL style bitmap: Format III jumps
+//# and CALLs hash their target with the previous location. When
+//# __AFL_SHM_ID is set, the bitmap is AFL's shared memory segment.
+//#
+//# An input crashes the firmware on an illegal instruction, an
+//# exit call with a nonzero code, SP outside of RAM (or below the
+//# stack limit) and a damaged canary at the stack limit. It hangs
+//# when it exhausts its instruction budget or the CPU gets stuck.
+//#
+//# The built-in driver keeps inputs which produce new bitmap
+//# buckets in the corpus directory and writes crashing and hanging
+//# inputs next to them as crash-N and hang-N.
+//#
+//# As an AFL fork server the emulator stops at the harness once,
+//# then forks a child per test case from there. The child runs the
+//# input and aborts if it crashed, so AFL sees the usual signal.
+//# A child whose input hung waits until AFL's timeout kills it, so
+//# AFL counts a hang instead of a clean exit.
+//##############################################################
+
+#include <dirent.h>
+#include <time.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "fuzz.h"
+#include "io.h"
+#include "../devices/snapshot.h"
+#include "../devices/cpu/interrupts.h"
+
+#define AFL_SHM_ENV "__AFL_SHM_ID"
+
+enum { Fuzz_CanaryByte = 0xA5 };
+enum { Fuzz_MaxStackedMutations = 16 };
+enum { Fuzz_MaxPathLength = 4096 };
+
+extern uint8_t* MEMSPACE;
+
+Fuzzer* fuzz_get(Emulator* const emu)
+{
+  if (emu->fuzz == NULL)
+  {
+    emu->fuzz = (Fuzzer*) calloc(1, sizeof(Fuzzer));
+    emu->fuzz->maxInstructions = Fuzz_DefaultMaxInstructions;
+  }
+  return emu->fuzz;
+}
+
+/**
+ * @brief Parse the input buffer, "ADDR:SIZE" with a hex address
+ */
+bool fuzz_parse_buffer(Fuzzer* const fuzz, const char* spec)
+{
+  char* end;
+  const unsigned long address = strtoul(spec, &end, 16);
+  unsigned long size;
+
+  if (*end != ':')
+    return false;
+  size = strtoul(end + 1, &end, 0);
+  if (*end != '\0' || size == 0 || address + size > ADDRESS_SPACE_SIZE)
+    return false;
+
+  fuzz->bufferAddress = (uint16_t)address;
+  fuzz->bufferSize = (uint16_t)size;
+  return true;
+}
+
+const char* fuzz_crash_name(const FuzzCrash crash)
+{
+  switch (crash) {
+    case FuzzCrash_IllegalInstruction: return "illegal_instruction";
+    case FuzzCrash_StackPointer: return "stack_pointer";
+    case FuzzCrash_StackCanary: return "stack_canary";
+    case FuzzCrash_Abort: return "abort";
+    default: return "none";
+  }
+}
+
+/**
+ * @brief Execute until PC reaches stopPc with SP at or above minSp
+ * @return false if the budget ran out or the CPU stopped first
+ */
+static bool execute_until(Emulator* const emu, const uint16_t stopPc,
+                          const uint16_t minSp, const uint64_t budget)
+{
+  Cpu* const cpu = emu->cpu;
+  Debugger* const deb = emu->debugger;
+  const uint64_t last = cpu->stats.instructions.executed + budget;
+
+  cpu->running = true;
+  while (cpu->running && !deb->quit)
+  {
+    while (cpu->running && cpu->cycles < scheduler_next_cycle(emu->scheduler))
+    {
+      if (cpu->pc == stopPc && cpu->sp >= minSp)
+        return true;
+      if (cpu->stats.instructions.executed >= last)
+        return false;
+
+      service_interrupts(emu);
+      const LowPowerState lowPower = handle_low_power_mode(emu);
+      if (lowPower == LowPower_Stuck)
+        return false;
+      if (lowPower == LowPower_Active)
+        decode(emu, fetch(emu, true), EXECUTE);
+    }
+    scheduler_run_due(emu);
+  }
+  return false;
+}
+
+static bool attach_trace(Fuzzer* const fuzz)
+{
+  const char* const id = getenv(AFL_SHM_ENV);
+
+  if (id != NULL)
+  {
+    void* const shared = shmat(atoi(id), NULL, 0);
+    if (shared == (void*)-1)
+      return false;
+    fuzz->trace = (uint8_t*)shared;
+    fuzz->sharedTrace = true;
+    return true;
+  }
+
+  fuzz->trace = (uint8_t*) calloc(Fuzz_MapSize, 1);
+  return true;
+}
+
+/**
+ * @brief Run the firmware to the harness and take the snapshot
+ */
+bool fuzz_prepare(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  Cpu* const cpu = emu->cpu;
+
+  if (fuzz->harnessPc == 0 || fuzz->bufferSize == 0)
+  {
+    printf("Fuzzing needs --fuzz-harness and --fuzz-buffer\n");
+    return false;
+  }
+  if (fuzz->trace == NULL && !attach_trace(fuzz))
+  {
+    printf("Could not attach the AFL shared memory %s\n", getenv(AFL_SHM_ENV));
+    return false;
+  }
+
+  emu->quiet = true;
+  const bool reached = execute_until(emu, fuzz->harnessPc, 0,
+                                     Fuzz_SetupMaxInstructions);
+  emu->quiet = false;
+  if (!reached)
+  {
+    printf("The firmware did not reach the harness at %04X\n", fuzz->harnessPc);
+    return false;
+  }
+
+  fuzz->entrySp = cpu->sp;
+  fuzz->returnPc = *(uint16_t*)(MEMSPACE + cpu->sp);
+  fuzz->canary = fuzz->stackLimit != 0;
+  if (fuzz->canary)
+  {
+    memset(MEMSPACE + fuzz->stackLimit, Fuzz_CanaryByte, Fuzz_CanaryBytes);
+    memory_mark_dirty(fuzz->stackLimit, Fuzz_CanaryBytes);
+  }
+
+  fuzz->snapshot = snapshot_create();
+  snapshot_save(emu, fuzz->snapshot);
+  return true;
+}
+
+/**
+ * @brief Called on every SP change, see update_cpu_stats()
+ */
+void fuzz_check_stack(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  Cpu* const cpu = emu->cpu;
+  const uint32_t ramEnd = emu->device->ramStart + emu->device->ramSize;
+  const uint32_t lowest = fuzz->canary ?
+    fuzz->stackLimit + Fuzz_CanaryBytes : emu->device->ramStart;
+
+  // Startup code may set SP up anywhere
+  if (fuzz->snapshot == NULL)
+    return;
+
+  if (cpu->sp < lowest || cpu->sp > ramEnd)
+  {
+    fuzz->crash = FuzzCrash_StackPointer;
+    cpu->running = false;
+  }
+}
+
+static bool canary_intact(const Fuzzer* const fuzz)
+{
+  for (uint32_t i = 0; i < Fuzz_CanaryBytes; i++)
+  {
+    if (MEMSPACE[fuzz->stackLimit + i] != Fuzz_CanaryByte)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Run the harness on one input and restore the snapshot
+ */
+FuzzResult fuzz_run_input(Emulator* const emu, const uint8_t* data,
+                          uint16_t size)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  Cpu* const cpu = emu->cpu;
+  Debugger* const deb = emu->debugger;
+  FuzzResult result = FuzzResult_Ok;
+
+  if (size > fuzz->bufferSize)
+    size = fuzz->bufferSize;
+
+  memset(fuzz->trace, 0, Fuzz_MapSize);
+  fuzz->previousLocation = 0;
+  fuzz->crash = FuzzCrash_None;
+  deb->stop_reason = StopReason_None;
+
+  memcpy(MEMSPACE + fuzz->bufferAddress, data, size);
+  memory_mark_dirty(fuzz->bufferAddress, size);
+  cpu->r12 = (int16_t)fuzz->bufferAddress;
+  cpu->r13 = (int16_t)size;
+
+  const bool returned = execute_until(emu, fuzz->returnPc,
+                                      (uint16_t)(fuzz->entrySp + 2),
+                                      fuzz->maxInstructions);
+
+  if (deb->stop_reason == StopReason_Interrupt)
+    result = FuzzResult_Interrupted;
+  else
+  {
+    if (fuzz->crash == FuzzCrash_None && deb->error == ERROR_ILLEGAL_INSTRUCTION)
+      fuzz->crash = FuzzCrash_IllegalInstruction;
+    if (fuzz->crash == FuzzCrash_None && deb->quit && emu->exit_code != 0)
+      fuzz->crash = FuzzCrash_Abort;
+    if (fuzz->crash == FuzzCrash_None && fuzz->canary && !canary_intact(fuzz))
+      fuzz->crash = FuzzCrash_StackCanary;
+
+    if (fuzz->crash != FuzzCrash_None)
+      result = FuzzResult_Crash;
+    else if (!returned && !deb->quit)
+      result = FuzzResult_Hang;
+  }
+
+  // Back to the harness entry, only the dirty pages are copied
+  deb->quit = false;
+  deb->error = 0;
+  emu->exit_code = 0;
+  snapshot_restore(emu, fuzz->snapshot);
+  return result;
+}
+
+//##########+++ Fuzzing driver +++##########
+
+// Inputs kept because they produced new coverage //
+typedef struct FuzzCorpus {
+  uint8_t** inputs;
+  uint16_t* sizes;
+  uint32_t count;
+  uint32_t capacity;
+  uint8_t virgin[Fuzz_MapSize];      // Buckets not seen yet, AFL style
+  uint8_t virginCrash[Fuzz_MapSize]; // Per unique crash
+  uint8_t virginHang[Fuzz_MapSize];  // Per unique hang
+  uint64_t random;                   // xorshift64 state
+} FuzzCorpus;
+
+static uint32_t next_random(FuzzCorpus* const corpus)
+{
+  corpus->random ^= corpus->random << 13;
+  corpus->random ^= corpus->random >> 7;
+  corpus->random ^= corpus->random << 17;
+  return (uint32_t)(corpus->random >> 32);
+}
+
+// Hit counts in AFL's buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static uint8_t bucket_of(const uint8_t count)
+{
+  if (count <= 3)
+    return (uint8_t)(count == 3 ? 4 : count);
+  if (count < 8) return 8;
+  if (count < 16) return 16;
+  if (count < 32) return 32;
+  if (count < 128) return 64;
+  return 128;
+}
+
+static bool has_new_bits(uint8_t* const virgin, const uint8_t* const trace)
+{
+  bool found = false;
+
+  for (uint32_t i = 0; i < Fuzz_MapSize; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, trace + i, sizeof word);
+    if (word == 0)
+      continue;
+    for (uint32_t j = i; j < i + sizeof(uint64_t); j++)
+    {
+      const uint8_t bucket = trace[j] ? bucket_of(trace[j]) : 0;
+      if (virgin[j] & bucket)
+      {
+        virgin[j] &= (uint8_t)~bucket;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+static uint32_t count_edges(const uint8_t* const virgin)
+{
+  uint32_t edges = 0;
+  for (uint32_t i = 0; i < Fuzz_MapSize; i++)
+    edges += virgin[i] != 0xFF;
+  return edges;
+}
+
+static void add_to_corpus(FuzzCorpus* const corpus, const uint8_t* data,
+                          const uint16_t size)
+{
+  if (corpus->count == corpus->capacity)
+  {
+    corpus->capacity = corpus->capacity ? 2 * corpus->capacity : 64;
+    corpus->inputs = realloc(corpus->inputs, corpus->capacity * sizeof(uint8_t*));
+    corpus->sizes = realloc(corpus->sizes, corpus->capacity * sizeof(uint16_t));
+  }
+  corpus->inputs[corpus->count] = malloc(size > 0 ? size : 1);
+  memcpy(corpus->inputs[corpus->count], data, size);
+  corpus->sizes[corpus->count++] = size;
+}
+
+static bool write_input(const char* directory, const char* name,
+                        const uint8_t* data, const uint16_t size)
+{
+  char path[Fuzz_MaxPathLength];
+  snprintf(path, sizeof path, "%s/%s", directory, name);
+
+  FILE* const file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+  const bool written = size == 0 || fwrite(data, size, 1, file) == 1;
+  return fclose(file) == 0 && written;
+}
+
+static uint16_t read_input(const char* path, uint8_t* data, const uint16_t maxSize)
+{
+  FILE* const file = fopen(path, "rb");
+  if (file == NULL)
+    return 0;
+  const size_t size = fread(data, 1, maxSize, file);
+  fclose(file);
+  return (uint16_t)size;
+}
+
+static void load_seeds(Emulator* const emu, FuzzCorpus* const corpus)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  uint8_t* const data = malloc(fuzz->bufferSize);
+  char path[Fuzz_MaxPathLength];
+  DIR* const directory = opendir(fuzz->path);
+  struct dirent* entry;
+
+  while (directory != NULL && (entry = readdir(directory)) != NULL)
+  {
+    if (entry->d_name[0] == '.' || !strncmp(entry->d_name, "crash-", 6) ||
+        !strncmp(entry->d_name, "hang-", 5))
+      continue;
+    snprintf(path, sizeof path, "%s/%s", fuzz->path, entry->d_name);
+    const uint16_t size = read_input(path, data, fuzz->bufferSize);
+    if (fuzz_run_input(emu, data, size) == FuzzResult_Ok)
+    {
+      has_new_bits(corpus->virgin, fuzz->trace);
+      add_to_corpus(corpus, data, size);
+    }
+  }
+  if (directory != NULL)
+    closedir(directory);
+
+  if (corpus->count == 0)
+  {
+    data[0] = 0;
+    add_to_corpus(corpus, data, 1);
+  }
+  free(data);
+}
+
+static const uint8_t InterestingBytes[] = { 0, 1, 0x7F, 0x80, 0xFF, 0x10, 0x20, 0x40 };
+
+/**
+ * @brief Stack a few random mutations onto a copy of a corpus input
+ */
+static uint16_t mutate(FuzzCorpus* const corpus, uint8_t* const data,
+                       uint16_t size, const uint16_t maxSize)
+{
+  const uint32_t count = 1u << (1 + next_random(corpus) % 4);
+
+  for (uint32_t i = 0; i < count && i < Fuzz_MaxStackedMutations; i++)
+  {
+    const uint32_t at = size > 0 ? next_random(corpus) % size : 0;
+
+    switch (next_random(corpus) % 7)
+    {
+      case 0: // Flip a bit
+        if (size > 0)
+          data[at] ^= (uint8_t)(1u << (next_random(corpus) % 8));
+        break;
+      case 1: // Random byte
+        if (size > 0)
+          data[at] = (uint8_t)next_random(corpus);
+        break;
+      case 2: // Small arithmetic
+        if (size > 0)
+          data[at] += (uint8_t)(next_random(corpus) % 35) - 17;
+        break;
+      case 3: // Interesting value
+        if (size > 0)
+          data[at] = InterestingBytes[next_random(corpus) % sizeof InterestingBytes];
+        break;
+      case 4: // Insert a byte
+        if (size < maxSize)
+        {
+          memmove(data + at + 1, data + at, size - at);
+          data[at] = (uint8_t)next_random(corpus);
+          size++;
+        }
+        break;
+      case 5: // Delete a byte
+        if (size > 1)
+        {
+          memmove(data + at, data + at + 1, size - at - 1);
+          size--;
+        }
+        break;
+      default: // Splice in a block of another input
+      {
+        const uint32_t other = next_random(corpus) % corpus->count;
+        const uint16_t otherSize = corpus->sizes[other];
+        if (otherSize == 0 || size == 0)
+          break;
+        const uint32_t from = next_random(corpus) % otherSize;
+        uint32_t length = 1 + next_random(corpus) % (otherSize - from);
+        if (length > (uint32_t)(size - at))
+          length = size - at;
+        memcpy(data + at, corpus->inputs[other] + from, length);
+        break;
+      }
+    }
+  }
+  return size;
+}
+
+static double seconds_since(const struct timespec* const start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+    (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int fuzz_loop(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  FuzzCorpus* const corpus = (FuzzCorpus*) calloc(1, sizeof(FuzzCorpus));
+  uint8_t* const data = malloc(fuzz->bufferSize);
+  uint64_t runs = 0, crashes = 0, hangs = 0;
+  double lastReport = 0;
+  struct timespec start;
+  char name[64];
+
+  memset(corpus->virgin, 0xFF, Fuzz_MapSize);
+  memset(corpus->virginCrash, 0xFF, Fuzz_MapSize);
+  memset(corpus->virginHang, 0xFF, Fuzz_MapSize);
+  corpus->random = (uint64_t)time(NULL) * 0x9E3779B97F4A7C15ull | 1;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  load_seeds(emu, corpus);
+  printf("Fuzzing harness %04X, %u seeds\n", fuzz->harnessPc, corpus->count);
+
+  while (fuzz->runs == 0 || runs < fuzz->runs)
+  {
+    const uint32_t pick = next_random(corpus) % corpus->count;
+    uint16_t size = corpus->sizes[pick];
+    memcpy(data, corpus->inputs[pick], size);
+    size = mutate(corpus, data, size, fuzz->bufferSize);
+
+    const FuzzResult result = fuzz_run_input(emu, data, size);
+    if (result == FuzzResult_Interrupted)
+      break;
+    runs++;
+    if (result == FuzzResult_Crash)
+      crashes++;
+    else if (result == FuzzResult_Hang)
+      hangs++;
+
+    if (result == FuzzResult_Ok && has_new_bits(corpus->virgin, fuzz->trace))
+    {
+      snprintf(name, sizeof name, "id-%06u", corpus->count);
+      write_input(fuzz->path, name, data, size);
+      add_to_corpus(corpus, data, size);
+    }
+    else if (result == FuzzResult_Crash &&
+             has_new_bits(corpus->virginCrash, fuzz->trace))
+    {
+      snprintf(name, sizeof name, "crash-%06llu-%s", (unsigned long long)runs,
+               fuzz_crash_name(fuzz->crash));
+      write_input(fuzz->path, name, data, size);
+    }
+    else if (result == FuzzResult_Hang &&
+             has_new_bits(corpus->virginHang, fuzz->trace))
+    {
+      snprintf(name, sizeof name, "hang-%06llu", (unsigned long long)runs);
+      write_input(fuzz->path, name, data, size);
+    }
+
+    const double elapsed = seconds_since(&start);
+    if (elapsed - lastReport >= 1.0)
+    {
+      lastReport = elapsed;
+      printf("#%llu\t%.0f execs/s\tcorpus %u\tedges %u\tcrashes %llu\thangs %llu\n",
+             (unsigned long long)runs, runs / elapsed, corpus->count,
+             count_edges(corpus->virgin), (unsigned long long)crashes,
+             (unsigned long long)hangs);
+    }
+  }
+
+  printf("Done: %llu runs, corpus %u, edges %u, crashes %llu, hangs %llu\n",
+         (unsigned long long)runs, corpus->count, count_edges(corpus->virgin),
+         (unsigned long long)crashes, (unsigned long long)hangs);
+
+  for (uint32_t i = 0; i < corpus->count; i++)
+    free(corpus->inputs[i]);
+  free(corpus->inputs);
+  free(corpus->sizes);
+  free(corpus);
+  free(data);
+  return crashes > 0 ? Fuzz_CrashExitCode : 0;
+}
+
+/**
+ * @brief Run a single input and report how it ended
+ */
+static int replay(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  uint8_t* const data = malloc(fuzz->bufferSize);
+  const uint16_t size = read_input(fuzz->path, data, fuzz->bufferSize);
+  const FuzzResult result = fuzz_run_input(emu, data, size);
+
+  free(data);
+  switch (result)
+  {
+    case FuzzResult_Crash:
+      printf("%s: crash (%s)\n", fuzz->path, fuzz_crash_name(fuzz->crash));
+      return Fuzz_CrashExitCode;
+    case FuzzResult_Hang:
+      printf("%s: hang\n", fuzz->path);
+      return Fuzz_HangExitCode;
+    default:
+      printf("%s: ok\n", fuzz->path);
+      return 0;
+  }
+}
+
+/**
+ * @brief Child of the fork server: run AFL's current input
+ */
+static int run_fork_server_child(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+  uint8_t* const data = malloc(fuzz->bufferSize);
+  uint16_t size = 0;
+
+  if (fuzz->path != NULL)
+    size = read_input(fuzz->path, data, fuzz->bufferSize);
+  else
+  {
+    ssize_t length;
+    while (size < fuzz->bufferSize &&
+           (length = read(STDIN_FILENO, data + size, fuzz->bufferSize - size)) > 0)
+      size += (uint16_t)length;
+  }
+
+  switch (fuzz_run_input(emu, data, size))
+  {
+    case FuzzResult_Crash:
+      abort();
+    case FuzzResult_Hang:
+      // Exiting would look like a finished run, leave it to AFL's timeout
+      for (;;)
+        pause();
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Serve AFL's fork server protocol: a hello on the status pipe,
+ * then per test case a request on the control pipe, answered with the
+ * child's PID and its wait status
+ */
+static int fork_server(Emulator* const emu)
+{
+  uint32_t message = 0;
+
+  if (write(Fuzz_ForkServerStatusFd, &message, sizeof message) != sizeof message)
+  {
+    printf("No AFL fork server pipe on descriptor %d\n", Fuzz_ForkServerStatusFd);
+    return 1;
+  }
+
+  while (read(Fuzz_ForkServerControlFd, &message, sizeof message) == sizeof message)
+  {
+    int status;
+    const pid_t child = fork();
+
+    if (child < 0)
+      return 1;
+    if (child == 0)
+    {
+      close(Fuzz_ForkServerControlFd);
+      close(Fuzz_ForkServerStatusFd);
+      _exit(run_fork_server_child(emu));
+    }
+
+    message = (uint32_t)child;
+    if (write(Fuzz_ForkServerStatusFd, &message, sizeof message) != sizeof message ||
+        waitpid(child, &status, 0) < 0)
+      return 1;
+    message = (uint32_t)status;
+    if (write(Fuzz_ForkServerStatusFd, &message, sizeof message) != sizeof message)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Serve AFL, fuzz with the corpus directory fuzz->path, or replay
+ * the single input in the file fuzz->path
+ * @return The emulator's exit status
+ */
+int fuzz_main(Emulator* const emu)
+{
+  struct stat status;
+
+  if (emu->fuzz->path == NULL && !emu->fuzz->forkServer)
+  {
+    printf("Fuzzing needs --fuzz DIR|FILE\n");
+    return 1;
+  }
+  if (!fuzz_prepare(emu))
+    return 1;
+
+  emu->quiet = true;
+  int result;
+  if (emu->fuzz->forkServer)
+    result = fork_server(emu);
+  else if (stat(emu->fuzz->path, &status) == 0 && S_ISDIR(status.st_mode))
+    result = fuzz_loop(emu);
+  else
+    result = replay(emu);
+  emu->quiet = false;
+  return result;
+}
+
+void fuzz_destroy(Emulator* const emu)
+{
+  Fuzzer* const fuzz = emu->fuzz;
+
+  if (fuzz == NULL)
+    return;
+  if (fuzz->sharedTrace)
+    shmdt(fuzz->trace);
+  else
+    free(fuzz->trace);
+  snapshot_destroy(fuzz->snapshot);
+  free(fuzz);
+  emu->fuzz = NULL;
+}
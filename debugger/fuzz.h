@@ -0,0 +1,91 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FUZZ_H_
+#define _FUZZ_H_
+
+#include "../main.h"
+
+enum { Fuzz_MapSize = 0x10000 };            // AFL's default MAP_SIZE
+enum { Fuzz_CanaryBytes = 16 };             // Guard at the stack limit
+enum { Fuzz_DefaultMaxInstructions = 1000000 };
+enum { Fuzz_SetupMaxInstructions = 100000000 }; // Reset to the harness
+enum { Fuzz_CrashExitCode = 4 };            // Replayed input crashed
+enum { Fuzz_HangExitCode = 5 };             // Replayed input hung
+enum { Fuzz_ForkServerControlFd = 198 };    // AFL's FORKSRV_FD
+enum { Fuzz_ForkServerStatusFd = 199 };
+
+// How the harness run of one input ended //
+typedef enum {
+  FuzzResult_Ok,    // The harness returned
+  FuzzResult_Crash,
+  FuzzResult_Hang,  // Instruction budget exhausted, or CPU stuck
+  FuzzResult_Interrupted, // CONTROL-c
+} FuzzResult;
+
+typedef enum {
+  FuzzCrash_None,
+  FuzzCrash_IllegalInstruction, // ERROR_ILLEGAL_INSTRUCTION
+  FuzzCrash_StackPointer,       // SP left RAM or went below the stack limit
+  FuzzCrash_StackCanary,        // The guard at the stack limit was overwritten
+  FuzzCrash_Abort,              // Emulator call 0x0000 with a nonzero code
+} FuzzCrash;
+
+// In-process fuzzing state //
+typedef struct Fuzzer {
+  uint16_t harnessPc;       // Entry of void harness(uint8_t* data, uint16_t size)
+  uint16_t bufferAddress;   // RAM receiving the input, passed in R12
+  uint16_t bufferSize;      // Largest input, the size is passed in R13
+  uint16_t stackLimit;      // Lowest stack address, 0 for the RAM start
+  bool canary;              // stackLimit was given, guard it with a canary
+  uint64_t maxInstructions; // Per input
+  const char* path;         // Corpus directory, or a single input to replay
+  bool forkServer;          // Serve AFL, path is its input file or NULL (stdin)
+  uint64_t runs;            // Inputs to try, 0 until CONTROL-c
+
+  uint8_t* trace;           // Edge hit counts of the current input
+  bool sharedTrace;         // trace is an AFL shared memory segment
+  uint16_t previousLocation;
+
+  Snapshot* snapshot;       // Machine state at the harness entry
+  uint16_t returnPc;
+  uint16_t entrySp;
+  FuzzCrash crash;          // Set while running an input
+} Fuzzer;
+
+/**
+ * @brief Count the edge to a Format III jump target or a CALL target
+ */
+static inline void fuzz_mark_edge(Fuzzer* const fuzz, const uint16_t pc)
+{
+  const uint16_t location = (uint16_t)((pc >> 1) * 0x9E3Bu);
+  fuzz->trace[location ^ fuzz->previousLocation]++;
+  fuzz->previousLocation = location >> 1;
+}
+
+Fuzzer* fuzz_get(Emulator* const emu);
+bool fuzz_parse_buffer(Fuzzer* const fuzz, const char* spec);
+bool fuzz_prepare(Emulator* const emu);
+FuzzResult fuzz_run_input(Emulator* const emu, const uint8_t* data,
+                          const uint16_t size);
+void fuzz_check_stack(Emulator* const emu);
+const char* fuzz_crash_name(const FuzzCrash crash);
+int fuzz_main(Emulator* const emu);
+void fuzz_destroy(Emulator* const emu);
+
+#endif
@@ -0,0 +1,706 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ GDB remote serial protocol stub +++##########
+//# msp430-elf-gdb connects over TCP or a Unix domain socket and
+//# drives the emulator through the same breakpoint lists as the
+//# console debugger. While the CPU runs the stub does nothing: the
+//# socket raises SIGIO when GDB sends its interrupt byte, and the
+//# signal stops the CPU like CONTROL-c. Once the CPU stopped, the
+//# stub answers packets until GDB resumes it.
+//#
+//# Registers go over the wire as 32 bit values, as msp430-elf-gdb
+//# expects. Memory packets access MEMSPACE directly, bypassing
+//# peripheral registers and the flash controller, so GDB can load
+//# a program. If the journal is on, reverse stepping is available.
+//##########################################################
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "gdb_stub.h"
+#include "io.h"
+#include "../devices/cpu/interrupts.h"
+#include "../devices/cpu/decoder.h"
+#include "../devices/utilities.h"
+
+extern uint8_t* MEMSPACE;
+
+enum { Gdb_InterruptByte = 0x03 };
+
+// Signal numbers of stop replies //
+enum {
+  Gdb_SignalInt = 2,
+  Gdb_SignalIll = 4,
+  Gdb_SignalTrap = 5,
+};
+
+static const char HexDigits[] = "0123456789abcdef";
+
+static int hex_value(const char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * @brief Parse a hex number, advancing the text pointer past it
+ */
+static uint32_t parse_hex(const char** text)
+{
+  uint32_t value = 0;
+  int digit;
+
+  while ((digit = hex_value(**text)) >= 0)
+  {
+    value = (value << 4) | (uint32_t)digit;
+    (*text)++;
+  }
+  return value;
+}
+
+static bool write_all(const int fd, const char* data, size_t length)
+{
+  while (length > 0)
+  {
+    const ssize_t written = write(fd, data, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    length -= (size_t)written;
+  }
+  return true;
+}
+
+static void disconnect(GdbStub* const stub)
+{
+  if (stub->fd >= 0)
+    close(stub->fd);
+  stub->fd = -1;
+}
+
+/**
+ * @return The next byte from GDB, -1 if the connection was closed
+ */
+static int read_byte(GdbStub* const stub)
+{
+  if (stub->inputHead == stub->inputLength)
+  {
+    ssize_t length;
+    do {
+      length = recv(stub->fd, stub->input, sizeof stub->input, 0);
+    } while (length < 0 && errno == EINTR);
+
+    if (length <= 0)
+    {
+      disconnect(stub);
+      return -1;
+    }
+    stub->inputHead = 0;
+    stub->inputLength = (uint32_t)length;
+  }
+  return stub->input[stub->inputHead++];
+}
+
+/**
+ * @brief Consume an interrupt request sent while the CPU was running
+ */
+static bool take_interrupt(GdbStub* const stub)
+{
+  struct pollfd fd = { .fd = stub->fd, .events = POLLIN };
+
+  if (stub->inputHead == stub->inputLength && poll(&fd, 1, 0) <= 0)
+    return false;
+  if (stub->inputHead == stub->inputLength && read_byte(stub) >= 0)
+    stub->inputHead--;
+  if (stub->fd < 0 || stub->input[stub->inputHead] != Gdb_InterruptByte)
+    return false;
+  stub->inputHead++;
+  return true;
+}
+
+static void send_packet(GdbStub* const stub, const char* data)
+{
+  const size_t length = strlen(data);
+  char trailer[4];
+  uint8_t checksum = 0;
+
+  for (size_t i = 0; i < length; i++)
+    checksum += (uint8_t)data[i];
+  sprintf(trailer, "#%02x", checksum);
+
+  do {
+    if (stub->fd < 0 || !write_all(stub->fd, "$", 1) ||
+        !write_all(stub->fd, data, length) || !write_all(stub->fd, trailer, 3))
+    {
+      disconnect(stub);
+      return;
+    }
+    if (stub->noAck)
+      return;
+
+    int ack;
+    while ((ack = read_byte(stub)) >= 0 && ack != '+' && ack != '-')
+      ;
+    if (ack != '-')
+      return;
+  } while (true);
+}
+
+/**
+ * @brief Wait for the next packet, its payload ends up in stub->packet
+ * @return false if the connection was closed
+ */
+static bool receive_packet(GdbStub* const stub)
+{
+  while (true)
+  {
+    int c;
+    uint32_t length = 0;
+    uint8_t checksum = 0;
+
+    while ((c = read_byte(stub)) != '$')
+    {
+      if (c < 0)
+        return false;
+    }
+
+    while ((c = read_byte(stub)) != '#')
+    {
+      if (c < 0)
+        return false;
+      if (length < sizeof stub->packet - 1)
+        stub->packet[length++] = (char)c;
+      checksum += (uint8_t)c;
+    }
+    stub->packet[length] = '\0';
+    stub->packetLength = length;
+
+    const int high = read_byte(stub);
+    const int low = read_byte(stub);
+    if (high < 0 || low < 0)
+      return false;
+    if (stub->noAck)
+      return true;
+
+    if (hex_value((char)high) * 16 + hex_value((char)low) == checksum)
+    {
+      write_all(stub->fd, "+", 1);
+      return true;
+    }
+    write_all(stub->fd, "-", 1);
+  }
+}
+
+static void send_stop_reply(Emulator* const emu, const bool interrupted)
+{
+  const Debugger* const deb = emu->debugger;
+  char reply[64];
+
+  if (deb->memory_bp_hit >= 0)
+  {
+    const uint8_t flags = deb->memory_bp_flags[deb->memory_bp_hit];
+    const char* kind = flags == MemoryCell_Flag_Written ? "watch" :
+      (flags == MemoryCell_Flag_Read ? "rwatch" : "awatch");
+    sprintf(reply, "T%02x%s:%x;", Gdb_SignalTrap, kind,
+            deb->memory_bp_addresses[deb->memory_bp_hit]);
+  }
+  else if (deb->error == ERROR_ILLEGAL_INSTRUCTION)
+    sprintf(reply, "S%02x", Gdb_SignalIll);
+  else if (interrupted)
+    sprintf(reply, "S%02x", Gdb_SignalInt);
+  else
+  {
+    bool atBreakpoint = false;
+    for (uint32_t i = 0; i < deb->num_bps; i++)
+      atBreakpoint |= deb->bp_addresses[i] == emu->cpu->pc;
+    sprintf(reply, "T%02x%s", Gdb_SignalTrap, atBreakpoint ? "swbreak:;" : "");
+  }
+  send_packet(emu->gdb, reply);
+}
+
+static void read_registers(Emulator* const emu, char* reply)
+{
+  for (uint8_t reg = 0; reg < Gdb_RegisterCount; reg++)
+  {
+    const uint16_t value = (uint16_t)*get_reg_ptr(emu, reg);
+    reply += sprintf(reply, "%02x%02x0000", value & 0xFF, value >> 8);
+  }
+}
+
+static uint16_t parse_register(const char* text, const uint32_t bytes)
+{
+  uint16_t value = 0;
+
+  for (uint32_t i = 0; i < bytes && i < 2; i++)
+  {
+    value |= (uint16_t)((hex_value(text[2 * i]) << 4 | hex_value(text[2 * i + 1]))
+                        << (8 * i));
+  }
+  return value;
+}
+
+static bool write_registers(Emulator* const emu, const char* data)
+{
+  const size_t length = strlen(data);
+  const uint32_t bytes = (uint32_t)(length / (2 * Gdb_RegisterCount));
+
+  if (bytes != 2 && bytes != Gdb_RegisterBytes)
+    return false;
+  for (uint8_t reg = 0; reg < Gdb_RegisterCount; reg++)
+    *get_reg_ptr(emu, reg) = (int16_t)parse_register(data + 2 * bytes * reg, bytes);
+  return true;
+}
+
+/**
+ * @brief Parse "ADDR,LENGTH", clamped to the address space
+ */
+static const char* parse_range(const char* text, uint32_t* const address,
+                               uint32_t* const length)
+{
+  *address = parse_hex(&text);
+  if (*text == ',')
+    text++;
+  *length = parse_hex(&text);
+  if (*address >= ADDRESS_SPACE_SIZE)
+    *length = 0;
+  else if (*address + *length > ADDRESS_SPACE_SIZE)
+    *length = ADDRESS_SPACE_SIZE - *address;
+  return text;
+}
+
+static void read_memory(const char* args, char* reply)
+{
+  uint32_t address, length;
+
+  parse_range(args, &address, &length);
+  if (length > Gdb_PacketSize)
+    length = Gdb_PacketSize;
+  for (uint32_t i = 0; i < length; i++)
+  {
+    *reply++ = HexDigits[MEMSPACE[address + i] >> 4];
+    *reply++ = HexDigits[MEMSPACE[address + i] & 0xF];
+  }
+  *reply = '\0';
+}
+
+/**
+ * @brief Handle M (hex data) and X (binary data) packets
+ * @param end The end of the packet, binary data may hold zero bytes
+ * @return false unless all LENGTH bytes were written
+ */
+static bool write_memory(const char* args, const char* end, const bool binary)
+{
+  uint32_t address, length, i = 0;
+  const char* data = parse_range(args, &address, &length);
+
+  if (data >= end || *data++ != ':')
+    return false;
+
+  memory_hook_range((uint16_t)address, length);
+  while (i < length && data < end)
+  {
+    if (binary)
+    {
+      uint8_t byte = (uint8_t)*data++;
+      if (byte == '}')
+      {
+        if (data == end)
+          break;
+        byte = (uint8_t)*data++ ^ 0x20;
+      }
+      MEMSPACE[address + i++] = byte;
+    }
+    else
+    {
+      const int high = data + 1 < end ? hex_value(data[0]) : -1;
+      const int low = high >= 0 ? hex_value(data[1]) : -1;
+      if (low < 0)
+        break;
+      MEMSPACE[address + i++] = (uint8_t)(high << 4 | low);
+      data += 2;
+    }
+  }
+  memory_mark_dirty((uint16_t)address, i);
+  return i == length;
+}
+
+/**
+ * @brief Handle Z (insert) and z (remove) packets
+ */
+static bool change_breakpoint(Emulator* const emu, const char* args,
+                              const bool insert)
+{
+  const uint32_t type = parse_hex(&args);
+  uint32_t address, length;
+  uint8_t flags;
+  bool ok = true;
+
+  if (*args++ != ',')
+    return false;
+  parse_range(args, &address, &length);
+
+  switch (type)
+  {
+    case 0:
+    case 1:
+      return insert ? add_breakpoint(emu, (uint16_t)address) :
+        remove_breakpoint(emu, (uint16_t)address);
+    case 2: flags = MemoryCell_Flag_Written; break;
+    case 3: flags = MemoryCell_Flag_Read; break;
+    case 4: flags = MemoryCell_Flag_Written | MemoryCell_Flag_Read; break;
+    default: return false;
+  }
+
+  // One memory breakpoint per watched byte
+  for (uint32_t i = 0; i < (length > 0 ? length : 1); i++)
+  {
+    ok &= insert ? add_memory_breakpoint(emu, (uint16_t)(address + i), flags) :
+      remove_memory_breakpoint(emu, (uint16_t)(address + i), flags);
+  }
+  return ok;
+}
+
+static void step_instruction(Emulator* const emu)
+{
+  emu->debugger->error = 0;
+  emu->debugger->memory_bp_hit = -1;
+  if (!service_interrupts(emu) && handle_low_power_mode(emu) == LowPower_Active)
+    decode(emu, fetch(emu, true), EXECUTE);
+  scheduler_run_due(emu);
+}
+
+/**
+ * @brief Run a monitor command with the console debugger
+ */
+static void run_monitor_command(Emulator* const emu, const char* hex)
+{
+  char line[256];
+  size_t length = 0;
+
+  while (hex[0] != '\0' && hex[1] != '\0' && length < sizeof line - 1)
+  {
+    line[length++] = (char)(hex_value(hex[0]) << 4 | hex_value(hex[1]));
+    hex += 2;
+  }
+  line[length] = '\0';
+  exec_cmd(emu, line, (int)length);
+}
+
+static void resume(Emulator* const emu, const char* args)
+{
+  Cpu* const cpu = emu->cpu;
+
+  if (*args != '\0')
+    cpu->pc = (uint16_t)parse_hex(&args);
+  emu->debugger->error = 0;
+  emu->debugger->debug_mode = false;
+  emu->debugger->stop_reason = StopReason_None;
+  rearm_memory_breakpoints(emu);
+  cpu->running = true;
+  emu->gdb->resumed = true;
+}
+
+static void detach(Emulator* const emu)
+{
+  disconnect(emu->gdb);
+  emu->gdb->resumed = false;
+  emu->debugger->debug_mode = false;
+  emu->cpu->running = true;
+}
+
+/**
+ * @brief Handle one packet
+ * @return false once the CPU was resumed or the session ended
+ */
+static bool handle_packet(Emulator* const emu)
+{
+  GdbStub* const stub = emu->gdb;
+  const char* const packet = stub->packet;
+  const char* args = packet + 1;
+  static char reply[2 * Gdb_PacketSize + 16];
+
+  reply[0] = '\0';
+  switch (packet[0])
+  {
+    case '?':
+      send_stop_reply(emu, false);
+      return true;
+    case 'g':
+      read_registers(emu, reply);
+      break;
+    case 'G':
+      strcpy(reply, write_registers(emu, args) ? "OK" : "E01");
+      break;
+    case 'p':
+    {
+      const uint32_t reg = parse_hex(&args);
+      if (reg < Gdb_RegisterCount)
+      {
+        const uint16_t value = (uint16_t)*get_reg_ptr(emu, (uint8_t)reg);
+        sprintf(reply, "%02x%02x0000", value & 0xFF, value >> 8);
+      }
+      else
+        strcpy(reply, "E01");
+      break;
+    }
+    case 'P':
+    {
+      const uint32_t reg = parse_hex(&args);
+      if (reg < Gdb_RegisterCount && *args++ == '=')
+      {
+        *get_reg_ptr(emu, (uint8_t)reg) =
+          (int16_t)parse_register(args, (uint32_t)strlen(args) / 2);
+        strcpy(reply, "OK");
+      }
+      else
+        strcpy(reply, "E01");
+      break;
+    }
+    case 'm':
+      read_memory(args, reply);
+      break;
+    case 'M':
+    case 'X':
+      strcpy(reply, write_memory(args, packet + stub->packetLength,
+                                 packet[0] == 'X') ? "OK" : "E01");
+      break;
+    case 'Z':
+    case 'z':
+      strcpy(reply, change_breakpoint(emu, args, packet[0] == 'Z') ? "OK" : "E01");
+      break;
+    case 'c':
+      resume(emu, args);
+      return false;
+    case 's':
+      if (*args != '\0')
+        emu->cpu->pc = (uint16_t)parse_hex(&args);
+      step_instruction(emu);
+      if (emu->debugger->quit)
+      {
+        stub->resumed = true;
+        return false;
+      }
+      send_stop_reply(emu, false);
+      return true;
+    case 'b':
+      // Reverse execution with the undo journal
+      if (emu->journal == NULL || (args[0] != 's' && args[0] != 'c'))
+      {
+        strcpy(reply, "E01");
+        break;
+      }
+      if (args[0] == 's')
+        journal_reverse_step(emu, 1);
+      else
+        journal_reverse_continue(emu);
+      emu->debugger->error = 0;
+      send_stop_reply(emu, false);
+      return true;
+    case 'k':
+      emu->debugger->quit = true;
+      disconnect(stub);
+      return false;
+    case 'D':
+      send_packet(stub, "OK");
+      detach(emu);
+      return false;
+    case 'H':
+    case 'T':
+      strcpy(reply, "OK");
+      break;
+    case 'q':
+      if (!strncmp(packet, "qSupported", strlen("qSupported")))
+        sprintf(reply, "PacketSize=%x;QStartNoAckMode+;swbreak+;hwbreak+;"
+                "ReverseStep+;ReverseContinue+", Gdb_PacketSize);
+      else if (!strcmp(packet, "qAttached"))
+        strcpy(reply, "1");
+      else if (!strcmp(packet, "qC"))
+        strcpy(reply, "QC1");
+      else if (!strcmp(packet, "qfThreadInfo"))
+        strcpy(reply, "m1");
+      else if (!strcmp(packet, "qsThreadInfo"))
+        strcpy(reply, "l");
+      else if (!strcmp(packet, "qOffsets"))
+        strcpy(reply, "Text=0;Data=0;Bss=0");
+      else if (!strncmp(packet, "qSymbol", strlen("qSymbol")))
+        strcpy(reply, "OK");
+      else if (!strncmp(packet, "qRcmd,", strlen("qRcmd,")))
+      {
+        run_monitor_command(emu, packet + strlen("qRcmd,"));
+        strcpy(reply, "OK");
+      }
+      break;
+    case 'Q':
+      if (!strcmp(packet, "QStartNoAckMode"))
+      {
+        send_packet(stub, "OK");
+        stub->noAck = true;
+        return true;
+      }
+      break;
+    default:
+      break;
+  }
+
+  send_packet(stub, reply);
+  return stub->fd >= 0;
+}
+
+static int listen_tcp(const int port)
+{
+  struct sockaddr_in address;
+  const int one = 1;
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+  memset(&address, 0, sizeof address);
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr*)&address, sizeof address) != 0 ||
+      listen(fd, 1) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int listen_unix(const char* path)
+{
+  struct sockaddr_un address;
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return -1;
+
+  memset(&address, 0, sizeof address);
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof address.sun_path - 1);
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof address) != 0 ||
+      listen(fd, 1) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Wait for GDB to connect on emu->gdb_socket, or on emu->port of
+ * the loopback interface
+ * @return false if the socket could not be opened
+ */
+bool gdb_listen(Emulator* const emu)
+{
+  GdbStub* const stub = (GdbStub*) calloc(1, sizeof(GdbStub));
+  const bool unixSocket = emu->gdb_socket != NULL;
+  char buffer[256];
+  const int one = 1;
+
+  stub->fd = -1;
+  stub->listenFd = unixSocket ?
+    listen_unix(emu->gdb_socket) : listen_tcp(emu->port);
+  emu->gdb = stub;
+  if (stub->listenFd < 0)
+    return false;
+
+  if (unixSocket)
+    snprintf(buffer, sizeof buffer, "Waiting for GDB on %s\n", emu->gdb_socket);
+  else
+    snprintf(buffer, sizeof buffer, "Waiting for GDB on port %d\n", emu->port);
+  print_console(emu, buffer);
+  do {
+    stub->fd = accept(stub->listenFd, NULL, NULL);
+  } while (stub->fd < 0 && errno == EINTR);
+  if (stub->fd < 0)
+    return false;
+
+  if (!unixSocket)
+    setsockopt(stub->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  // The interrupt byte raises SIGIO, which stops the CPU
+  fcntl(stub->fd, F_SETOWN, getpid());
+  fcntl(stub->fd, F_SETFL, fcntl(stub->fd, F_GETFL) | O_ASYNC);
+  register_signal(SIGIO);
+  return true;
+}
+
+bool gdb_is_attached(const Emulator* const emu)
+{
+  return emu->gdb != NULL && emu->gdb->fd >= 0;
+}
+
+/**
+ * @brief Report why the CPU stopped and serve GDB until it resumes the CPU
+ */
+void gdb_serve(Emulator* const emu)
+{
+  GdbStub* const stub = emu->gdb;
+
+  if (stub->resumed)
+  {
+    stub->resumed = false;
+    send_stop_reply(emu, take_interrupt(stub));
+  }
+
+  while (stub->fd >= 0 && receive_packet(stub))
+  {
+    if (!handle_packet(emu))
+      return;
+  }
+
+  // GDB went away, leave the CPU to the console debugger
+  emu->debugger->debug_mode = true;
+}
+
+/**
+ * @brief Tell GDB that the program ended and close the sockets
+ */
+void gdb_close(Emulator* const emu)
+{
+  GdbStub* const stub = emu->gdb;
+  char reply[8];
+
+  if (stub == NULL)
+    return;
+  if (stub->fd >= 0 && stub->resumed)
+  {
+    sprintf(reply, "W%02x", (uint8_t)emu->exit_code);
+    send_packet(stub, reply);
+  }
+  disconnect(stub);
+  if (stub->listenFd >= 0)
+    close(stub->listenFd);
+  free(stub);
+  emu->gdb = NULL;
+}
@@ -0,0 +1,47 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GDB_STUB_H_
+#define _GDB_STUB_H_
+
+#include "../main.h"
+#include "debugger.h"
+
+enum { Gdb_PacketSize = 0x1000 };   // Advertised to GDB, payload bytes
+enum { Gdb_RegisterCount = 16 };
+enum { Gdb_RegisterBytes = 4 };     // msp430-elf-gdb transfers 32 bit registers
+
+// Connection to a GDB client //
+typedef struct GdbStub {
+  int listenFd;
+  int fd;            // Client connection, -1 once detached
+  bool noAck;        // QStartNoAckMode was accepted
+  bool resumed;      // A continue is running, a stop reply is owed
+  uint8_t input[Gdb_PacketSize];
+  uint32_t inputHead;
+  uint32_t inputLength;
+  char packet[2 * Gdb_PacketSize + 16];
+  uint32_t packetLength; // Payload bytes, X packets carry raw zeros
+} GdbStub;
+
+bool gdb_listen(Emulator* const emu);
+bool gdb_is_attached(const Emulator* const emu);
+void gdb_serve(Emulator* const emu);
+void gdb_close(Emulator* const emu);
+
+#endif
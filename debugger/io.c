@@ -20,5 +20,36 @@
 
 void print_console (Emulator *emu, const char *buf)
 {
-    printf("%s", buf);
+    if (emu->quiet)
+        return;
+    if (emu->host_io.console != NULL)
+        emu->host_io.console(emu->host_io.context, buf);
+    else
+        printf("%s", buf);
+}
+
+/**
+ * @brief Emulator call 0x0001, output a byte on the host console
+ */
+void write_console_char(Emulator* const emu, const uint8_t c)
+{
+    if (emu->host_io.put_char != NULL)
+        emu->host_io.put_char(emu->host_io.context, c);
+    else
+        write(STDOUT_FILENO, &c, 1);
+}
+
+/**
+ * @brief Emulator call 0x0002, input a byte from the host console
+ * @return false at the end of the input
+ */
+bool read_console_char(Emulator* const emu, char* const c)
+{
+    if (emu->host_io.get_char != NULL)
+    {
+        const int value = emu->host_io.get_char(emu->host_io.context);
+        *c = (char)(value < 0 ? 0 : value);
+        return value >= 0;
+    }
+    return read(STDIN_FILENO, c, 1) > 0;
 }
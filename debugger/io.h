@@ -23,5 +23,7 @@
 
 void print_console (Emulator *emu, const char *buf);
 void print_serial (Emulator *emu, char *buf);
+void write_console_char(Emulator* const emu, const uint8_t c);
+bool read_console_char(Emulator* const emu, char* const c);
 
 #endif
@@ -0,0 +1,259 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Undo journal for reverse execution +++##########
+//# Every executed instruction records the register file it started
+//# with, every memory write records the bytes it overwrites. Going
+//# back one step undoes the writes of the newest step in reverse
+//# order and restores its registers, so N steps back cost O(N).
+//#
+//# Both records live in ring buffers sized by the step window. A
+//# step whose writes were overwritten in the write ring can no
+//# longer be undone and drops out of the window.
+//#
+//# Bulk writes, a flash erase or a GDB memory write, are recorded
+//# word by word through memory_hook_range(). Peripheral models keep
+//# no history: once the steps are undone, the cycle counter goes
+//# back and the models restart from the restored registers, as
+//# after a snapshot restore. Events scheduled by the models follow,
+//# other pending events keep their cycle.
+//##############################################################
+
+#include "journal.h"
+#include "io.h"
+#include "../devices/machine.h"
+#include "../devices/peripherals/timerA.h"
+
+extern uint8_t* MEMSPACE;
+
+Journal* journal_create(const uint32_t steps)
+{
+  Journal* const journal = (Journal*) calloc(1, sizeof(Journal));
+  journal->stepCapacity = steps > 0 ? steps : 1;
+  journal->writeCapacity = journal->stepCapacity * Journal_WritesPerStep;
+  journal->steps = (JournalStep*) calloc(journal->stepCapacity,
+                                         sizeof(JournalStep));
+  journal->writes = (JournalWrite*) calloc(journal->writeCapacity,
+                                           sizeof(JournalWrite));
+  return journal;
+}
+
+void journal_destroy(Journal* const journal)
+{
+  if (journal == NULL)
+    return;
+  free(journal->steps);
+  free(journal->writes);
+  free(journal);
+}
+
+void journal_enable(Emulator* const emu, const uint32_t steps)
+{
+  journal_disable(emu);
+  emu->journal = journal_create(steps);
+  memory_set_write_hook(journal_record_write, emu->journal);
+}
+
+void journal_disable(Emulator* const emu)
+{
+  if (emu->journal == NULL)
+    return;
+  memory_set_write_hook(NULL, NULL);
+  journal_destroy(emu->journal);
+  emu->journal = NULL;
+}
+
+/**
+ * @brief Forget the recorded history, e.g. after the machine state was replaced
+ */
+void journal_clear(Journal* const journal)
+{
+  if (journal == NULL)
+    return;
+  journal->stepCount = 0;
+  journal->firstStep = 0;
+  journal->writeCount = 0;
+}
+
+static void save_registers(const Cpu* const cpu, uint16_t* const registers)
+{
+  registers[0] = cpu->pc;
+  registers[1] = cpu->sp;
+  registers[2] = cpu->sr;
+  registers[3] = (uint16_t)cpu->cg2;
+  registers[4] = (uint16_t)cpu->r4;
+  registers[5] = (uint16_t)cpu->r5;
+  registers[6] = (uint16_t)cpu->r6;
+  registers[7] = (uint16_t)cpu->r7;
+  registers[8] = (uint16_t)cpu->r8;
+  registers[9] = (uint16_t)cpu->r9;
+  registers[10] = (uint16_t)cpu->r10;
+  registers[11] = (uint16_t)cpu->r11;
+  registers[12] = (uint16_t)cpu->r12;
+  registers[13] = (uint16_t)cpu->r13;
+  registers[14] = (uint16_t)cpu->r14;
+  registers[15] = (uint16_t)cpu->r15;
+}
+
+static void restore_registers(Cpu* const cpu, const uint16_t* const registers)
+{
+  cpu->pc = registers[0];
+  cpu->sp = registers[1];
+  cpu->sr = registers[2];
+  cpu->cg2 = (int16_t)registers[3];
+  cpu->r4 = (int16_t)registers[4];
+  cpu->r5 = (int16_t)registers[5];
+  cpu->r6 = (int16_t)registers[6];
+  cpu->r7 = (int16_t)registers[7];
+  cpu->r8 = (int16_t)registers[8];
+  cpu->r9 = (int16_t)registers[9];
+  cpu->r10 = (int16_t)registers[10];
+  cpu->r11 = (int16_t)registers[11];
+  cpu->r12 = (int16_t)registers[12];
+  cpu->r13 = (int16_t)registers[13];
+  cpu->r14 = (int16_t)registers[14];
+  cpu->r15 = (int16_t)registers[15];
+}
+
+/**
+ * @brief Record the register file before the instruction at PC executes
+ */
+void journal_record_step(Emulator* const emu)
+{
+  Journal* const journal = emu->journal;
+  JournalStep* const step =
+    &journal->steps[journal->stepCount % journal->stepCapacity];
+
+  timer_a_sync(emu);
+  save_registers(emu->cpu, step->registers);
+  step->cycle = emu->cpu->cycles;
+  step->timerCountingDown = timer_a_counting_down(emu);
+  step->firstWrite = journal->writeCount;
+  journal->stepCount++;
+
+  if (journal->stepCount - journal->firstStep > journal->stepCapacity)
+    journal->firstStep = journal->stepCount - journal->stepCapacity;
+}
+
+/**
+ * @brief Memory write hook, records the bytes about to be overwritten
+ */
+void journal_record_write(void* context, const uint16_t virt_addr,
+                          const uint8_t size)
+{
+  Journal* const journal = (Journal*)context;
+  JournalWrite* const write =
+    &journal->writes[journal->writeCount % journal->writeCapacity];
+
+  write->address = virt_addr;
+  write->size = size;
+  write->value = size == 1 ? MEMSPACE[virt_addr] :
+    (uint16_t)(MEMSPACE[virt_addr] | (MEMSPACE[virt_addr + 1] << 8));
+  journal->writeCount++;
+
+  // Steps whose writes were overwritten can not be undone anymore
+  if (journal->writeCount > journal->writeCapacity)
+  {
+    const uint64_t oldestWrite = journal->writeCount - journal->writeCapacity;
+    while (journal->firstStep < journal->stepCount &&
+           journal->steps[journal->firstStep % journal->stepCapacity]
+             .firstWrite < oldestWrite)
+      journal->firstStep++;
+  }
+}
+
+uint64_t journal_available_steps(const Journal* const journal)
+{
+  return journal->stepCount - journal->firstStep;
+}
+
+/**
+ * @brief Undo the newest recorded step
+ * @return false if the journal holds no step
+ */
+bool journal_undo_step(Emulator* const emu)
+{
+  Journal* const journal = emu->journal;
+
+  if (journal == NULL || journal->stepCount == journal->firstStep)
+    return false;
+
+  journal->stepCount--;
+  const JournalStep* const step =
+    &journal->steps[journal->stepCount % journal->stepCapacity];
+
+  while (journal->writeCount > step->firstWrite)
+  {
+    journal->writeCount--;
+    const JournalWrite* const write =
+      &journal->writes[journal->writeCount % journal->writeCapacity];
+
+    MEMSPACE[write->address] = (uint8_t)write->value;
+    if (write->size == 2)
+      MEMSPACE[write->address + 1] = (uint8_t)(write->value >> 8);
+    memory_mark_dirty(write->address, write->size);
+  }
+
+  restore_registers(emu->cpu, step->registers);
+  emu->cpu->cycles = step->cycle;
+  timer_a_set_counting_down(emu, step->timerCountingDown);
+  return true;
+}
+
+/**
+ * @brief Go back the given number of steps, or as far as the journal reaches
+ * @return The number of steps undone
+ */
+uint64_t journal_reverse_step(Emulator* const emu, const uint64_t steps)
+{
+  uint64_t undone = 0;
+  while (undone < steps && journal_undo_step(emu))
+    undone++;
+  if (undone > 0)
+    machine_resync(emu);
+  return undone;
+}
+
+static bool is_pc_breakpoint(const Debugger* const deb, const uint16_t pc)
+{
+  for (uint32_t i = 0; i < deb->num_bps; i++)
+  {
+    if (deb->bp_addresses[i] == pc)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Go back until PC reaches a breakpoint, or as far as the journal
+ * reaches. The instruction at the current PC is not considered.
+ * @return The number of steps undone
+ */
+uint64_t journal_reverse_continue(Emulator* const emu)
+{
+  uint64_t undone = 0;
+  while (journal_undo_step(emu))
+  {
+    undone++;
+    if (is_pc_breakpoint(emu->debugger, emu->cpu->pc))
+      break;
+  }
+  if (undone > 0)
+    machine_resync(emu);
+  return undone;
+}
@@ -0,0 +1,70 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include "../main.h"
+
+enum { Journal_DefaultSteps = 100000 };
+enum { Journal_WritesPerStep = 4 };
+enum { Journal_RegisterCount = 16 };
+
+// Register file before an executed instruction //
+typedef struct JournalStep {
+  uint16_t registers[Journal_RegisterCount];
+  uint64_t cycle;       // CPU cycle before the instruction
+  bool timerCountingDown; // Timer_A up/down direction, not in a register
+  uint64_t firstWrite;  // Index of the first memory write of this step
+} JournalStep;
+
+// Memory contents before a write //
+typedef struct JournalWrite {
+  uint16_t address;
+  uint16_t value;
+  uint8_t size;
+} JournalWrite;
+
+// Undo journal, two ring buffers bounded by the configured step window //
+typedef struct Journal {
+  JournalStep* steps;
+  JournalWrite* writes;
+  uint32_t stepCapacity;
+  uint32_t writeCapacity;
+  uint64_t stepCount;   // Steps recorded, the newest one is stepCount - 1
+  uint64_t firstStep;   // Oldest step which can still be undone
+  uint64_t writeCount;  // Writes recorded
+} Journal;
+
+Journal* journal_create(const uint32_t steps);
+void journal_destroy(Journal* const journal);
+
+void journal_enable(Emulator* const emu, const uint32_t steps);
+void journal_disable(Emulator* const emu);
+void journal_clear(Journal* const journal);
+
+void journal_record_step(Emulator* const emu);
+void journal_record_write(void* context, const uint16_t virt_addr,
+                          const uint8_t size);
+
+uint64_t journal_available_steps(const Journal* const journal);
+bool journal_undo_step(Emulator* const emu);
+uint64_t journal_reverse_step(Emulator* const emu, const uint64_t steps);
+uint64_t journal_reverse_continue(Emulator* const emu);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Run limits +++##########
+//# Budgets on executed instructions, CPU cycles and host wall-clock
+//# time keep runaway firmware from spinning until a CI job timeout.
+//# The cycle limit is a single observer event of the scheduler at
+//# the limit, so low power modes and idle loops are still skipped
+//# in one go. The run loop compares the executed instruction count
+//# with the next check, every Limits_CheckInstructions instructions
+//# or at the instruction limit, which then looks at the instruction
+//# and time limits.
+//#
+//# Each check also samples the PC. When a limit is hit, the report
+//# shows the registers, the call stack and the most sampled PCs,
+//# which point at the loop the firmware was stuck in.
+//######################################
+
+#include <time.h>
+
+#include "limits.h"
+#include "io.h"
+
+RunLimits* limits_get(Emulator* const emu)
+{
+  if (emu->limits == NULL)
+    emu->limits = (RunLimits*) calloc(1, sizeof(RunLimits));
+  return emu->limits;
+}
+
+static double seconds_since(const struct timespec* const start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+    (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void display_call_stack(Emulator* const emu)
+{
+  const CallTracer* const tracer = &emu->cpu->callTracer;
+  char line[STRING_BUFFER_SIZE];
+
+  print_console(emu, "Call stack:\n");
+  for (uint32_t depth = tracer->callDepth; depth > 0; depth--)
+  {
+    if (depth > CallTracer_MaxCallDepth)
+      continue;
+    const CallTraceEntry* const entry = &tracer->calls[depth - 1];
+    sprintf(line, " \t#%-3u %04X, returns to %04X, SP %04X\n",
+            tracer->callDepth - depth, entry->targetPc, entry->returnPc,
+            entry->sp);
+    print_console(emu, line);
+  }
+  print_console(emu, " \treset\n");
+}
+
+static void display_pc_histogram(Emulator* const emu)
+{
+  const RunLimits* const limits = emu->limits;
+  uint32_t hottest[Limits_HistogramEntries] = {0};
+  uint32_t count = 0;
+  char line[STRING_BUFFER_SIZE];
+
+  // Keep the most sampled PCs in descending order
+  for (uint32_t i = 0; i < ADDRESS_SPACE_SIZE / 2; i++)
+  {
+    const uint32_t samples = limits->pcSamples[i];
+    if (samples == 0)
+      continue;
+    if (count < Limits_HistogramEntries)
+      hottest[count++] = i;
+    else if (samples > limits->pcSamples[hottest[count - 1]])
+      hottest[count - 1] = i;
+    else
+      continue;
+
+    for (uint32_t j = count - 1;
+         j > 0 && limits->pcSamples[hottest[j - 1]] < samples; j--)
+    {
+      hottest[j] = hottest[j - 1];
+      hottest[j - 1] = i;
+    }
+  }
+
+  sprintf(line, "PC histogram (%llu samples):\n",
+          (unsigned long long)limits->numSamples);
+  print_console(emu, line);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const uint32_t samples = limits->pcSamples[hottest[i]];
+    sprintf(line, " \t%04X %10u %6.2f%%\n", hottest[i] * 2, samples,
+            100.0 * samples / limits->numSamples);
+    print_console(emu, line);
+  }
+}
+
+static void stop_run(Emulator* const emu, const StopReason reason,
+                     const char* message)
+{
+  Debugger* const deb = emu->debugger;
+
+  print_console(emu, message);
+  display_registers(emu);
+  display_call_stack(emu);
+  display_pc_histogram(emu);
+
+  emu->cpu->running = false;
+  emu->exit_code = Limits_ExitCode;
+  deb->stop_reason = reason;
+  deb->quit = true;
+}
+
+static void sample_pc(RunLimits* const limits, const uint16_t pc)
+{
+  limits->pcSamples[pc / 2]++;
+  limits->numSamples++;
+}
+
+static void check_cycle_limit(Emulator* const emu, void* context)
+{
+  RunLimits* const limits = (RunLimits*) context;
+  char message[STRING_BUFFER_SIZE];
+
+  sample_pc(limits, emu->cpu->pc);
+  sprintf(message, "\n\t[Cycle limit of %llu reached]\n\n",
+          (unsigned long long)limits->maxCycles);
+  stop_run(emu, StopReason_CycleLimit, message);
+}
+
+/**
+ * @brief Check the instruction and time limits, see limits_poll()
+ */
+void limits_check(Emulator* const emu)
+{
+  RunLimits* const limits = emu->limits;
+  const uint64_t executed = emu->cpu->stats.instructions.executed;
+  char message[STRING_BUFFER_SIZE];
+
+  sample_pc(limits, emu->cpu->pc);
+
+  if (limits->maxInstructions != 0 && executed >= limits->maxInstructions)
+  {
+    sprintf(message, "\n\t[Instruction limit of %llu reached]\n\n",
+            (unsigned long long)limits->maxInstructions);
+    stop_run(emu, StopReason_InstructionLimit, message);
+    limits->nextCheck = UINT64_MAX;
+    return;
+  }
+  if (limits->maxSeconds != 0 && seconds_since(&limits->start) >= limits->maxSeconds)
+  {
+    sprintf(message, "\n\t[Time limit of %u seconds reached]\n\n",
+            limits->maxSeconds);
+    stop_run(emu, StopReason_Timeout, message);
+    limits->nextCheck = UINT64_MAX;
+    return;
+  }
+
+  limits->nextCheck = executed + Limits_CheckInstructions;
+  if (limits->maxInstructions != 0 && limits->nextCheck > limits->maxInstructions)
+    limits->nextCheck = limits->maxInstructions;
+}
+
+/**
+ * @brief Start the clock, schedule the cycle limit and check the other
+ * limits before the first instruction, if any limit is set
+ */
+void limits_start(Emulator* const emu)
+{
+  RunLimits* const limits = emu->limits;
+
+  if (limits == NULL)
+    return;
+
+  if (limits->pcSamples == NULL)
+    limits->pcSamples = (uint32_t*) calloc(ADDRESS_SPACE_SIZE / 2, sizeof(uint32_t));
+  clock_gettime(CLOCK_MONOTONIC, &limits->start);
+  scheduler_cancel(emu->scheduler, check_cycle_limit, limits);
+  if (limits->maxCycles != 0)
+    scheduler_add_observer(emu->scheduler, limits->maxCycles,
+                           check_cycle_limit, limits);
+  limits->nextCheck = emu->cpu->stats.instructions.executed;
+}
+
+void limits_destroy(Emulator* const emu)
+{
+  if (emu->limits == NULL)
+    return;
+  free(emu->limits->pcSamples);
+  free(emu->limits);
+  emu->limits = NULL;
+}
@@ -0,0 +1,56 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LIMITS_H_
+#define _LIMITS_H_
+
+#include "../main.h"
+#include "../devices/cpu/registers.h"
+
+enum { Limits_ExitCode = 3 };          // Exit status once a limit was hit
+enum { Limits_CheckInstructions = 4096 }; // Between two checks of the run loop
+enum { Limits_HistogramEntries = 16 }; // Hottest PCs in the report
+
+// Budgets of a run, 0 for no limit //
+typedef struct RunLimits {
+  uint64_t maxInstructions;
+  uint64_t maxCycles;
+  uint32_t maxSeconds;      // Host wall-clock time
+  struct timespec start;
+  uint64_t nextCheck;       // Executed instruction count of the next check
+  uint32_t* pcSamples;      // PC sampled at every check, indexed by PC / 2
+  uint64_t numSamples;
+} RunLimits;
+
+RunLimits* limits_get(Emulator* const emu);
+void limits_start(Emulator* const emu);
+void limits_check(Emulator* const emu);
+void limits_destroy(Emulator* const emu);
+
+/**
+ * @brief Called by the run loop after each instruction, checks the
+ * instruction and time limits every Limits_CheckInstructions instructions
+ */
+static inline void limits_poll(Emulator* const emu)
+{
+  if (emu->limits != NULL &&
+      emu->cpu->stats.instructions.executed >= emu->limits->nextCheck)
+    limits_check(emu);
+}
+
+#endif
@@ -0,0 +1,484 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Network simulation +++##########
+//# Simulates a mesh of MSP430 nodes, each one an emulator process
+//# run through the co-simulation bridge (cosim.c) with its UART
+//# linked. The machine state of an emulator is global to its
+//# process, so nodes are processes, and the host spreads them over
+//# its cores. The topology file has one entry per line, # starts
+//# a comment:
+//#
+//#   node NAME FIRMWARE [device=PART]
+//#   link NAME NAME
+//#
+//# A linked node hears every byte its neighbor transmits, like a
+//# radio in range. Time advances in windows of --lookahead cycles,
+//# the link latency: bytes sent in a window are delivered when the
+//# next one starts, so within a window the nodes are independent.
+//# All nodes due in a window get their quantum before the first
+//# answer is awaited and run in parallel.
+//#
+//# A node asleep until after the window is parked: it gets no
+//# quantum and its process blocks on its socket. Asleep means in
+//# a low power mode, or in an idle loop such as one polling a
+//# flag set by the UART interrupt. Once it has to run, a single
+//# quantum takes it to the window start, skipped at no cost,
+//# before bytes are delivered to it. When no bytes are in
+//# flight, windows in which every node sleeps are skipped
+//# altogether.
+//##############################################
+
+#include <sys/socket.h>
+
+#include "network.h"
+#include "../devices/peripherals/usci.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_interrupt(int sig)
+{
+  (void)sig;
+  interrupted = 1;
+}
+
+Network* network_get(Emulator* const emu)
+{
+  if (emu->network == NULL)
+  {
+    emu->network = (Network*) calloc(1, sizeof(Network));
+    emu->network->lookahead = Network_DefaultLookahead;
+  }
+  return emu->network;
+}
+
+static NetworkNode* find_node(Network* const network, const char* name)
+{
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    if (!strcmp(network->nodes[i].name, name))
+      return &network->nodes[i];
+  }
+  return NULL;
+}
+
+static bool add_neighbor(NetworkNode* const node, const uint32_t neighbor)
+{
+  if (node->numNeighbors == Network_MaxNeighbors)
+    return false;
+  node->neighbors[node->numNeighbors++] = (uint16_t)neighbor;
+  return true;
+}
+
+/**
+ * @return NULL if the line is fine, else what is wrong with it
+ */
+static const char* parse_line(Network* const network, char* line)
+{
+  char* words[4] = {0};
+  uint32_t count = 0;
+
+  for (char* word = strtok(line, " \t\r\n"); word != NULL;
+       word = strtok(NULL, " \t\r\n"))
+  {
+    if (count == 4)
+      return "too many fields";
+    words[count++] = word;
+  }
+
+  if (!strcmp(words[0], "node"))
+  {
+    if (count < 3)
+      return "expected node NAME FIRMWARE [device=PART]";
+    if (count == 4 && strncmp(words[3], "device=", strlen("device=")))
+      return "expected device=PART";
+    if (find_node(network, words[1]) != NULL)
+      return "duplicate node";
+    if (network->numNodes == Network_MaxNodes)
+      return "too many nodes";
+
+    NetworkNode* const node = &network->nodes[network->numNodes++];
+    node->name = strdup(words[1]);
+    node->firmware = strdup(words[2]);
+    node->device = count == 4 ? strdup(words[3] + strlen("device=")) : NULL;
+    node->fd = -1;
+    return NULL;
+  }
+
+  if (!strcmp(words[0], "link"))
+  {
+    NetworkNode* const a = count == 3 ? find_node(network, words[1]) : NULL;
+    NetworkNode* const b = count == 3 ? find_node(network, words[2]) : NULL;
+    if (a == NULL || b == NULL || a == b)
+      return "expected link NAME NAME of two declared nodes";
+    if (!add_neighbor(a, (uint32_t)(b - network->nodes)) ||
+        !add_neighbor(b, (uint32_t)(a - network->nodes)))
+      return "too many neighbors";
+    return NULL;
+  }
+
+  return "expected node or link";
+}
+
+static bool load_topology(Network* const network)
+{
+  char line[Network_MaxLineLength];
+  uint32_t lineNumber = 0;
+  FILE* const file = fopen(network->path, "r");
+
+  if (file == NULL)
+  {
+    printf("Could not open network %s\n", network->path);
+    return false;
+  }
+
+  while (fgets(line, sizeof line, file) != NULL)
+  {
+    const char* text = line + strspn(line, " \t\r\n");
+    const char* error;
+
+    lineNumber++;
+    if (*text == '\0' || *text == '#')
+      continue;
+    if ((error = parse_line(network, line)) != NULL)
+    {
+      printf("%s:%u: %s\n", network->path, lineNumber, error);
+      fclose(file);
+      return false;
+    }
+  }
+
+  fclose(file);
+  if (network->numNodes == 0)
+  {
+    printf("%s: no nodes\n", network->path);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Start the emulator of a node on one end of a socket pair
+ */
+static bool spawn_node(NetworkNode* const node)
+{
+  int sockets[2];
+  char spec[32];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0)
+    return false;
+
+  node->pid = fork();
+  if (node->pid == 0)
+  {
+    // CONTROL-c stops the network at a window boundary, not the nodes
+    setpgid(0, 0);
+    // Only this end survives the exec
+    fcntl(sockets[1], F_SETFD, 0);
+    sprintf(spec, COSIM_FD_PREFIX "%d", sockets[1]);
+    char* argv[] = { "msp430-emu", "-b", node->firmware, "--cosim", spec,
+                     "--cosim-uart", "--device",
+                     node->device != NULL ? node->device : DEVICE_DEFAULT_NAME,
+                     NULL };
+    execv("/proc/self/exe", argv);
+    _exit(127);
+  }
+
+  close(sockets[1]);
+  if (node->pid < 0)
+  {
+    close(sockets[0]);
+    return false;
+  }
+  node->fd = sockets[0];
+  node->input = (uint8_t*) malloc(Usci_BufferSize);
+  return true;
+}
+
+static bool send_all(const int fd, const void* data, size_t length)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+
+  while (length > 0)
+  {
+    const ssize_t written = write(fd, bytes, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    bytes += written;
+    length -= (size_t)written;
+  }
+  return true;
+}
+
+static bool receive_all(const int fd, void* data, size_t length)
+{
+  uint8_t* bytes = (uint8_t*)data;
+
+  while (length > 0)
+  {
+    const ssize_t got = read(fd, bytes, length);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+    bytes += got;
+    length -= (size_t)got;
+  }
+  return true;
+}
+
+static void stop_node(NetworkNode* const node, const CosimStatus status)
+{
+  node->done = true;
+  node->last.status = status;
+}
+
+static void request_quantum(NetworkNode* const node, const uint64_t cycles)
+{
+  const CosimRequest request = {
+    .command = CosimCommand_Advance,
+    .cycles = cycles,
+  };
+
+  if (!send_all(node->fd, &request, sizeof request))
+    stop_node(node, CosimStatus_Halted);
+  node->quanta++;
+}
+
+static void deliver_input(NetworkNode* const node)
+{
+  const CosimRequest request = {
+    .command = CosimCommand_UartInput,
+    .argument = node->inputLength,
+  };
+
+  if (!send_all(node->fd, &request, sizeof request) ||
+      !send_all(node->fd, node->input, node->inputLength))
+    stop_node(node, CosimStatus_Halted);
+  node->inputLength = 0;
+}
+
+/**
+ * @brief Take the answer to a quantum, pass the transmitted bytes on
+ */
+static void collect_quantum(Network* const network, NetworkNode* const node)
+{
+  if (node->done)
+    return;
+  if (!receive_all(node->fd, &node->last, sizeof node->last) ||
+      node->last.uartLength > Usci_BufferSize ||
+      !receive_all(node->fd, network->transfer, node->last.uartLength))
+  {
+    stop_node(node, CosimStatus_Halted);
+    return;
+  }
+
+  for (uint8_t i = 0; i < node->numNeighbors; i++)
+  {
+    NetworkNode* const neighbor = &network->nodes[node->neighbors[i]];
+    const uint32_t space = Usci_BufferSize - neighbor->inputLength;
+    const uint32_t length = node->last.uartLength < space ?
+      node->last.uartLength : space;
+
+    memcpy(neighbor->input + neighbor->inputLength, network->transfer, length);
+    neighbor->inputLength += length;
+  }
+
+  if (node->last.status != CosimStatus_Completed)
+    node->done = true;
+}
+
+/**
+ * @brief Advance all nodes which have to run to the end of a window
+ */
+static void run_window(Network* const network, const uint64_t start,
+                       const uint64_t end)
+{
+  bool catchUp = false;
+
+  // Parked nodes receiving bytes first sleep until the window starts
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    NetworkNode* const node = &network->nodes[i];
+    if (!node->done && node->inputLength > 0 && node->last.cycle < start)
+    {
+      request_quantum(node, start - node->last.cycle);
+      catchUp = true;
+    }
+  }
+  for (uint32_t i = 0; catchUp && i < network->numNodes; i++)
+  {
+    NetworkNode* const node = &network->nodes[i];
+    if (!node->done && node->inputLength > 0 && node->last.cycle < start)
+      collect_quantum(network, node);
+  }
+
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    NetworkNode* const node = &network->nodes[i];
+    const bool input = node->inputLength > 0;
+
+    node->last.uartLength = 0;
+    if (node->done)
+      continue;
+    if (input)
+      deliver_input(node);
+    if (node->last.cycle >= end || (!input && node->last.wakeCycle >= end))
+    {
+      node->last.uartLength = UINT32_MAX; // Parked, nothing to collect
+      network->parked++;
+      continue;
+    }
+    request_quantum(node, end - node->last.cycle);
+  }
+
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    NetworkNode* const node = &network->nodes[i];
+    if (node->last.uartLength != UINT32_MAX)
+      collect_quantum(network, node);
+  }
+}
+
+/**
+ * @brief Find the start of the next window in which a node has to run
+ * @return SCHEDULER_NO_EVENT if all nodes are done or asleep for good
+ */
+static uint64_t next_window(const Network* const network, const uint64_t end)
+{
+  uint64_t wake = SCHEDULER_NO_EVENT;
+
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    const NetworkNode* const node = &network->nodes[i];
+    if (node->done)
+      continue;
+    if (node->inputLength > 0)
+      return end;
+    if (node->last.wakeCycle < wake)
+      wake = node->last.wakeCycle;
+  }
+
+  if (wake == SCHEDULER_NO_EVENT || wake < end)
+    return wake == SCHEDULER_NO_EVENT ? wake : end;
+  return wake - (wake - end) % network->lookahead;
+}
+
+static const char* node_state(const NetworkNode* const node)
+{
+  if (!node->done)
+    return "running";
+  return node->last.status == CosimStatus_Exited ? "exited" : "halted";
+}
+
+/**
+ * @brief Run the network until all nodes are done, the simulated time
+ * passed or CONTROL-c
+ * @return 0 if no node halted or exited with a nonzero code
+ */
+int network_main(Emulator* const emu)
+{
+  Network* const network = emu->network;
+  uint64_t start = 0;
+  uint64_t quanta = 0;
+  int result = 0;
+
+  if (network->lookahead == 0)
+  {
+    printf("The lookahead must be at least one cycle\n");
+    return 1;
+  }
+  if (!load_topology(network))
+    return 1;
+
+  network->transfer = (uint8_t*) malloc(Usci_BufferSize);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_interrupt);
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    if (!spawn_node(&network->nodes[i]))
+    {
+      printf("Could not start node %s\n", network->nodes[i].name);
+      stop_node(&network->nodes[i], CosimStatus_Halted);
+    }
+  }
+
+  const clock_t began = clock();
+  while (!interrupted && start != SCHEDULER_NO_EVENT &&
+         (network->maxCycles == 0 || start < network->maxCycles))
+  {
+    uint64_t end = start + network->lookahead;
+    if (network->maxCycles != 0 && end > network->maxCycles)
+      end = network->maxCycles;
+    run_window(network, start, end);
+    network->windows++;
+    start = next_window(network, end);
+  }
+  const double seconds = (double)(clock() - began) / CLOCKS_PER_SEC;
+
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    NetworkNode* const node = &network->nodes[i];
+    const CosimRequest quit = { .command = CosimCommand_Quit };
+
+    if (node->fd >= 0)
+    {
+      send_all(node->fd, &quit, sizeof quit);
+      close(node->fd);
+      node->fd = -1;
+    }
+    if (node->pid > 0)
+      waitpid(node->pid, NULL, 0);
+
+    if (node->done && (node->last.status != CosimStatus_Exited ||
+                       node->last.exitCode != 0))
+      result = 1;
+    quanta += node->quanta;
+    printf("%s: %s, exit code %u, %llu cycles, %llu instructions, "
+           "%llu quanta\n", node->name, node_state(node), node->last.exitCode,
+           (unsigned long long)node->last.cycle,
+           (unsigned long long)node->last.instructions,
+           (unsigned long long)node->quanta);
+  }
+  printf("%llu windows of %llu cycles, %llu quanta, %llu parked, "
+         "%.2f s coordinator CPU time\n",
+         (unsigned long long)network->windows,
+         (unsigned long long)network->lookahead, (unsigned long long)quanta,
+         (unsigned long long)network->parked, seconds);
+  return result;
+}
+
+void network_destroy(Emulator* const emu)
+{
+  Network* const network = emu->network;
+
+  if (network == NULL)
+    return;
+  for (uint32_t i = 0; i < network->numNodes; i++)
+  {
+    free(network->nodes[i].name);
+    free(network->nodes[i].firmware);
+    free(network->nodes[i].device);
+    free(network->nodes[i].input);
+  }
+  free(network->transfer);
+  free(network);
+  emu->network = NULL;
+}
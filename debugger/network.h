@@ -0,0 +1,63 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NETWORK_H_
+#define _NETWORK_H_
+
+#include "../main.h"
+#include "cosim.h"
+
+enum { Network_MaxNodes = 1024 };
+enum { Network_MaxNeighbors = 32 };
+enum { Network_MaxLineLength = 1024 };
+enum { Network_DefaultLookahead = 10000 }; // Cycles, 10 ms at 1 MHz
+
+// One emulator process of the network //
+typedef struct NetworkNode {
+  char* name;
+  char* firmware;
+  char* device;                // NULL for the default part
+  uint16_t neighbors[Network_MaxNeighbors]; // Nodes hearing the UART
+  uint8_t numNeighbors;
+
+  pid_t pid;
+  int fd;                      // Co-simulation socket
+  bool done;                   // Exited or halted, no longer advanced
+  CosimReply last;             // Answer to the last quantum
+  uint8_t* input;              // UART bytes to deliver before the next quantum
+  uint32_t inputLength;
+  uint64_t quanta;             // Quanta run, the rest of the windows it was parked
+} NetworkNode;
+
+// Mesh of nodes advanced in lock step, see network.c //
+typedef struct Network {
+  const char* path;            // Topology file
+  uint64_t lookahead;          // Window length in cycles, the link latency
+  uint64_t maxCycles;          // Simulated time, 0 until all nodes are done
+  NetworkNode nodes[Network_MaxNodes];
+  uint32_t numNodes;
+  uint8_t* transfer;           // Bytes of a reply
+  uint64_t windows;            // Windows run
+  uint64_t parked;             // Nodes left asleep through a window
+} Network;
+
+Network* network_get(Emulator* const emu);
+int network_main(Emulator* const emu);
+void network_destroy(Emulator* const emu);
+
+#endif
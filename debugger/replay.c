@@ -0,0 +1,296 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Deterministic record/replay +++##########
+//# Given the same firmware and options, a run only differs from the
+//# last in what it gets from the host: bytes read by emulator call
+//# 0x0002, the UART input stream (its data and whether data was
+//# ready) and CONTROL-c. A recording logs each of those values with
+//# the number of instructions executed before it was used. A replay
+//# takes them from the log instead of the host, so the run repeats
+//# exactly, and CONTROL-c stops the CPU at the same cycle again.
+//#
+//# The log is the magic, a version, the flags and the records:
+//# [KIND:1][INSTRUCTION DELTA:LEB128][LENGTH:LEB128][DATA:LENGTH],
+//# numbers little endian. Debugger commands are not recorded, a
+//# batch script repeats them.
+//########################################################
+
+#include "replay.h"
+#include "io.h"
+
+enum { Replay_HeaderSize = 16 };
+
+Replay* replay_get(Emulator* const emu)
+{
+  if (emu->replay == NULL)
+    emu->replay = (Replay*) calloc(1, sizeof(Replay));
+  return emu->replay;
+}
+
+static void put_leb128(FILE* file, uint64_t value)
+{
+  do {
+    const uint8_t byte = (uint8_t)(value & 0x7F);
+    value >>= 7;
+    fputc(byte | (value != 0 ? 0x80 : 0), file);
+  } while (value != 0);
+}
+
+static bool get_leb128(const uint8_t* const data, const uint32_t size,
+                       uint32_t* const offset, uint64_t* const value)
+{
+  *value = 0;
+  for (uint32_t shift = 0; shift < 64 && *offset < size; shift += 7)
+  {
+    const uint8_t byte = data[(*offset)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static uint64_t executed_instructions(const Emulator* const emu)
+{
+  return emu->cpu->stats.instructions.executed;
+}
+
+static void replay_interrupt(Emulator* const emu, void* context);
+
+/**
+ * @brief Schedule the stop of the next recorded interrupt
+ */
+static void schedule_interrupt(Emulator* const emu, Replay* const replay)
+{
+  while (replay->nextInterrupt < replay->numRecords)
+  {
+    const ReplayRecord* const record = &replay->records[replay->nextInterrupt];
+    if (record->kind == ReplayRecord_Interrupt && record->length == sizeof(uint64_t))
+    {
+      uint64_t cycle;
+      memcpy(&cycle, replay->data + record->offset, sizeof cycle);
+      scheduler_add_observer(emu->scheduler, cycle, replay_interrupt, replay);
+      return;
+    }
+    replay->nextInterrupt++;
+  }
+}
+
+static void replay_interrupt(Emulator* const emu, void* context)
+{
+  Replay* const replay = (Replay*)context;
+
+  print_console(emu, "\n\t[Replayed CONTROL-c]\n\n");
+  emu->cpu->running = false;
+  emu->debugger->debug_mode = true;
+  emu->debugger->stop_reason = StopReason_Interrupt;
+
+  replay->nextInterrupt++;
+  schedule_interrupt(emu, replay);
+}
+
+static bool load_log(Emulator* const emu, Replay* const replay)
+{
+  FILE* const file = fopen(replay->path, "rb");
+  long size;
+
+  if (file == NULL)
+    return false;
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  replay->data = (uint8_t*) malloc(size > 0 ? (size_t)size : 1);
+  const bool read = size >= Replay_HeaderSize &&
+    fread(replay->data, (size_t)size, 1, file) == 1;
+  fclose(file);
+  if (!read)
+    return false;
+
+  uint32_t version;
+  memcpy(&version, replay->data + 8, sizeof version);
+  if (memcmp(replay->data, REPLAY_FILE_MAGIC, 8) != 0 ||
+      version != REPLAY_FILE_VERSION)
+    return false;
+  memcpy(&replay->flags, replay->data + 12, sizeof replay->flags);
+
+  uint32_t offset = Replay_HeaderSize;
+  uint32_t capacity = 0;
+  uint64_t instruction = 0;
+  while (offset < (uint32_t)size)
+  {
+    const uint8_t kind = replay->data[offset++];
+    uint64_t delta, length;
+    if (!get_leb128(replay->data, (uint32_t)size, &offset, &delta) ||
+        !get_leb128(replay->data, (uint32_t)size, &offset, &length) ||
+        length > (uint64_t)size - offset)
+      return false;
+
+    if (replay->numRecords == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 256;
+      replay->records = realloc(replay->records, capacity * sizeof(ReplayRecord));
+    }
+    instruction += delta;
+    ReplayRecord* const record = &replay->records[replay->numRecords++];
+    record->kind = kind;
+    record->instruction = instruction;
+    record->offset = offset;
+    record->length = (uint32_t)length;
+    offset += (uint32_t)length;
+  }
+
+  schedule_interrupt(emu, replay);
+  return true;
+}
+
+/**
+ * @brief Create the recording, or load the log to replay
+ */
+bool replay_start(Emulator* const emu)
+{
+  Replay* const replay = emu->replay;
+
+  if (replay == NULL)
+    return true;
+  if (!replay->recording)
+    return load_log(emu, replay);
+
+  replay->file = fopen(replay->path, "wb");
+  if (replay->file == NULL)
+    return false;
+
+  const uint32_t version = REPLAY_FILE_VERSION;
+  replay->flags = emu->uart_in != NULL ? Replay_FlagUartInput : 0;
+  replay->lastInstruction = executed_instructions(emu);
+  fwrite(REPLAY_FILE_MAGIC, 8, 1, replay->file);
+  fwrite(&version, sizeof version, 1, replay->file);
+  fwrite(&replay->flags, sizeof replay->flags, 1, replay->file);
+  return fflush(replay->file) == 0;
+}
+
+void replay_stop(Emulator* const emu)
+{
+  Replay* const replay = emu->replay;
+
+  if (replay == NULL)
+    return;
+  if (replay->file != NULL)
+    fclose(replay->file);
+  free(replay->records);
+  free(replay->data);
+  free(replay);
+  emu->replay = NULL;
+}
+
+bool replay_has_uart_input(const Emulator* const emu)
+{
+  return replay_is_replaying(emu) && (emu->replay->flags & Replay_FlagUartInput);
+}
+
+/**
+ * @brief Log a value the run got from the host, if recording
+ */
+void replay_record(Emulator* const emu, const ReplayRecordKind kind,
+                   const void* data, const uint32_t length)
+{
+  Replay* const replay = emu->replay;
+
+  if (replay == NULL || !replay->recording)
+    return;
+
+  const uint64_t instruction = executed_instructions(emu);
+  fputc(kind, replay->file);
+  put_leb128(replay->file, instruction - replay->lastInstruction);
+  put_leb128(replay->file, length);
+  if (length > 0)
+    fwrite(data, length, 1, replay->file);
+  // A failing run may never reach a clean exit
+  fflush(replay->file);
+  replay->lastInstruction = instruction;
+}
+
+/**
+ * @brief Take the next logged value, which must be of the given kind
+ * @return The length of the value, 0 once the replay diverged
+ */
+uint32_t replay_take(Emulator* const emu, const ReplayRecordKind kind,
+                     void* data, const uint32_t capacity)
+{
+  Replay* const replay = emu->replay;
+  char buffer[128];
+
+  while (replay->next < replay->numRecords &&
+         replay->records[replay->next].kind == ReplayRecord_Interrupt)
+    replay->next++;
+
+  const ReplayRecord* const record = replay->next < replay->numRecords ?
+    &replay->records[replay->next] : NULL;
+  if (record == NULL || record->kind != kind ||
+      record->instruction != executed_instructions(emu))
+  {
+    if (!replay->diverged)
+    {
+      sprintf(buffer, "\n\t[Replay diverged at instruction %llu]\n\n",
+              (unsigned long long)executed_instructions(emu));
+      print_console(emu, buffer);
+      replay->diverged = true;
+    }
+    return 0;
+  }
+
+  replay->next++;
+  const uint32_t length = record->length < capacity ? record->length : capacity;
+  memcpy(data, replay->data + record->offset, length);
+  return length;
+}
+
+/**
+ * @brief Emulator call 0x0002, a byte from the host console or the log
+ */
+char replay_read_console(Emulator* const emu)
+{
+  char c = 0;
+
+  if (replay_is_replaying(emu))
+  {
+    replay_take(emu, ReplayRecord_Console, &c, 1);
+    return c;
+  }
+
+  const bool read = read_console_char(emu, &c);
+  replay_record(emu, ReplayRecord_Console, &c, read ? 1 : 0);
+  return c;
+}
+
+/**
+ * @brief Called after each stretch of execution, logs a stop by CONTROL-c
+ * @param wasRunning Whether the CPU was running before the stretch
+ */
+void replay_note_stop(Emulator* const emu, const bool wasRunning)
+{
+  Replay* const replay = emu->replay;
+
+  if (replay == NULL || !replay->recording || !wasRunning ||
+      emu->cpu->running || emu->debugger->stop_reason != StopReason_Interrupt)
+    return;
+
+  const uint64_t cycle = emu->cpu->cycles;
+  replay_record(emu, ReplayRecord_Interrupt, &cycle, sizeof cycle);
+}
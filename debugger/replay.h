@@ -0,0 +1,77 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "../main.h"
+
+#define REPLAY_FILE_MAGIC "M430RPLY"
+#define REPLAY_FILE_VERSION 2u  // 2: UART input is polled before every read
+
+enum { Replay_FlagUartInput = 1 }; // The recorded run had a UART input stream
+
+// Externally sourced values, in the order the run consumed them //
+typedef enum {
+  ReplayRecord_Console,   // Emulator call 0x0002, the byte read (none at EOF)
+  ReplayRecord_UartReady, // Whether the UART input had data, one byte
+  ReplayRecord_UartData,  // A read from the UART input, empty at EOF
+  ReplayRecord_Interrupt, // CONTROL-c stopped the CPU, the cycle (8 bytes)
+} ReplayRecordKind;
+
+typedef struct ReplayRecord {
+  uint8_t kind;
+  uint64_t instruction;   // Instructions executed before the value was used
+  uint32_t offset;        // Payload in Replay.data
+  uint32_t length;
+} ReplayRecord;
+
+// Record or replay log //
+typedef struct Replay {
+  const char* path;
+  bool recording;
+  uint32_t flags;
+  FILE* file;             // Log being recorded
+  uint64_t lastInstruction;
+
+  ReplayRecord* records;  // Log being replayed
+  uint32_t numRecords;
+  uint32_t next;          // Next record to consume
+  uint32_t nextInterrupt; // Next interrupt record to schedule
+  uint8_t* data;
+  bool diverged;
+} Replay;
+
+Replay* replay_get(Emulator* const emu);
+bool replay_start(Emulator* const emu);
+void replay_stop(Emulator* const emu);
+
+static inline bool replay_is_replaying(const Emulator* const emu)
+{
+  return emu->replay != NULL && !emu->replay->recording;
+}
+
+bool replay_has_uart_input(const Emulator* const emu);
+void replay_record(Emulator* const emu, const ReplayRecordKind kind,
+                   const void* data, const uint32_t length);
+uint32_t replay_take(Emulator* const emu, const ReplayRecordKind kind,
+                     void* data, const uint32_t capacity);
+char replay_read_console(Emulator* const emu);
+void replay_note_stop(Emulator* const emu, const bool wasRunning);
+
+#endif
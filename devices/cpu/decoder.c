@@ -18,6 +18,7 @@
 
 #include "decoder.h"
 #include "../../debugger/io.h"
+#include "../../debugger/replay.h"
 
 // ##########+++ CPU Fetch Cycle  +++##########
 uint16_t fetch(Emulator *emu, bool report)
@@ -27,6 +28,14 @@ uint16_t fetch(Emulator *emu, bool report)
 
     p = (get_addr_ptr(cpu->pc));
     word = *p;
+    if (emu->coverage != NULL && report)
+    {
+        coverage_mark(emu->coverage->executed, cpu->pc);
+    }
+    if (emu->journal != NULL && report)
+    {
+        journal_record_step(emu);
+    }
     if (emu->do_trace && report)
     {
         char buffer[128];
@@ -66,21 +75,31 @@ void decode(Emulator *emu, uint16_t instruction, bool disassemble)
         // format I (two operand) instruction
         decode_formatI(emu, instruction, disassemble);
     }
+    else if (instruction < 0x0006 && disassemble)
+    {
+        if (debugger->debug_mode)
+        {
+            char call[100] = {0};
+            sprintf(call, "%02X%02X        \t[EMULATOR CALL %u]\n",
+                    instruction & 0xFF, instruction >> 8, instruction);
+            print_console(emu, call);
+        }
+    }
     else if (instruction < 0x0006)
     {
         switch (instruction) {
             case 0x0000:
-                exit(cpu->r7);
+                emu->exit_code = (uint8_t)cpu->r7;
+                cpu->running = false;
+                debugger->quit = true;
+                debugger->stop_reason = StopReason_Exit;
                 break;
             case 0x0001:
-                write(1, &cpu->r7, 1);
+                write_console_char(emu, (uint8_t)cpu->r7);
                 break;
             case 0x0002:
-                {
-                    char c;
-                    read(0, &c, 1);
-                    cpu->r7 = c;
-                } break;
+                cpu->r7 = replay_read_console(emu);
+                break;
             case 0x0003:
                 emu->do_trace = true;
                 break;
@@ -98,6 +117,7 @@ void decode(Emulator *emu, uint16_t instruction, bool disassemble)
     {
         char inv[100] = {0};
         debugger->error = ERROR_ILLEGAL_INSTRUCTION;
+        debugger->stop_reason = StopReason_IllegalInstruction;
         sprintf(inv, "%04X\t[INVALID INSTRUCTION]\n", instruction);
         print_console(emu, inv);
 
@@ -108,10 +128,108 @@ void decode(Emulator *emu, uint16_t instruction, bool disassemble)
 
     if (!disassemble)
     {
-        update_cpu_stats(emu);
+        cpu->cycles += instruction_cycles(instruction);
+        update_instruction_stats(emu, instruction);
     }
 }
 
+/**
+ * @brief Compute the length of an instruction from its first word
+ * @param instruction The first word of the instruction
+ * @return The instruction length in words (1 - 3), extension words included
+ */
+uint8_t instruction_length(uint16_t instruction)
+{
+    const uint8_t FormatId = (uint8_t)(instruction >> 12);
+    const uint8_t as_flag = (instruction & 0x0030) >> 4;
+    uint8_t source;
+    uint8_t length = 1;
+
+    if (FormatId >= 0x4)
+    {
+        source = (instruction & 0x0F00) >> 8;
+        length += (instruction & 0x0080) >> 7; // Indexed destination
+    }
+    else if (FormatId == 0x1)
+    {
+        source = instruction & 0x000F;
+    }
+    else
+    {
+        return length; // Jumps and emulator calls
+    }
+
+    if (as_flag == 1 && source != 3)
+        length++;      // Indexed, symbolic or absolute source
+    else if (as_flag == 3 && source == 0)
+        length++;      // Immediate source
+
+    return length;
+}
+
+// Format I cycles by source mode (Rn, X(Rn), @Rn, @Rn+ or #N)
+// and destination (Rm, PC, X(Rm)/EDE/&EDE)
+static const uint8_t FormatICycles[4][3] = {
+    { 1, 2, 4 },
+    { 3, 3, 6 },
+    { 2, 2, 5 },
+    { 2, 3, 5 },
+};
+
+// Format II cycles of RRA/RRC/SWPB/SXT, PUSH and CALL by source mode
+// (Rn, X(Rn), @Rn, @Rn+, #N)
+static const uint8_t FormatIICycles[3][5] = {
+    { 1, 4, 3, 3, 3 },
+    { 3, 5, 4, 5, 4 },
+    { 4, 5, 4, 5, 5 },
+};
+
+/**
+ * @brief Compute the execution time of an instruction from its first word,
+ * per the MSP430x2xx family user's guide. Constant generator sources count
+ * as register mode.
+ * @param instruction The first word of the instruction
+ * @return The number of MCLK cycles
+ */
+uint8_t instruction_cycles(uint16_t instruction)
+{
+    const uint8_t FormatId = (uint8_t)(instruction >> 12);
+    const uint8_t as_flag = (instruction & 0x0030) >> 4;
+
+    if (FormatId >= 0x4)
+    {
+        const uint8_t source = (instruction & 0x0F00) >> 8;
+        const uint8_t destination = instruction & 0x000F;
+        const bool constant = source == 3 || (source == 2 && as_flag > 1);
+        const uint8_t column = (instruction & 0x0080) ? 2 :
+            (destination == 0 ? 1 : 0);
+
+        return FormatICycles[constant ? 0 : as_flag][column];
+    }
+    else if (FormatId == 0x1)
+    {
+        const uint8_t opcode = (instruction & 0x0380) >> 7;
+        const uint8_t source = instruction & 0x000F;
+        const bool constant = source == 3 || (source == 2 && as_flag > 1);
+        uint8_t mode = constant ? 0 : as_flag;
+
+        if (opcode == 6)
+            return 5; // RETI
+        if (opcode > 6)
+            return 1;
+        if (mode == 3 && source == 0)
+            mode = 4; // Immediate
+
+        return FormatIICycles[opcode < 4 ? 0 : opcode - 3][mode];
+    }
+    else if (FormatId >= 0x2)
+    {
+        return 2; // Jumps, taken or not
+    }
+
+    return 1;     // Emulator calls and invalid instructions
+}
+
 // Constant Generator
 int16_t run_constant_generator(uint8_t source, uint8_t as_flag)
 {
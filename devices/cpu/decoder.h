@@ -35,6 +35,9 @@ void decode(Emulator *emu, uint16_t instruction, bool disassemble);
 
 uint16_t fetch(Emulator *emu, bool report);
 
+uint8_t instruction_length(uint16_t instruction);
+uint8_t instruction_cycles(uint16_t instruction);
+
 enum { 
   WORD, 
   BYTE 
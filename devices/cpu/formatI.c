@@ -802,6 +802,11 @@ void decode_formatI(Emulator *emu, uint16_t instruction, bool disassemble)
 
     } //# End of switch
 
+    /* Stack tracking only for instructions writing SP (incl. POP and RET) */
+    if ((destination == 1 && ad_flag == 0) || (source == 1 && as_flag == 3)) {
+      report_instruction_execution(emu, instruction);
+    }
+
   } // End of if
 
 
@@ -352,7 +352,10 @@ void decode_formatII(Emulator *emu, uint16_t instruction, bool disassemble)
 
       //# RETI Return from interrupt: Pop SR then pop PC
     case 0x6:{
-      print_console(emu,"Unimplemented - RETI\n");
+      cpu->sr = memory_read_word(get_stack_ptr(emu));
+      cpu->sp += 2;
+      cpu->pc = memory_read_word(get_stack_ptr(emu));
+      cpu->sp += 2;
       break;
     }
     default:{
@@ -360,6 +363,11 @@ void decode_formatII(Emulator *emu, uint16_t instruction, bool disassemble)
     }
 
     } //# End of Switch
+
+    /* Stack tracking only for PUSH, CALL, RETI and operations on SP */
+    if (opcode >= 0x4 || source == 1) {
+      report_instruction_execution(emu, instruction);
+    }
   } //# end if
 
 
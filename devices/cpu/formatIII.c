@@ -25,7 +25,9 @@
 //########################################################
 
 #include "decoder.h"
+#include "idle_loop.h"
 #include "../../debugger/io.h"
+#include "../../debugger/fuzz.h"
 
 void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
 {
@@ -51,6 +53,9 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   signed_offset *= 2;
 
   if (!disassemble) {
+  const uint16_t next_pc = cpu->pc;
+  bool taken = false;
+
   switch(condition){
 
   /* JNE/JNZ Jump if not equal/zero
@@ -61,7 +66,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x0:{
     const Status_reg fields = get_sr_fields(emu);
     if (fields.zero == false) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -74,7 +79,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x1:{
     const Status_reg fields = get_sr_fields(emu);
     if (fields.zero == true) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -88,7 +93,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x2:{
     const Status_reg fields = get_sr_fields(emu);
     if (fields.carry == false) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -102,7 +107,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x3:{
     const Status_reg fields = get_sr_fields(emu);
     if (fields.carry == true) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -116,7 +121,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x4:{
     const Status_reg fields = get_sr_fields(emu);
     if (fields.negative == true) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -130,7 +135,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x5:{
     const Status_reg fields = get_sr_fields(emu);
     if ((fields.negative ^ fields.overflow) == false) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -144,7 +149,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   case 0x6:{
     const Status_reg fields = get_sr_fields(emu);
     if ((fields.negative ^ fields.overflow) == true) {
-      cpu->pc += signed_offset;
+      taken = true;
     }
 
     break;
@@ -156,7 +161,7 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
    *
    */
   case 0x7:{
-    cpu->pc += signed_offset;
+    taken = true;
     break;
   }
 
@@ -166,6 +171,28 @@ void decode_formatIII(Emulator *emu, uint16_t instruction, bool disassemble)
   }
 
   } //# End of Switch
+
+  // An offset of 0 lands on the next instruction either way, the
+  // condition tells whether the branch was taken
+  if (taken) {
+    cpu->pc += signed_offset;
+  }
+
+  if (emu->fuzz != NULL) {
+    fuzz_mark_edge(emu->fuzz, cpu->pc);
+  }
+
+  if (emu->coverage != NULL) {
+    const uint16_t jump_address = next_pc - 2;
+    if (taken)
+      coverage_mark(emu->coverage->branchTaken, jump_address);
+    else
+      coverage_mark(emu->coverage->branchNotTaken, jump_address);
+  }
+
+  if (signed_offset < 0 && taken) {
+    report_backward_jump(emu, next_pc - 2);
+  }
   } //# end if
 
 
@@ -0,0 +1,114 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Idle loop detection +++##########
+//# Every taken backward jump compares the machine state with the
+//# one at its previous execution. If all registers are equal and
+//# memory was neither written nor a peripheral register read in
+//# between, the iteration changed nothing and the loop repeats
+//# identically until an event raises an interrupt or modifies a
+//# register. This covers jmp $ as well as loops polling a RAM
+//# flag set by an interrupt handler.
+//#
+//# Such a loop is skipped by whole iterations up to the next
+//# scheduled event. A loop polling a peripheral register is never
+//# skipped, the register may change at any time. Without a wake-up
+//# source the loop never ends and the run stops, unless a cycle
+//# quantum of machine_run() is active: then it spins to the end of
+//# the quantum, as an external simulator may set the flag.
+//################################################
+
+#include "idle_loop.h"
+#include "../../debugger/io.h"
+
+static void save_registers(Emulator* const emu, uint16_t* const registers)
+{
+  for (uint8_t i = 0; i < IdleLoop_RegisterCount; i++)
+    registers[i] = *(uint16_t*)get_reg_ptr(emu, i);
+}
+
+/**
+ * @brief Report a taken jump to a lower address
+ * @param jumpPc The address of the jump instruction
+ */
+void report_backward_jump(Emulator* const emu, const uint16_t jumpPc)
+{
+  Cpu* const cpu = emu->cpu;
+  IdleLoopDetector* const idle = &cpu->idleLoop;
+  const uint64_t epoch = memory_get_epoch();
+  uint16_t registers[IdleLoop_RegisterCount];
+
+  if (emu->no_idle_skip)
+    return;
+
+  save_registers(emu, registers);
+
+  if (idle->jumpPc != jumpPc || idle->memoryEpoch != epoch ||
+      idle->cycle >= cpu->cycles ||
+      memcmp(idle->registers, registers, sizeof registers) != 0)
+  {
+    idle->jumpPc = jumpPc;
+    idle->memoryEpoch = epoch;
+    idle->cycle = cpu->cycles;
+    idle->spinning = false;
+    memcpy(idle->registers, registers, sizeof registers);
+    return;
+  }
+
+  idle->spinning = true;
+
+  const uint64_t period = cpu->cycles - idle->cycle;
+  const uint64_t nextEvent = scheduler_next_cycle(emu->scheduler);
+
+  if (!idle->quantum && !scheduler_has_wakeup_source(emu->scheduler))
+  {
+    // Single steps just keep spinning
+    if (cpu->running)
+    {
+      char buffer[64];
+      sprintf(buffer, "\n\t[Idle loop at %04X without a wake-up source]\n\n",
+              jumpPc);
+      print_console(emu, buffer);
+      cpu->running = false;
+      emu->debugger->debug_mode = true;
+      emu->debugger->stop_reason = StopReason_IdleLoopStuck;
+    }
+    idle->cycle = cpu->cycles;
+    return;
+  }
+
+  if (nextEvent > cpu->cycles)
+  {
+    const uint64_t skipped =
+      (nextEvent - cpu->cycles + period - 1) / period * period;
+    cpu->cycles += skipped;
+    cpu->idleLoopCycles += skipped;
+  }
+  idle->cycle = cpu->cycles;
+}
+
+/**
+ * @return true if the CPU spins in an idle loop and nothing changed since
+ * its last iteration, only an interrupt or a host write can end the loop
+ */
+bool idle_loop_spinning(const Emulator* const emu)
+{
+  const IdleLoopDetector* const idle = &emu->cpu->idleLoop;
+
+  return idle->spinning && idle->memoryEpoch == memory_get_epoch();
+}
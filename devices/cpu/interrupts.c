@@ -0,0 +1,177 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Interrupt controller +++##########
+//# Peripherals assert and release interrupt lines as bits of a
+//# pending mask, bit N selecting the vector at 0xFFC0 + 2 * N.
+//# The mask is checked once before every instruction. A higher
+//# vector address has a higher priority, the NMI vector is taken
+//# regardless of GIE.
+//#
+//# Accepting an interrupt pushes PC and SR, clears SR except SCG0
+//# and loads PC from the vector. The vector's ack handler then
+//# clears single source flags. Vectors without a handler are
+//# edge triggered and released on acceptance.
+//#################################################
+
+#include "interrupts.h"
+#include "../utilities.h"
+#include "../../debugger/io.h"
+
+void interrupt_request(Emulator* const emu, const uint8_t vector)
+{
+  if (vector < Interrupt_Reset)
+    emu->cpu->interrupts.pending |= 1u << vector;
+}
+
+void interrupt_clear(Emulator* const emu, const uint8_t vector)
+{
+  if (vector < Interrupt_Reset)
+    emu->cpu->interrupts.pending &= ~(1u << vector);
+}
+
+/**
+ * @brief Install the handler called when the CPU accepts the vector. The
+ * handler is responsible for releasing the line if the source is cleared.
+ */
+void interrupt_set_ack_handler(Emulator* const emu, const uint8_t vector,
+                               InterruptAckHandler handler, void* context)
+{
+  InterruptController* const irq = &emu->cpu->interrupts;
+
+  if (vector >= Interrupt_VectorCount)
+    return;
+  irq->ack[vector] = handler;
+  irq->ackContext[vector] = context;
+}
+
+void reset_interrupts(Emulator* const emu)
+{
+  InterruptController* const irq = &emu->cpu->interrupts;
+
+  irq->pending = 0;
+  memset(irq->accepted, 0, sizeof irq->accepted);
+}
+
+static uint8_t highest_pending(const uint32_t pending)
+{
+  return (uint8_t)(31 - __builtin_clz(pending));
+}
+
+/**
+ * @brief Accept the highest priority pending interrupt, if any is enabled
+ * @return true if PC now points at an interrupt handler
+ */
+bool service_interrupts(Emulator* const emu)
+{
+  Cpu* const cpu = emu->cpu;
+  InterruptController* const irq = &cpu->interrupts;
+  uint32_t enabled = irq->pending;
+
+  if (enabled == 0)
+    return false;
+  if (!(cpu->sr & StatusRegister_GIE))
+    enabled &= 1u << Interrupt_Nmi;
+  if (enabled == 0)
+    return false;
+
+  const uint8_t vector = highest_pending(enabled);
+  const uint16_t returnPc = cpu->pc;
+
+  cpu->sp -= 2;
+  memory_write_word(get_stack_ptr(emu), cpu->pc);
+  cpu->sp -= 2;
+  memory_write_word(get_stack_ptr(emu), cpu->sr);
+
+  cpu->sr &= StatusRegister_SCG0;
+  cpu->pc = memory_read_word(
+    get_addr_ptr(INTERRUPT_VECTOR_TABLE + 2 * vector));
+
+  cpu->cycles += Interrupt_EntryCycles;
+  irq->accepted[vector]++;
+  if (irq->ack[vector] != NULL)
+    irq->ack[vector](emu, irq->ackContext[vector], vector);
+  else
+    irq->pending &= ~(1u << vector);
+
+  if (emu->do_trace)
+  {
+    char buffer[64];
+    sprintf(buffer, "Interrupt %u -> %04X\n", vector, cpu->pc);
+    print_console(emu, buffer);
+  }
+
+  report_interrupt_entry(emu, returnPc);
+  return true;
+}
+
+/**
+ * @brief With CPUOFF set no instruction is fetched. Instead of idling
+ * cycle by cycle, time jumps to the next scheduled event, the only thing
+ * which can raise the interrupt ending the low power mode. The caller runs
+ * the due events.
+ */
+LowPowerState handle_low_power_mode(Emulator* const emu)
+{
+  Cpu* const cpu = emu->cpu;
+  const uint64_t nextEvent = scheduler_next_cycle(emu->scheduler);
+
+  if (!(cpu->sr & StatusRegister_CPUOFF))
+    return LowPower_Active;
+
+  if (!(cpu->sr & StatusRegister_GIE) &&
+      !(cpu->interrupts.pending & (1u << Interrupt_Nmi)))
+  {
+    print_console(emu, "\n\t[CPU off with interrupts disabled]\n\n");
+    return LowPower_Stuck;
+  }
+  if (!scheduler_has_wakeup_source(emu->scheduler))
+  {
+    print_console(emu, "\n\t[CPU off without a wake-up source]\n\n");
+    return LowPower_Stuck;
+  }
+
+  if (nextEvent > cpu->cycles)
+  {
+    cpu->lowPowerCycles += nextEvent - cpu->cycles;
+    cpu->cycles = nextEvent;
+  }
+  return LowPower_Sleeping;
+}
+
+void display_interrupts(Emulator* const emu)
+{
+  const Cpu* const cpu = emu->cpu;
+  const InterruptController* const irq = &cpu->interrupts;
+  char buffer[128];
+
+  sprintf(buffer, "GIE: %u  Pending: %08X\n",
+          (cpu->sr & StatusRegister_GIE) ? 1 : 0, irq->pending);
+  print_console(emu, buffer);
+
+  for (uint8_t vector = 0; vector < Interrupt_VectorCount; vector++)
+  {
+    if (irq->accepted[vector] == 0 && !(irq->pending & (1u << vector)))
+      continue;
+    sprintf(buffer, "  %2u  %04X  %s accepted %llu\n", vector,
+            INTERRUPT_VECTOR_TABLE + 2 * vector,
+            (irq->pending & (1u << vector)) ? "pending " : "        ",
+            (unsigned long long)irq->accepted[vector]);
+    print_console(emu, buffer);
+  }
+}
@@ -0,0 +1,53 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INTERRUPTS_H_
+#define _INTERRUPTS_H_
+
+#include "../../main.h"
+
+#define INTERRUPT_VECTOR_TABLE 0xFFC0u
+
+enum { Interrupt_Nmi = 30 };   // 0xFFFC, not masked by GIE
+enum { Interrupt_Reset = 31 }; // 0xFFFE, not requested through the controller
+enum { Interrupt_EntryCycles = 6 };
+
+enum {
+  StatusRegister_GIE = 0x0008,
+  StatusRegister_CPUOFF = 0x0010,
+  StatusRegister_SCG0 = 0x0040,
+};
+
+void interrupt_request(Emulator* const emu, const uint8_t vector);
+void interrupt_clear(Emulator* const emu, const uint8_t vector);
+void interrupt_set_ack_handler(Emulator* const emu, const uint8_t vector,
+                               InterruptAckHandler handler, void* context);
+void reset_interrupts(Emulator* const emu);
+
+// Result of handle_low_power_mode() //
+typedef enum {
+  LowPower_Active,   // CPUOFF is clear, execute the next instruction
+  LowPower_Sleeping, // Time was skipped to the next scheduled event
+  LowPower_Stuck,    // Nothing can ever wake the CPU up
+} LowPowerState;
+
+bool service_interrupts(Emulator* const emu);
+LowPowerState handle_low_power_mode(Emulator* const emu);
+void display_interrupts(Emulator* const emu);
+
+#endif
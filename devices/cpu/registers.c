@@ -18,9 +18,12 @@
 
 #include "registers.h"
 #include "../../debugger/io.h"
+#include "../../debugger/fuzz.h"
 
 #define OPCODE_MASK 0xFFC0u
 #define OPCODE_CALL_INSTRUCTION 0x1280u
+#define OPCODE_RET_INSTRUCTION 0x4130u
+#define OPCODE_RETI_INSTRUCTION 0x1300u
 
 //##########+++ MSP430 Register initialization +++##########
 void initialize_msp_registers(Emulator* const emu)
@@ -190,43 +193,433 @@ void set_sr_from_fields(Emulator* const emu, const Status_reg fields)
   cpu->sr = r2;
 }
 
+/**
+ * @brief Record the current SP value. Called only after instructions that
+ * modify SP, the lowest SP seen inside the innermost call is kept in its
+ * call trace entry and propagated to the caller when the call returns.
+ */
 void update_cpu_stats(Emulator* const emu)
 {
+  Cpu* const cpu = emu->cpu;
+  CpuStats* const stats = &cpu->stats;
+  CallTracer* const tracer = &cpu->callTracer;
   char buffer[STRING_BUFFER_SIZE];
-  if (emu->cpu->stats.spLowWatermark > emu->cpu->sp)
+
+  if (tracer->callDepth > 0 && tracer->callDepth <= CallTracer_MaxCallDepth)
+  {
+    CallTraceEntry* const top = &tracer->calls[tracer->callDepth - 1];
+    if (top->minSp > cpu->sp)
+      top->minSp = cpu->sp;
+  }
+
+  if (stats->spLowWatermark > cpu->sp)
+  {
+    if (emu->do_trace)
+    {
+      sprintf(buffer, "New SP low watermark - %04X\n", cpu->sp);
+      print_console(emu, buffer);
+    }
+    stats->spLowWatermark = cpu->sp;
+    stats->spLowWatermarkPc = cpu->pc;
+
+    // Keep the call chain which produced the worst case
+    stats->worstChainDepth = tracer->callDepth;
+    for (uint32_t i = 0; i < tracer->callDepth && i < CallTracer_MaxCallDepth; i++)
+      stats->worstChain[i] = tracer->calls[i].targetPc;
+  }
+
+  stats->spLastValue = cpu->sp;
+
+  if (emu->fuzz != NULL)
+    fuzz_check_stack(emu);
+}
+
+static FunctionStackUsage* find_function_stack_usage(CpuStats* const stats,
+                                                     const uint16_t entryPc)
+{
+  uint32_t slot = (entryPc >> 1) & (CpuStats_MaxFunctions - 1);
+
+  for (uint32_t i = 0; i < CpuStats_MaxFunctions; i++)
+  {
+    FunctionStackUsage* const usage = &stats->functions[slot];
+    if (usage->entryPc == entryPc)
+      return usage;
+    if (usage->entryPc == 0 && usage->calls == 0)
+    {
+      usage->entryPc = entryPc;
+      stats->numFunctions++;
+      return usage;
+    }
+    slot = (slot + 1) & (CpuStats_MaxFunctions - 1);
+  }
+  return NULL;
+}
+
+static void print_spaces(Emulator* const emu, const uint8_t count)
+{
+  for (uint8_t i = 0; i < count; i++)
+    print_console(emu, " ");
+}
+
+static void push_call(Emulator* const emu, const uint16_t returnPc,
+                      const uint16_t frameSp, const char* const kind)
+{
+  Cpu* const cpu = emu->cpu;
+  CallTracer* const tracer = &cpu->callTracer;
+  char buffer[STRING_BUFFER_SIZE];
+
+  FunctionStackUsage* const usage =
+    find_function_stack_usage(&cpu->stats, cpu->pc);
+  if (usage != NULL)
+    usage->calls++;
+
+  if (tracer->callDepth < CallTracer_MaxCallDepth)
   {
+    CallTraceEntry* const entry = &tracer->calls[tracer->callDepth];
+    entry->targetPc = cpu->pc;
+    entry->returnPc = returnPc;
+    entry->sp = frameSp;
+    entry->minSp = cpu->sp;
+  }
+
+  if (emu->do_trace)
+  {
+    print_spaces(emu, tracer->callDepth < 64 ? tracer->callDepth : 64);
+    sprintf(buffer, "%s %04X (SP %04X)\n", kind, cpu->pc, cpu->sp);
+    print_console(emu, buffer);
+  }
+  tracer->callDepth++;
+}
+
+static void pop_call(Emulator* const emu)
+{
+  Cpu* const cpu = emu->cpu;
+  CallTracer* const tracer = &cpu->callTracer;
+  char buffer[STRING_BUFFER_SIZE];
+
+  tracer->callDepth--;
+  if (tracer->callDepth < CallTracer_MaxCallDepth)
+  {
+    const CallTraceEntry* const entry = &tracer->calls[tracer->callDepth];
+    FunctionStackUsage* const usage =
+      find_function_stack_usage(&cpu->stats, entry->targetPc);
+    const uint16_t depth = entry->sp - entry->minSp;
+
+    if (usage != NULL && usage->maxDepth < depth)
+      usage->maxDepth = depth;
+
+    if (tracer->callDepth > 0 &&
+        tracer->calls[tracer->callDepth - 1].minSp > entry->minSp)
+      tracer->calls[tracer->callDepth - 1].minSp = entry->minSp;
+
     if (emu->do_trace)
     {
-      sprintf(buffer, "New SP low watermark - %04X\n", emu->cpu->sp);
+      print_spaces(emu, tracer->callDepth < 64 ? tracer->callDepth : 64);
+      sprintf(buffer, "RET  %04X (%u bytes)\n", entry->targetPc, depth);
       print_console(emu, buffer);
     }
-    emu->cpu->stats.spLowWatermark = emu->cpu->sp;
   }
+}
+
+/**
+ * @brief Report the execution of an instruction which modified SP. CALL,
+ * RET (MOV @SP+, PC) and RETI maintain the call tracer, every SP change
+ * updates the stack statistics.
+ * @param instruction The first word of the executed instruction
+ */
+void report_instruction_execution(Emulator* const emu, const uint16_t instruction)
+{
+  Cpu* const cpu = emu->cpu;
+  CallTracer* const tracer = &cpu->callTracer;
 
-  emu->cpu->stats.spLastValue = emu->cpu->sp;
+  if ((instruction & OPCODE_MASK) == OPCODE_CALL_INSTRUCTION)
+  {
+    push_call(emu, memory_read_word(get_stack_ptr(emu)), cpu->sp + 2, "CALL");
+    update_cpu_stats(emu);
+    if (emu->fuzz != NULL)
+      fuzz_mark_edge(emu->fuzz, cpu->pc);
+  }
+  else if (instruction == OPCODE_RET_INSTRUCTION ||
+           instruction == OPCODE_RETI_INSTRUCTION)
+  {
+    update_cpu_stats(emu);
+
+    // Unwind to the frame returning here, calls left by other means
+    // (e.g. longjmp) are dropped with it
+    for (uint32_t depth = tracer->callDepth; depth > 0; depth--)
+    {
+      if (depth <= CallTracer_MaxCallDepth &&
+          tracer->calls[depth - 1].returnPc != cpu->pc)
+        continue;
+      while (tracer->callDepth >= depth)
+        pop_call(emu);
+      break;
+    }
+  }
+  else
+  {
+    update_cpu_stats(emu);
+  }
+}
+
+/**
+ * @brief Report an accepted interrupt, traced as a call whose frame holds
+ * the pushed PC and SR
+ * @param returnPc The PC pushed on the stack
+ */
+void report_interrupt_entry(Emulator* const emu, const uint16_t returnPc)
+{
+  Cpu* const cpu = emu->cpu;
+
+  push_call(emu, returnPc, cpu->sp + 4, "INT ");
+  update_cpu_stats(emu);
+}
+
+static SourceMode get_source_mode(const uint8_t source, const uint8_t as_flag)
+{
+  if (source == 3 || (source == 2 && as_flag > 1))
+    return SourceMode_Constant;
+
+  switch (as_flag) {
+    case 0: return SourceMode_Register;
+    case 1:
+      if (source == 0) return SourceMode_Symbolic;
+      if (source == 2) return SourceMode_Absolute;
+      return SourceMode_Indexed;
+    case 2: return SourceMode_Indirect;
+    default:
+      return source == 0 ? SourceMode_Immediate : SourceMode_AutoIncrement;
+  }
+}
+
+static DestinationMode get_destination_mode(const uint8_t destination,
+                                            const uint8_t ad_flag)
+{
+  if (ad_flag == 0)
+    return DestinationMode_Register;
+  if (destination == 0)
+    return DestinationMode_Symbolic;
+  if (destination == 2)
+    return DestinationMode_Absolute;
+  return DestinationMode_Indexed;
+}
+
+void update_instruction_stats(Emulator* const emu, const uint16_t instruction)
+{
+  InstructionStats* const stats = &emu->cpu->stats.instructions;
+  const uint8_t formatId = (uint8_t)(instruction >> 12);
+  const uint8_t as_flag = (instruction & 0x0030) >> 4;
+
+  stats->executed++;
+
+  if (formatId >= 0x4) {
+    const uint8_t source = (instruction & 0x0F00) >> 8;
+    const uint8_t destination = instruction & 0x000F;
+    const uint8_t ad_flag = (instruction & 0x0080) >> 7;
+    stats->kindCounts[InstructionKind_Mov + formatId - 0x4]++;
+    stats->formatIModeCounts[get_source_mode(source, as_flag)]
+      [get_destination_mode(destination, ad_flag)]++;
+  }
+  else if (formatId >= 0x2) {
+    const uint8_t condition = (instruction & 0x1C00) >> 10;
+    stats->kindCounts[InstructionKind_Jnz + condition]++;
+  }
+  else if (formatId == 0x1) {
+    const uint8_t opcode = (instruction & 0x0380) >> 7;
+    const uint8_t source = instruction & 0x000F;
+    if (opcode <= 0x6) {
+      stats->kindCounts[InstructionKind_Rrc + opcode]++;
+      stats->formatIIModeCounts[get_source_mode(source, as_flag)]++;
+    }
+    else {
+      stats->kindCounts[InstructionKind_Invalid]++;
+    }
+  }
+  else if (instruction < 0x0006) {
+    stats->kindCounts[InstructionKind_EmulatorCall]++;
+  }
+  else {
+    stats->kindCounts[InstructionKind_Invalid]++;
+  }
+}
+
+static const char* const InstructionKindNames[InstructionKind_Count] = {
+  "RRC", "SWPB", "RRA", "SXT", "PUSH", "CALL", "RETI",
+  "JNZ", "JZ", "JNC", "JC", "JN", "JGE", "JL", "JMP",
+  "MOV", "ADD", "ADDC", "SUBC", "SUB", "CMP", "DADD",
+  "BIT", "BIC", "BIS", "XOR", "AND",
+  "<emu>", "<invalid>"
+};
+
+static const char* const SourceModeNames[SourceMode_Count] = {
+  "Rn", "X(Rn)", "ADDR", "&ADDR", "@Rn", "@Rn+", "#N", "#CG"
+};
+
+static const char* const DestinationModeNames[DestinationMode_Count] = {
+  "Rn", "X(Rn)", "ADDR", "&ADDR"
+};
+
+static double percentage(const uint64_t count, const uint64_t total)
+{
+  return total == 0 ? 0.0 : (100.0 * count) / total;
+}
+
+static void display_instruction_stats(Emulator* const emu)
+{
+  const InstructionStats* const stats = &emu->cpu->stats.instructions;
+  char line[STRING_BUFFER_SIZE];
+  uint64_t formatITotal = 0, formatIITotal = 0;
+
+  sprintf(line, " \tInstructions executed - %llu\n",
+    (unsigned long long)stats->executed);
+  print_console(emu, line);
+  if (stats->executed == 0)
+    return;
+
+  print_console(emu, " \tInstruction mix:\n");
+  for (int i = 0; i < InstructionKind_Count; i++) {
+    if (stats->kindCounts[i] == 0)
+      continue;
+    sprintf(line, " \t  %-14s %12llu (%5.1f%%)\n", InstructionKindNames[i],
+      (unsigned long long)stats->kindCounts[i],
+      percentage(stats->kindCounts[i], stats->executed));
+    print_console(emu, line);
+  }
+
+  for (int as = 0; as < SourceMode_Count; as++) {
+    for (int ad = 0; ad < DestinationMode_Count; ad++)
+      formatITotal += stats->formatIModeCounts[as][ad];
+    formatIITotal += stats->formatIIModeCounts[as];
+  }
+
+  if (formatITotal > 0) {
+    print_console(emu, " \tFormat I addressing (src, dst):\n");
+    for (int as = 0; as < SourceMode_Count; as++) {
+      for (int ad = 0; ad < DestinationMode_Count; ad++) {
+        const uint64_t count = stats->formatIModeCounts[as][ad];
+        if (count == 0)
+          continue;
+        sprintf(line, " \t  %-5s, %-6s %12llu (%5.1f%%)\n",
+          SourceModeNames[as], DestinationModeNames[ad],
+          (unsigned long long)count, percentage(count, formatITotal));
+        print_console(emu, line);
+      }
+    }
+  }
+
+  if (formatIITotal > 0) {
+    print_console(emu, " \tFormat II addressing (src):\n");
+    for (int as = 0; as < SourceMode_Count; as++) {
+      const uint64_t count = stats->formatIIModeCounts[as];
+      if (count == 0)
+        continue;
+      sprintf(line, " \t  %-14s %12llu (%5.1f%%)\n", SourceModeNames[as],
+        (unsigned long long)count, percentage(count, formatIITotal));
+      print_console(emu, line);
+    }
+  }
+}
+
+static int compare_stack_usage(const void* a, const void* b)
+{
+  const FunctionStackUsage* x = a;
+  const FunctionStackUsage* y = b;
+  if (x->maxDepth != y->maxDepth)
+    return (int)y->maxDepth - (int)x->maxDepth;
+  return (int)x->entryPc - (int)y->entryPc;
+}
+
+static void display_stack_stats(Emulator* const emu)
+{
+  Cpu* const cpu = emu->cpu;
+  CpuStats* const stats = &cpu->stats;
+  const CallTracer* const tracer = &cpu->callTracer;
+  char line[STRING_BUFFER_SIZE];
+  uint32_t count = 0;
+
+  if (stats->numFunctions == 0)
+    return;
+
+  FunctionStackUsage* const usage =
+    calloc(stats->numFunctions, sizeof(FunctionStackUsage));
+
+  for (uint32_t i = 0; i < CpuStats_MaxFunctions; i++)
+  {
+    if (stats->functions[i].calls > 0)
+      usage[count++] = stats->functions[i];
+  }
+
+  // Calls which have not returned yet count with their current depth
+  uint16_t minSp = 0xFFFF;
+  for (uint32_t depth = tracer->callDepth; depth > 0; depth--)
+  {
+    if (depth > CallTracer_MaxCallDepth)
+      continue;
+    const CallTraceEntry* const entry = &tracer->calls[depth - 1];
+    if (minSp > entry->minSp)
+      minSp = entry->minSp;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (usage[i].entryPc == entry->targetPc &&
+          usage[i].maxDepth < (uint16_t)(entry->sp - minSp))
+        usage[i].maxDepth = entry->sp - minSp;
+    }
+  }
+
+  qsort(usage, count, sizeof(FunctionStackUsage), compare_stack_usage);
+
+  print_console(emu, " \tStack usage per function (callees included):\n");
+  for (uint32_t i = 0; i < count; i++)
+  {
+    sprintf(line, " \t  %04X %6u bytes %10u calls\n", usage[i].entryPc,
+      usage[i].maxDepth, usage[i].calls);
+    print_console(emu, line);
+  }
+  free(usage);
+
+  sprintf(line, " \tWorst case call chain (SP %04X at PC %04X):\n \t  reset",
+    stats->spLowWatermark, stats->spLowWatermarkPc);
+  print_console(emu, line);
+  for (uint32_t i = 0; i < stats->worstChainDepth; i++)
+  {
+    if (i == CallTracer_MaxCallDepth)
+    {
+      print_console(emu, " -> ...");
+      break;
+    }
+    sprintf(line, " -> %04X", stats->worstChain[i]);
+    print_console(emu, line);
+  }
+  print_console(emu, "\n");
 }
 
 void display_cpu_stats(Emulator* const emu)
 {
   char stats[STRING_BUFFER_SIZE];
-  sprintf(stats, "CPU stats:\n \tSP low watermark - %04X\n",
+  sprintf(stats, "CPU stats:\n \tCycles - %llu (%llu in low power mode, "
+    "%llu in idle loops)\n \tSP low watermark - %04X\n",
+    (unsigned long long)emu->cpu->cycles,
+    (unsigned long long)emu->cpu->lowPowerCycles,
+    (unsigned long long)emu->cpu->idleLoopCycles,
     emu->cpu->stats.spLowWatermark);
   print_console(emu, stats);
+  display_stack_stats(emu);
+  display_instruction_stats(emu);
 }
 
 void reset_cpu_stats(Emulator* const emu)
 {
-  emu->cpu->stats.spLowWatermark = 0xFFFF;
-  emu->cpu->stats.spLastValue = 0xFFFF;
+  CpuStats* const stats = &emu->cpu->stats;
+  stats->spLowWatermark = 0xFFFF;
+  stats->spLastValue = 0xFFFF;
+  stats->spLowWatermarkPc = 0;
+  stats->worstChainDepth = 0;
+  stats->numFunctions = 0;
+  memset(stats->functions, 0, sizeof(stats->functions));
+  memset(&stats->instructions, 0, sizeof(InstructionStats));
 }
 
 void reset_call_tracer(Emulator* const emu)
 {
   emu->cpu->callTracer.callDepth = 0;
 }
-
-static void print_spaces(Emulator* const emu, const uint8_t count)
-{
-  for (uint8_t i = 0; i < count; i++)
-    print_console(emu, " ");
-}
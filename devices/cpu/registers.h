@@ -26,6 +26,43 @@
 #include "../../main.h"
 
 enum { CallTracer_MaxCallDepth = 128 };
+enum { CpuStats_MaxFunctions = 1024 }; // Power of two, hashed by entry PC
+enum { Interrupt_VectorCount = 32 };   // Vectors at 0xFFC0 - 0xFFFE
+enum { IdleLoop_RegisterCount = 16 };
+
+// Instruction kinds counted by the instruction-mix statistics //
+typedef enum {
+  InstructionKind_Rrc,  // Format II
+  InstructionKind_Swpb,
+  InstructionKind_Rra,
+  InstructionKind_Sxt,
+  InstructionKind_Push,
+  InstructionKind_Call,
+  InstructionKind_Reti,
+  InstructionKind_Jnz,  // Format III
+  InstructionKind_Jz,
+  InstructionKind_Jnc,
+  InstructionKind_Jc,
+  InstructionKind_Jn,
+  InstructionKind_Jge,
+  InstructionKind_Jl,
+  InstructionKind_Jmp,
+  InstructionKind_Mov,  // Format I
+  InstructionKind_Add,
+  InstructionKind_Addc,
+  InstructionKind_Subc,
+  InstructionKind_Sub,
+  InstructionKind_Cmp,
+  InstructionKind_Dadd,
+  InstructionKind_Bit,
+  InstructionKind_Bic,
+  InstructionKind_Bis,
+  InstructionKind_Xor,
+  InstructionKind_And,
+  InstructionKind_EmulatorCall, // 0x0000 - 0x0005 host calls
+  InstructionKind_Invalid,
+  InstructionKind_Count
+} InstructionKind;
 
 /* r2 or SR, the status register */
 typedef struct Status_reg {
@@ -46,6 +83,7 @@ typedef struct CallTraceEntry {
   uint16_t targetPc; // Target call PC
   uint16_t returnPc; // Return PC (one instruction after the call)
   uint16_t sp;       // SP value at the time of the call
+  uint16_t minSp;    // Lowest SP value reached inside the call
 } CallTraceEntry;
 
 // Structure containing data for call tracing //
@@ -54,10 +92,75 @@ typedef struct CallTracer {
   uint32_t callDepth;                            // Current call stack depth
 } CallTracer;
 
+// Called when the CPU accepts an interrupt, clears single source flags //
+typedef void (*InterruptAckHandler)(Emulator* const emu, void* context,
+                                    const uint8_t vector);
+
+// Structure containing the interrupt controller state //
+typedef struct InterruptController {
+  uint32_t pending; // Bit N requests the vector at 0xFFC0 + 2 * N
+  InterruptAckHandler ack[Interrupt_VectorCount]; // Per vector, may be NULL
+  void* ackContext[Interrupt_VectorCount];
+  uint64_t accepted[Interrupt_VectorCount];       // Accepted per vector
+} InterruptController;
+
+// Machine state at the last taken backward jump //
+typedef struct IdleLoopDetector {
+  uint16_t jumpPc;        // Address of the jump, 0 if none was seen
+  uint16_t registers[IdleLoop_RegisterCount];
+  uint64_t memoryEpoch;   // memory_get_epoch() at the jump
+  uint64_t cycle;         // CPU cycle at the jump
+  bool quantum;           // machine_run() has a cycle budget, see below
+  bool spinning;          // The last iteration changed nothing
+} IdleLoopDetector;
+
+// Effective source addressing modes (As decoded with its register) //
+typedef enum {
+  SourceMode_Register,      // Rn
+  SourceMode_Indexed,       // X(Rn)
+  SourceMode_Symbolic,      // ADDR, X(PC)
+  SourceMode_Absolute,      // &ADDR, X(SR)
+  SourceMode_Indirect,      // @Rn
+  SourceMode_AutoIncrement, // @Rn+
+  SourceMode_Immediate,     // #N, @PC+
+  SourceMode_Constant,      // #N from CG1/CG2
+  SourceMode_Count
+} SourceMode;
+
+// Effective destination addressing modes (Ad decoded with its register) //
+typedef enum {
+  DestinationMode_Register, // Rn
+  DestinationMode_Indexed,  // X(Rn)
+  DestinationMode_Symbolic, // ADDR, X(PC)
+  DestinationMode_Absolute, // &ADDR, X(SR)
+  DestinationMode_Count
+} DestinationMode;
+
+// Structure containing instruction mix and addressing mode histograms //
+typedef struct InstructionStats {
+  uint64_t executed;                          // Executed instructions
+  uint64_t kindCounts[InstructionKind_Count]; // Per opcode counters
+  uint64_t formatIModeCounts[SourceMode_Count][DestinationMode_Count];
+  uint64_t formatIIModeCounts[SourceMode_Count];
+} InstructionStats;
+
+// Structure describing the stack usage of a single function //
+typedef struct FunctionStackUsage {
+  uint16_t entryPc;  // Function entry PC, 0 for an unused slot
+  uint16_t maxDepth; // Maximum stack depth in bytes, callees included
+  uint32_t calls;    // Number of calls
+} FunctionStackUsage;
+
 // Structure containing CPU statistics //
 typedef struct CpuStats {
   uint16_t spLowWatermark; // The lowest recorded SP value
   uint16_t spLastValue;    // Last SP value
+  uint16_t spLowWatermarkPc; // PC at which the low watermark was reached
+  uint32_t worstChainDepth;  // Call depth at the low watermark
+  uint16_t worstChain[CallTracer_MaxCallDepth]; // Call chain at the watermark
+  FunctionStackUsage functions[CpuStats_MaxFunctions]; // Per function usage
+  uint32_t numFunctions;   // Used slots in functions
+  InstructionStats instructions;
 } CpuStats;
 
 // Main CPU structure //
@@ -76,7 +179,14 @@ typedef struct Cpu {
   Usci *usci;
   Bcm *bcm;
   Timer_a *timer_a;
-
+  Multiplier *mpy;   /* NULL without a hardware multiplier */
+  FlashController *flash;
+
+  uint64_t cycles;   /* MCLK cycles executed since power up */
+  uint64_t lowPowerCycles; /* Cycles skipped with CPUOFF set */
+  uint64_t idleLoopCycles; /* Cycles skipped in idle loops */
+  IdleLoopDetector idleLoop;
+  InterruptController interrupts;
   CallTracer callTracer;
   CpuStats stats;
 } Cpu;
@@ -86,10 +196,12 @@ void set_sr_from_fields(Emulator* const emu, const Status_reg fields);
 void initialize_msp_registers (Emulator* const emu);
 void update_register_display (Emulator* const emu);
 void update_cpu_stats(Emulator* const emu);
+void update_instruction_stats(Emulator* const emu, const uint16_t instruction);
 void display_cpu_stats(Emulator* const emu);
 void reset_cpu_stats(Emulator* const emu);
 void reset_call_tracer(Emulator* const emu);
 void report_instruction_execution(Emulator* const emu, const uint16_t instruction);
+void report_interrupt_entry(Emulator* const emu, const uint16_t returnPc);
 
 
 #endif
@@ -0,0 +1,373 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Device profiles +++##########
+//# A profile describes one part on a single line: its name, then
+//# key=value fields separated by blanks. Numbers are C literals.
+//#
+//#   ram=START:SIZE  flash=START:SIZE  info=START:SIZE (0x1000:256)
+//#   cal=ADDRESS:XX,XX,...   calibration bytes in hex
+//#   peripherals=port1,timer_a,usci,mpy,flash
+//#   vectors=port1:N,usci_tx:N,usci_rx:N,timer_a1:N,timer_a0:N
+//#
+//# Vectors not given keep their MSP430x2xx numbers. Lines of a
+//# profile file starting with '#' are comments, a profile with
+//# the name of an earlier one replaces it. Profiles are parsed
+//# once into a table, the emulator only reads the selected one
+//# while it sets the machine up.
+//###########################################
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "device.h"
+
+enum { Device_MaxLineLength = 512 };
+
+static const char* const BuiltinProfiles[] = {
+  "msp430g2553 ram=0x200:512 flash=0xC000:16384 info=0x1000:256"
+  " cal=0x10F8:95,8F,9E,8E,92,8D,D1,86 peripherals=flash,port1,timer_a,usci",
+  "msp430g2452 ram=0x200:256 flash=0xE000:8192 info=0x1000:256"
+  " cal=0x10FE:D1,86 peripherals=flash,port1,timer_a",
+  "msp430g2231 ram=0x200:128 flash=0xF800:2048 info=0x1000:256"
+  " cal=0x10FE:D1,86 peripherals=flash,port1,timer_a",
+  "msp430f2274 ram=0x200:1024 flash=0x8000:32768 info=0x1000:256"
+  " cal=0x10F8:95,8F,9E,8E,92,8D,D1,86 peripherals=flash,port1,timer_a,usci",
+  "msp430f2370 ram=0x1100:2048 flash=0x8000:32768 info=0x1000:256"
+  " cal=0x10F8:95,8F,9E,8E,92,8D,D1,86 peripherals=flash,port1,timer_a,usci,mpy",
+};
+
+static const char* const PeripheralNames[] = {
+  "port1", "timer_a", "usci", "mpy", "flash"
+};
+
+static const char* const VectorNames[DeviceVector_Count] = {
+  "port1", "usci_tx", "usci_rx", "timer_a1", "timer_a0"
+};
+
+static const uint8_t DefaultVectors[DeviceVector_Count] = {
+  18, 22, 23, 24, 25
+};
+
+static DeviceProfile profiles[Device_MaxProfiles];
+static uint32_t num_profiles = 0;
+static bool builtins_parsed = false;
+
+static bool parse_number(const char* text, uint32_t* const value,
+                         const uint32_t limit)
+{
+  char* end;
+  const unsigned long number = strtoul(text, &end, 0);
+
+  if (end == text || *end != '\0' || number > limit)
+    return false;
+  *value = (uint32_t)number;
+  return true;
+}
+
+/**
+ * @brief Parse START:SIZE of a region ending within the address space
+ */
+static bool parse_region(char* text, uint16_t* const start,
+                         uint32_t* const size)
+{
+  char* const colon = strchr(text, ':');
+  uint32_t first, length;
+
+  if (colon == NULL)
+    return false;
+  *colon = '\0';
+  if (!parse_number(text, &first, 0xFFFF) ||
+      !parse_number(colon + 1, &length, 0x10000) ||
+      first + length > 0x10000)
+    return false;
+  *start = (uint16_t)first;
+  *size = length;
+  return true;
+}
+
+static bool parse_calibration(char* text, DeviceProfile* const device)
+{
+  char* const colon = strchr(text, ':');
+  char* saveptr;
+  uint32_t address, byte;
+
+  if (colon == NULL)
+    return false;
+  *colon = '\0';
+  if (!parse_number(text, &address, 0xFFFF))
+    return false;
+
+  device->calibrationStart = (uint16_t)address;
+  device->calibrationSize = 0;
+  for (char* item = strtok_r(colon + 1, ",", &saveptr); item != NULL;
+       item = strtok_r(NULL, ",", &saveptr))
+  {
+    char* end;
+    byte = (uint32_t)strtoul(item, &end, 16);
+    if (end == item || *end != '\0' || byte > 0xFF ||
+        device->calibrationSize == Device_MaxCalibrationBytes ||
+        address + device->calibrationSize > 0xFFFF)
+      return false;
+    device->calibration[device->calibrationSize++] = (uint8_t)byte;
+  }
+  return true;
+}
+
+static bool parse_peripherals(char* text, DeviceProfile* const device)
+{
+  char* saveptr;
+
+  device->peripherals = 0;
+  for (char* item = strtok_r(text, ",", &saveptr); item != NULL;
+       item = strtok_r(NULL, ",", &saveptr))
+  {
+    uint32_t i;
+    for (i = 0; i < sizeof PeripheralNames / sizeof *PeripheralNames; i++)
+    {
+      if (!strcmp(item, PeripheralNames[i]))
+        break;
+    }
+    if (i == sizeof PeripheralNames / sizeof *PeripheralNames)
+      return false;
+    device->peripherals |= 1u << i;
+  }
+  return true;
+}
+
+static bool parse_vectors(char* text, DeviceProfile* const device)
+{
+  char* saveptr;
+
+  for (char* item = strtok_r(text, ",", &saveptr); item != NULL;
+       item = strtok_r(NULL, ",", &saveptr))
+  {
+    char* const colon = strchr(item, ':');
+    uint32_t vector, i;
+
+    if (colon == NULL)
+      return false;
+    *colon = '\0';
+    for (i = 0; i < DeviceVector_Count; i++)
+    {
+      if (!strcmp(item, VectorNames[i]))
+        break;
+    }
+    // The reset and NMI vectors are not assignable
+    if (i == DeviceVector_Count || !parse_number(colon + 1, &vector, 29))
+      return false;
+    device->vectors[i] = (uint8_t)vector;
+  }
+  return true;
+}
+
+/**
+ * @brief Parse one profile line, the line buffer is modified
+ * @return false with a message in error if the line is invalid
+ */
+static bool parse_profile(char* line, DeviceProfile* const device,
+                          const char** error)
+{
+  char* saveptr;
+  char* name = strtok_r(line, " \t\r\n", &saveptr);
+  bool hasRam = false, hasFlash = false;
+
+  memset(device, 0, sizeof *device);
+  memcpy(device->vectors, DefaultVectors, sizeof device->vectors);
+  device->infoStart = 0x1000;
+  device->infoSize = 256;
+  if (name == NULL || strlen(name) >= Device_MaxNameLength)
+  {
+    *error = "invalid name";
+    return false;
+  }
+  strcpy(device->name, name);
+
+  for (char* field = strtok_r(NULL, " \t\r\n", &saveptr); field != NULL;
+       field = strtok_r(NULL, " \t\r\n", &saveptr))
+  {
+    char* const equals = strchr(field, '=');
+    bool valid;
+
+    if (equals == NULL)
+    {
+      *error = "expected key=value";
+      return false;
+    }
+    *equals = '\0';
+
+    if (!strcmp(field, "ram"))
+      valid = hasRam = parse_region(equals + 1, &device->ramStart,
+                                    &device->ramSize);
+    else if (!strcmp(field, "flash"))
+      valid = hasFlash = parse_region(equals + 1, &device->flashStart,
+                                      &device->flashSize);
+    else if (!strcmp(field, "info"))
+      valid = parse_region(equals + 1, &device->infoStart, &device->infoSize);
+    else if (!strcmp(field, "cal"))
+      valid = parse_calibration(equals + 1, device);
+    else if (!strcmp(field, "peripherals"))
+      valid = parse_peripherals(equals + 1, device);
+    else if (!strcmp(field, "vectors"))
+      valid = parse_vectors(equals + 1, device);
+    else
+    {
+      *error = "unknown key";
+      return false;
+    }
+
+    if (!valid)
+    {
+      *error = "invalid value";
+      return false;
+    }
+  }
+
+  if (!hasRam || !hasFlash)
+  {
+    *error = "ram and flash are required";
+    return false;
+  }
+  // The vector table is part of the flash
+  if ((uint32_t)device->flashStart + device->flashSize != 0x10000)
+  {
+    *error = "flash must end at 0xFFFF";
+    return false;
+  }
+  return true;
+}
+
+static bool add_profile(const DeviceProfile* const device)
+{
+  for (uint32_t i = 0; i < num_profiles; i++)
+  {
+    if (!strcmp(profiles[i].name, device->name))
+    {
+      profiles[i] = *device;
+      return true;
+    }
+  }
+  if (num_profiles == Device_MaxProfiles)
+    return false;
+  profiles[num_profiles++] = *device;
+  return true;
+}
+
+static void parse_builtin_profiles()
+{
+  char line[Device_MaxLineLength];
+  DeviceProfile device;
+  const char* error;
+
+  if (builtins_parsed)
+    return;
+  builtins_parsed = true;
+
+  for (uint32_t i = 0; i < sizeof BuiltinProfiles / sizeof *BuiltinProfiles; i++)
+  {
+    strcpy(line, BuiltinProfiles[i]);
+    if (parse_profile(line, &device, &error))
+      add_profile(&device);
+  }
+}
+
+/**
+ * @brief Add the profiles described in a file to the built-in ones
+ * @return false if the file could not be read or has an invalid line
+ */
+bool device_load_profiles(const char* fileName)
+{
+  char line[Device_MaxLineLength];
+  DeviceProfile device;
+  const char* error;
+  uint32_t lineNumber = 0;
+  FILE* const file = fopen(fileName, "r");
+
+  if (file == NULL)
+    return false;
+  parse_builtin_profiles();
+
+  while (fgets(line, sizeof line, file) != NULL)
+  {
+    const char* text = line + strspn(line, " \t\r\n");
+
+    lineNumber++;
+    if (*text == '\0' || *text == '#')
+      continue;
+    if (!parse_profile(line, &device, &error) || !add_profile(&device))
+    {
+      printf("%s:%u: %s\n", fileName, lineNumber,
+             num_profiles == Device_MaxProfiles ? "too many profiles" : error);
+      fclose(file);
+      return false;
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+/**
+ * @brief Look a profile up by its name
+ * @return NULL if there is none
+ */
+const DeviceProfile* device_find_profile(const char* name)
+{
+  parse_builtin_profiles();
+  for (uint32_t i = 0; i < num_profiles; i++)
+  {
+    if (!strcasecmp(profiles[i].name, name))
+      return &profiles[i];
+  }
+  return NULL;
+}
+
+void device_list_profiles()
+{
+  char buffer[256];
+
+  parse_builtin_profiles();
+  for (uint32_t i = 0; i < num_profiles; i++)
+  {
+    device_describe(&profiles[i], buffer, sizeof buffer);
+    printf("%s", buffer);
+  }
+}
+
+/**
+ * @brief Write a one line summary of a profile, newline terminated
+ */
+void device_describe(const DeviceProfile* const device, char* buffer,
+                     const uint32_t size)
+{
+  int length = snprintf(buffer, size,
+                        "%s: RAM %04X-%04X, flash %04X-FFFF, info %04X-%04X,",
+                        device->name, device->ramStart,
+                        device->ramStart + device->ramSize - 1,
+                        device->flashStart, device->infoStart,
+                        device->infoStart + device->infoSize - 1);
+
+  for (uint32_t i = 0; i < sizeof PeripheralNames / sizeof *PeripheralNames; i++)
+  {
+    if ((device->peripherals & (1u << i)) && length > 0 && (uint32_t)length < size)
+      length += snprintf(buffer + length, size - length, " %s", PeripheralNames[i]);
+  }
+  if (length > 0 && (uint32_t)length < size)
+    snprintf(buffer + length, size - length, "\n");
+}
@@ -0,0 +1,72 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DEVICE_H_
+#define _DEVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum { Device_MaxProfiles = 32 };
+enum { Device_MaxNameLength = 32 };
+enum { Device_MaxCalibrationBytes = 16 };
+
+#define DEVICE_DEFAULT_NAME "msp430g2553"
+
+// Peripheral models present on a device //
+typedef enum {
+  DevicePeripheral_Port1 = 0x01,
+  DevicePeripheral_TimerA = 0x02,
+  DevicePeripheral_Usci = 0x04,
+  DevicePeripheral_Multiplier = 0x08,
+  DevicePeripheral_Flash = 0x10,
+} DevicePeripheral;
+
+// Interrupt sources whose vector differs between families //
+typedef enum {
+  DeviceVector_Port1,
+  DeviceVector_UsciTx,
+  DeviceVector_UsciRx,
+  DeviceVector_TimerATaiv,
+  DeviceVector_TimerACcr0,
+  DeviceVector_Count
+} DeviceVector;
+
+// Memory layout and peripheral set of one MSP430 part //
+typedef struct DeviceProfile {
+  char name[Device_MaxNameLength];
+  uint16_t ramStart;
+  uint32_t ramSize;
+  uint16_t flashStart;        // Main flash, up to the end of the address space
+  uint32_t flashSize;
+  uint16_t infoStart;         // Information memory
+  uint32_t infoSize;
+  uint16_t calibrationStart;  // Calibration constants in information memory
+  uint8_t calibrationSize;
+  uint8_t calibration[Device_MaxCalibrationBytes];
+  uint32_t peripherals;       // DevicePeripheral bits
+  uint8_t vectors[DeviceVector_Count]; // Vector number, 0xFFC0 + 2 * N
+} DeviceProfile;
+
+bool device_load_profiles(const char* fileName);
+const DeviceProfile* device_find_profile(const char* name);
+void device_list_profiles();
+void device_describe(const DeviceProfile* const device, char* buffer,
+                     const uint32_t size);
+
+#endif
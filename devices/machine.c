@@ -0,0 +1,172 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Machine assembly +++##########
+//# Creates the CPU, the scheduler and the peripherals of the
+//# selected device profile, and takes them down again. Shared by
+//# the command line emulator and the library, see lib/msp430emu.c.
+//#
+//# machine_run() advances the machine by a fixed quantum of
+//# instructions or cycles, for co-simulation and the "run N"
+//# command. The cycle quantum is an observer event, so the inner
+//# loop only compares the cycle counter with the next event as
+//# it does anyway, and nothing is printed unless a breakpoint
+//# stops the run. A quantum ends on an instruction boundary, at or
+//# just past the requested cycle. An idle loop without a wake-up
+//# source is skipped to the end of the quantum, see idle_loop.c.
+//#############################################
+
+#include "machine.h"
+#include "peripherals/timerA.h"
+#include "peripherals/usci.h"
+#include "peripherals/port1.h"
+#include "peripherals/multiplier.h"
+#include "peripherals/flash.h"
+#include "cpu/interrupts.h"
+
+/**
+ * @brief Power up the CPU and the peripherals of emu->device, the
+ * memory space must be initialized and the firmware loaded
+ */
+void machine_initialize(Emulator* const emu)
+{
+  emu->cpu       = (Cpu *) calloc(1, sizeof(Cpu));
+  emu->scheduler = scheduler_create();
+  initialize_msp_registers(emu);
+  const uint32_t peripherals = emu->device->peripherals;
+  if (peripherals & DevicePeripheral_TimerA)
+    setup_timer_a(emu);
+  if (peripherals & DevicePeripheral_Usci)
+  {
+    setup_usci(emu);
+    emu->cpu->usci->infiniteSpeed = emu->uart_fast;
+  }
+  if (peripherals & DevicePeripheral_Port1)
+    setup_port_1(emu);
+  if (peripherals & DevicePeripheral_Multiplier)
+    setup_multiplier(emu);
+  if (peripherals & DevicePeripheral_Flash)
+    setup_flash(emu);
+}
+
+/**
+ * @brief Release the peripherals, the CPU and the memory space
+ */
+void machine_uninitialize(Emulator* const emu)
+{
+  uninitialize_flash(emu);
+  uninitialize_multiplier(emu);
+  uninitialize_port_1(emu);
+  uninitialize_usci(emu);
+  uninitialize_timer_a(emu);
+  uninitialize_msp_memspace();
+  free(emu->cpu);
+  emu->cpu = NULL;
+  scheduler_destroy(emu->scheduler);
+  emu->scheduler = NULL;
+}
+
+/**
+ * @brief Restart the peripheral models from the register contents, after
+ * the memory or the CPU cycle counter was replaced
+ */
+void machine_resync(Emulator* const emu)
+{
+  timer_a_resync(emu);
+  usci_resync(emu);
+  port_1_resync(emu);
+  multiplier_resync(emu);
+  flash_resync(emu);
+}
+
+static void stop_at_cycle_limit(Emulator* const emu, void* context)
+{
+  (void)context;
+  emu->cpu->running = false;
+  emu->debugger->stop_reason = StopReason_CycleLimit;
+}
+
+/**
+ * @brief Run until the CPU stops, a breakpoint at the starting PC does
+ * not stop the first instruction
+ * @param instructions Stop after this many instructions, 0 for no limit
+ * @param cycles Stop once this many cycles passed, 0 for no limit
+ * @return Why the CPU stopped
+ */
+StopReason machine_run(Emulator* const emu, const uint64_t instructions,
+                       const uint64_t cycles)
+{
+  Cpu* const cpu = emu->cpu;
+  Debugger* const deb = emu->debugger;
+  const uint64_t lastInstruction = instructions != 0 ?
+    cpu->stats.instructions.executed + instructions : UINT64_MAX;
+  const bool breakpoints = deb->num_bps != 0 || deb->num_memory_bps != 0;
+  const uint16_t resumePc = cpu->pc;
+  bool resuming = true;
+
+  if (deb->quit)
+    return deb->stop_reason;
+
+  deb->error = 0;
+  deb->memory_bp_hit = -1;
+  deb->debug_mode = false;
+  deb->stop_reason = StopReason_None;
+  if (cycles != 0)
+  {
+    scheduler_add_observer(emu->scheduler, cpu->cycles + cycles,
+                           stop_at_cycle_limit, NULL);
+    cpu->idleLoop.quantum = true;
+  }
+
+  cpu->running = true;
+  while (cpu->running && !deb->quit)
+  {
+    while (cpu->running && cpu->cycles < scheduler_next_cycle(emu->scheduler))
+    {
+      if (cpu->stats.instructions.executed >= lastInstruction)
+      {
+        cpu->running = false;
+        deb->stop_reason = StopReason_InstructionLimit;
+        break;
+      }
+
+      service_interrupts(emu);
+      if (breakpoints && (!resuming || cpu->pc != resumePc) &&
+          handle_breakpoints(emu))
+        break;
+      resuming = false;
+
+      const LowPowerState lowPower = handle_low_power_mode(emu);
+      if (lowPower == LowPower_Stuck)
+      {
+        cpu->running = false;
+        deb->stop_reason = StopReason_LowPowerStuck;
+        break;
+      }
+      if (lowPower == LowPower_Active)
+        decode(emu, fetch(emu, true), EXECUTE);
+    }
+    scheduler_run_due(emu);
+  }
+
+  scheduler_cancel(emu->scheduler, stop_at_cycle_limit, NULL);
+  cpu->idleLoop.quantum = false;
+  cpu->running = false;
+  deb->debug_mode = true;
+  return deb->stop_reason;
+}
@@ -0,0 +1,31 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+#include "../main.h"
+#include "../debugger/debugger.h"
+
+void machine_initialize(Emulator* const emu);
+void machine_uninitialize(Emulator* const emu);
+void machine_resync(Emulator* const emu);
+StopReason machine_run(Emulator* const emu, const uint64_t instructions,
+                       const uint64_t cycles);
+
+#endif
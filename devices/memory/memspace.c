@@ -30,6 +30,51 @@ uint8_t* PER16;      /* 16-bit peripherals */
 uint8_t* PER8;       /* 8-bit peripherals */
 uint8_t* SFRS;       /* Special Function Registers */
 
+/* Pages whose memory or flags changed since the last memory_clear_dirty(),
+   one extra entry for word accesses at the very end of the address space */
+static uint8_t MEMSPACE_DIRTY[MEMORY_PAGE_COUNT + 1];
+
+/* Counts memory writes and peripheral register reads, any change means
+   memory may read differently than before */
+static uint64_t memory_epoch = 0;
+
+static MemoryWriteHook write_hook = NULL;
+static void* write_hook_context = NULL;
+
+/* Peripheral registers. sync runs before every read or write of the
+   region, so the device can bring lazily computed registers up to date,
+   write runs after a write with the new value already in MEMSPACE. */
+typedef struct MemoryIoRegion {
+  uint32_t start;
+  uint32_t end;
+  MemoryIoHandler sync;
+  MemoryIoHandler write;
+  void* context;
+} MemoryIoRegion;
+
+static MemoryIoRegion io_regions[Memory_MaxIoRegions];
+static uint8_t num_io_regions = 0;
+
+/* Number of IO regions overlapping each page, one extra entry for word
+   accesses at the very end of the address space */
+static uint8_t MEMSPACE_IO_PAGES[MEMORY_PAGE_COUNT + 1];
+
+/* Memory only a controller may change, like flash. The filter runs before
+   a write with the old value still in place, it may change the value to
+   store or drop the write. Reads are not affected. */
+typedef struct MemoryProtectedRegion {
+  uint32_t start;
+  uint32_t end;
+  MemoryWriteFilter filter;
+  void* context;
+} MemoryProtectedRegion;
+
+static MemoryProtectedRegion protected_regions[Memory_MaxProtectedRegions];
+static uint8_t num_protected_regions = 0;
+
+/* Number of protected regions containing each page */
+static uint8_t MEMSPACE_PROTECTED_PAGES[MEMORY_PAGE_COUNT + 1];
+
 static int32_t getEffectiveAddressIndex(void* const offset)
 {
   const intptr_t offsetIndex = (intptr_t)offset;
@@ -45,73 +90,102 @@ static int32_t getEffectiveAddressIndex(void* const offset)
 /* Initialize Address Space Locations
 **
 ** Allocate and set MSP430 Memory space
-** Some of these locations vary by model
+** The layout and calibration data come from the device profile
 */
-void initialize_msp_memspace()
+void initialize_msp_memspace(const DeviceProfile* const device)
 {
-  // MSP430g2553 Device Specific ...
-  // 16 KB / 64 KB Addressable Space
+  // 64 KB Addressable Space
   MEMSPACE = (uint8_t *) calloc(1, ADDRESS_SPACE_SIZE);
   MEMSPACE_FLAGS = (uint8_t *) calloc(1, ADDRESS_SPACE_SIZE);
   memset(MEMSPACE_FLAGS, 0x00, ADDRESS_SPACE_SIZE);
+  memory_mark_dirty(0, ADDRESS_SPACE_SIZE);
 
   // (lower bounds, so increment upwards)
 
-  // Info memory from 0x10FF - 0x1000 (256 Bytes)
-  INFO = MEMSPACE + 0x1000;
-  // Set it all to 0xFF by default...
-  memset(INFO, 0xFF, 256);
+  // Info memory, erased flash by default
+  INFO = MEMSPACE + device->infoStart;
+  memset(INFO, 0xFF, device->infoSize);
 
-  // Code Memory 0xFFFF - 0xC000;
-  CODE = MEMSPACE + 0xC000;
-  // Set it all to 0xFF by default...
-  memset(CODE, 0xFF, 16384);
+  // Code Memory up to 0xFFFF, erased flash by default
+  CODE = MEMSPACE + device->flashStart;
+  memset(CODE, 0xFF, device->flashSize);
 
   // Interrupt Vector Table 0xFFFF - 0xFFC0
   IVT = MEMSPACE + 0xFFC0;
 
-  // ROM // 0x400 - 0x1FFFF
-  ROM = MEMSPACE + 0x0400;
+  // Flash/ROM, the code memory
+  ROM = CODE;
 
-  // RAM from 0x3FF - 0x200
-  RAM = MEMSPACE + 0x0200;   // 0x200 - 0x3FF
+  RAM = MEMSPACE + device->ramStart;
   PER16 = MEMSPACE + 0x0100;   // 0x0100 - 0x01FF
   PER8 = MEMSPACE + 0x0010;   // 0x0010 - 0x00FF
   SFRS = MEMSPACE + 0x0;      // 0x0 - 0x0F
 
   // Setup the calibration data in info memory
+  memcpy(MEMSPACE + device->calibrationStart, device->calibration,
+         device->calibrationSize);
+}
 
-  const uint16_t CALDCO_16MHZ_VLOC = 0x10F8;
-  *((uint8_t *) (MEMSPACE + CALDCO_16MHZ_VLOC)) = 0x95;
-
-  const uint16_t CALBC1_16MHZ_VLOC = 0x10F9;
-  *((uint8_t *) (MEMSPACE + CALBC1_16MHZ_VLOC)) = 0x8F;
-
-  const uint16_t CALDCO_12MHZ_VLOC = 0x10FA;
-  *((uint8_t *) (MEMSPACE + CALDCO_12MHZ_VLOC)) = 0x9E;
 
-  const uint16_t CALBC1_12MHZ_VLOC = 0x10FB;
-  *((uint8_t *) (MEMSPACE + CALBC1_12MHZ_VLOC)) = 0x8E;
+static void io_access(const int32_t index, const uint8_t size,
+                      const bool written)
+{
+  memory_epoch++;
+  for (uint8_t i = 0; i < num_io_regions; i++)
+  {
+    const MemoryIoRegion* const region = &io_regions[i];
+    if ((uint32_t)index + size <= region->start || (uint32_t)index >= region->end)
+      continue;
 
-  const uint16_t CALDCO_8MHZ_VLOC = 0x10FC;
-  *((uint8_t *) (MEMSPACE + CALDCO_8MHZ_VLOC)) = 0x92;
+    const MemoryIoHandler handler = written ? region->write : region->sync;
+    if (handler != NULL)
+      handler(region->context, (uint16_t)index, size);
+  }
+}
 
-  const uint16_t CALBC1_8MHZ_VLOC = 0x10FD;
-  *((uint8_t *) (MEMSPACE + CALBC1_8MHZ_VLOC)) = 0x8D;
+static inline bool is_io_page(const int32_t index)
+{
+  return MEMSPACE_IO_PAGES[index / MEMORY_PAGE_SIZE] != 0;
+}
 
-  const uint16_t CALDCO_1MHZ_VLOC = 0x10FE;
-  *((uint8_t *) (MEMSPACE + CALDCO_1MHZ_VLOC)) = 0xD1;
+static inline bool is_protected_page(const int32_t index)
+{
+  return MEMSPACE_PROTECTED_PAGES[index / MEMORY_PAGE_SIZE] != 0;
+}
 
-  const uint16_t CALBC1_1MHZ_VLOC = 0x10FF;
-  *((uint8_t *) (MEMSPACE + CALBC1_1MHZ_VLOC)) = 0x86;
+/**
+ * @return false if a filter dropped the write
+ */
+static bool filter_write(const int32_t index, const uint8_t size,
+                         uint16_t* const value)
+{
+  for (uint8_t i = 0; i < num_protected_regions; i++)
+  {
+    const MemoryProtectedRegion* const region = &protected_regions[i];
+    if ((uint32_t)index >= region->start && (uint32_t)index < region->end)
+      return region->filter(region->context, (uint16_t)index, size, value);
+  }
+  return true;
 }
 
+static inline void mark_read(const int32_t index)
+{
+  if (!(MEMSPACE_FLAGS[index] & (uint8_t)MemoryCell_Flag_Read))
+  {
+    MEMSPACE_FLAGS[index] |= (uint8_t)MemoryCell_Flag_Read;
+    MEMSPACE_DIRTY[index / MEMORY_PAGE_SIZE] = 1;
+  }
+}
 
 uint8_t memory_read_byte(void* const address)
 {
   const int32_t index = getEffectiveAddressIndex(address);
   if (index >= 0)
-    MEMSPACE_FLAGS[index] |= (uint8_t)MemoryCell_Flag_Read;
+  {
+    if (is_io_page(index))
+      io_access(index, 1, false);
+    mark_read(index);
+  }
   return *(uint8_t*)address;
 }
 
@@ -120,8 +194,10 @@ uint16_t memory_read_word(void* const address)
   const int32_t index = getEffectiveAddressIndex(address);
   if (index >= 0)
    {
-      MEMSPACE_FLAGS[index] |= (uint8_t)MemoryCell_Flag_Read;
-      MEMSPACE_FLAGS[index + 1] |= (uint8_t)MemoryCell_Flag_Read;
+      if (is_io_page(index))
+        io_access(index, 2, false);
+      mark_read(index);
+      mark_read(index + 1);
    }
   return *(uint16_t*)address;
 }
@@ -129,20 +205,47 @@ uint16_t memory_read_word(void* const address)
 void memory_write_byte(void* const address, const uint8_t x)
 {
   const int32_t index = getEffectiveAddressIndex(address);
+  const bool io = index >= 0 && is_io_page(index);
+  uint16_t value = x;
+  if (index >= 0 && is_protected_page(index) && !filter_write(index, 1, &value))
+    return;
   if (index >= 0)
+  {
+    if (io)
+      io_access(index, 1, false);
+    if (write_hook != NULL)
+      write_hook(write_hook_context, (uint16_t)index, 1);
+    memory_epoch++;
     MEMSPACE_FLAGS[index] |= (uint8_t)MemoryCell_Flag_Written;
-  (*(uint8_t*)address) = x;
+    MEMSPACE_DIRTY[index / MEMORY_PAGE_SIZE] = 1;
+  }
+  (*(uint8_t*)address) = (uint8_t)value;
+  if (io)
+    io_access(index, 1, true);
 }
 
 void memory_write_word(void* const address, const uint16_t x)
 {
   const int32_t index = getEffectiveAddressIndex(address);
+  const bool io = index >= 0 && is_io_page(index);
+  uint16_t value = x;
+  if (index >= 0 && is_protected_page(index) && !filter_write(index, 2, &value))
+    return;
   if (index >= 0)
   {
+    if (io)
+      io_access(index, 2, false);
+    if (write_hook != NULL)
+      write_hook(write_hook_context, (uint16_t)index, 2);
+    memory_epoch++;
     MEMSPACE_FLAGS[index] |= (uint8_t)MemoryCell_Flag_Written;
     MEMSPACE_FLAGS[index + 1] |= (uint8_t)MemoryCell_Flag_Written;
+    MEMSPACE_DIRTY[index / MEMORY_PAGE_SIZE] = 1;
+    MEMSPACE_DIRTY[(index + 1) / MEMORY_PAGE_SIZE] = 1;
   }
-  (*(uint16_t*)address) = x;
+  (*(uint16_t*)address) = value;
+  if (io)
+    io_access(index, 2, true);
 }
 
 uint8_t memory_get_flags(void* const address)
@@ -165,7 +268,166 @@ void memory_clear_flags(void* const address)
 {
   const int32_t index = getEffectiveAddressIndex(address);
   if (index >= 0)
+  {
     MEMSPACE_FLAGS[index] = 0;
+    MEMSPACE_DIRTY[index / MEMORY_PAGE_SIZE] = 1;
+  }
+}
+
+/*
+** Dirty page tracking, used by snapshots to copy only modified pages
+*/
+const uint8_t* memory_get_dirty_pages()
+{
+  return MEMSPACE_DIRTY;
+}
+
+void memory_mark_dirty(const uint16_t virt_addr, const uint32_t size)
+{
+  if (size == 0)
+    return;
+
+  memory_epoch++;
+  uint32_t last = (uint32_t)virt_addr + size - 1;
+  if (last >= ADDRESS_SPACE_SIZE)
+    last = ADDRESS_SPACE_SIZE - 1;
+
+  for (uint32_t page = virt_addr / MEMORY_PAGE_SIZE;
+       page <= last / MEMORY_PAGE_SIZE; page++)
+    MEMSPACE_DIRTY[page] = 1;
+}
+
+void memory_clear_dirty()
+{
+  memset(MEMSPACE_DIRTY, 0, sizeof MEMSPACE_DIRTY);
+}
+
+uint64_t memory_get_epoch()
+{
+  return memory_epoch;
+}
+
+void memory_set_write_hook(MemoryWriteHook hook, void* context)
+{
+  write_hook = hook;
+  write_hook_context = context;
+}
+
+/**
+ * @brief Report a range about to be overwritten outside of the write
+ * functions, with memset, memcpy or a peripheral model, to the write hook
+ * and mark it dirty
+ */
+void memory_hook_range(const uint16_t virt_addr, const uint32_t size)
+{
+  uint32_t address = virt_addr;
+  uint32_t last = (uint32_t)virt_addr + size;
+
+  memory_mark_dirty(virt_addr, size);
+  if (write_hook == NULL)
+    return;
+  if (last > ADDRESS_SPACE_SIZE)
+    last = ADDRESS_SPACE_SIZE;
+  for (; address + 1 < last; address += 2)
+    write_hook(write_hook_context, (uint16_t)address, 2);
+  if (address < last)
+    write_hook(write_hook_context, (uint16_t)address, 1);
+}
+
+/**
+ * @brief Route accesses to a range of addresses to a peripheral model
+ * @param sync Called before reads and writes, may be NULL
+ * @param write Called after writes, may be NULL
+ * @return false if all IO regions are in use
+ */
+bool memory_map_io(const uint16_t virt_addr, const uint16_t size,
+                   MemoryIoHandler sync, MemoryIoHandler write, void* context)
+{
+  if (num_io_regions >= Memory_MaxIoRegions || size == 0)
+    return false;
+
+  MemoryIoRegion* const region = &io_regions[num_io_regions++];
+  region->start = virt_addr;
+  region->end = (uint32_t)virt_addr + size;
+  region->sync = sync;
+  region->write = write;
+  region->context = context;
+
+  // A word access may start in the page before the region
+  const uint32_t first = virt_addr > 0 ? (virt_addr - 1u) / MEMORY_PAGE_SIZE : 0;
+  for (uint32_t page = first; page <= (region->end - 1) / MEMORY_PAGE_SIZE; page++)
+    MEMSPACE_IO_PAGES[page]++;
+  return true;
+}
+
+/**
+ * @brief Remove all IO regions of a peripheral model
+ */
+void memory_unmap_io(void* context)
+{
+  uint8_t i = 0;
+
+  while (i < num_io_regions)
+  {
+    const MemoryIoRegion region = io_regions[i];
+    if (region.context != context)
+    {
+      i++;
+      continue;
+    }
+
+    const uint32_t first = region.start > 0 ? (region.start - 1) / MEMORY_PAGE_SIZE : 0;
+    for (uint32_t page = first; page <= (region.end - 1) / MEMORY_PAGE_SIZE; page++)
+      MEMSPACE_IO_PAGES[page]--;
+    io_regions[i] = io_regions[--num_io_regions];
+  }
+}
+
+/**
+ * @brief Route writes to a range through a filter, for memory that only
+ * changes under the control of a peripheral. Regions must not overlap.
+ * @return false if all protected regions are in use
+ */
+bool memory_protect(const uint16_t virt_addr, const uint32_t size,
+                    MemoryWriteFilter filter, void* context)
+{
+  if (num_protected_regions >= Memory_MaxProtectedRegions || size == 0 ||
+      (uint32_t)virt_addr + size > ADDRESS_SPACE_SIZE)
+    return false;
+
+  MemoryProtectedRegion* const region = &protected_regions[num_protected_regions++];
+  region->start = virt_addr;
+  region->end = (uint32_t)virt_addr + size;
+  region->filter = filter;
+  region->context = context;
+
+  for (uint32_t page = virt_addr / MEMORY_PAGE_SIZE;
+       page <= (region->end - 1) / MEMORY_PAGE_SIZE; page++)
+    MEMSPACE_PROTECTED_PAGES[page]++;
+  return true;
+}
+
+/**
+ * @brief Remove all protected regions of a peripheral model
+ */
+void memory_unprotect(void* context)
+{
+  uint8_t i = 0;
+
+  while (i < num_protected_regions)
+  {
+    const MemoryProtectedRegion region = protected_regions[i];
+    if (region.context != context)
+    {
+      i++;
+      continue;
+    }
+
+    for (uint32_t page = region.start / MEMORY_PAGE_SIZE;
+         page <= (region.end - 1) / MEMORY_PAGE_SIZE; page++)
+      MEMSPACE_PROTECTED_PAGES[page]--;
+    protected_regions[i] = protected_regions[--num_protected_regions];
+  }
 }
 
 /*
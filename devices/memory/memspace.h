@@ -23,15 +23,34 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
+#include "../device.h"
 
 #define ADDRESS_SPACE_SIZE 0x10000
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_PAGE_COUNT (ADDRESS_SPACE_SIZE / MEMORY_PAGE_SIZE)
 
 typedef enum {
   MemoryCell_Flag_Written = 1,
   MemoryCell_Flag_Read = 2
 } MemoryCell_Flag;
 
-void initialize_msp_memspace();
+/* Called before a write to MEMSPACE, while the old value is still in place */
+typedef void (*MemoryWriteHook)(void* context, const uint16_t virt_addr,
+                                const uint8_t size);
+
+/* Memory mapped peripheral register handlers, see memory_map_io() */
+typedef void (*MemoryIoHandler)(void* context, const uint16_t virt_addr,
+                                const uint8_t size);
+
+/* Decides what a write to a protected range stores, see memory_protect() */
+typedef bool (*MemoryWriteFilter)(void* context, const uint16_t virt_addr,
+                                  const uint8_t size, uint16_t* const value);
+
+enum { Memory_MaxIoRegions = 16 };
+enum { Memory_MaxProtectedRegions = 4 };
+
+void initialize_msp_memspace(const DeviceProfile* const device);
 void uninitialize_msp_memspace();
 
 uint8_t memory_read_byte(void* const address);
@@ -44,4 +63,21 @@ uint8_t memory_get_flags(void* const address);
 uint8_t memory_get_flags_of_virtual_address(void* const address);
 void memory_clear_flags(void* const address);
 
+const uint8_t* memory_get_dirty_pages();
+void memory_mark_dirty(const uint16_t virt_addr, const uint32_t size);
+void memory_clear_dirty();
+
+void memory_set_write_hook(MemoryWriteHook hook, void* context);
+void memory_hook_range(const uint16_t virt_addr, const uint32_t size);
+
+uint64_t memory_get_epoch();
+
+bool memory_map_io(const uint16_t virt_addr, const uint16_t size,
+                   MemoryIoHandler sync, MemoryIoHandler write, void* context);
+void memory_unmap_io(void* context);
+
+bool memory_protect(const uint16_t virt_addr, const uint32_t size,
+                    MemoryWriteFilter filter, void* context);
+void memory_unprotect(void* context);
+
 #endif
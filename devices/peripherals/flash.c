@@ -0,0 +1,303 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Flash memory controller +++##########
+//# Main and information memory are protected: the CPU changes
+//# them only through the controller. With LOCK set, while an
+//# operation runs or without an operation selected in FCTL1 a
+//# write is dropped and sets ACCVIFG. A write in erase mode is
+//# the dummy write starting a segment or mass erase, a write in
+//# write mode programs the word, which like real flash can only
+//# clear bits. Information segment A also needs LOCKA cleared.
+//#
+//# An operation is not simulated step by step. Its end is
+//# computed from the flash timing generator clock (FCTL2) and
+//# BUSY and WAIT are derived from it when FCTL3 is read. Code
+//# running from flash is held until the operation ended, as on
+//# the device, by advancing the cycle counter. A key violation
+//# sets KEYV and ignores the write instead of resetting the part.
+//##################################################
+
+#include "flash.h"
+#include "../cpu/interrupts.h"
+#include "../../debugger/io.h"
+
+extern uint8_t* MEMSPACE;
+
+enum { Flash_ACCVIE = 0x20 }; // IE1 bit enabling the access violation NMI
+enum { Flash_WritableBits = Flash_FAIL | Flash_EMEX | Flash_LOCK |
+       Flash_ACCVIFG | Flash_KEYV };
+
+static inline uint16_t* flash_reg(const uint16_t address)
+{
+  return (uint16_t*)(MEMSPACE + address);
+}
+
+static bool is_busy(const FlashController* const flash)
+{
+  return flash->emu->cpu->cycles < flash->busyUntil;
+}
+
+/**
+ * @brief Complete an erase which ended, then show the registers with the
+ * read password, BUSY and WAIT as of now
+ */
+static void sync_registers(void* context, const uint16_t virt_addr,
+                           const uint8_t size)
+{
+  FlashController* const flash = (FlashController*)context;
+  const bool busy = is_busy(flash);
+
+  if (flash->erasing && !busy)
+  {
+    flash->registers[0] &= (uint16_t)~(Flash_ERASE | Flash_MERAS);
+    flash->erasing = false;
+  }
+
+  *flash_reg(FCTL1) = Flash_ReadPassword | flash->registers[0];
+  *flash_reg(FCTL2) = Flash_ReadPassword | flash->registers[1];
+  *flash_reg(FCTL3) = Flash_ReadPassword | flash->registers[2] |
+    (busy ? Flash_BUSY : Flash_WAIT);
+}
+
+static void report_violation(FlashController* const flash, const uint16_t flag)
+{
+  flash->registers[2] |= flag;
+  flash->violations++;
+  if (flag == Flash_ACCVIFG && (*(MEMSPACE + 0x0000) & Flash_ACCVIE))
+    interrupt_request(flash->emu, Interrupt_Nmi);
+}
+
+static void write_registers(void* context, const uint16_t virt_addr,
+                            const uint8_t size)
+{
+  FlashController* const flash = (FlashController*)context;
+  const uint16_t reg = virt_addr & ~1u;
+  const uint16_t value = *flash_reg(reg);
+
+  if (size != 2 || (virt_addr & 1) || (value & 0xFF00) != Flash_Password)
+  {
+    report_violation(flash, Flash_KEYV);
+  }
+  else if (reg == FCTL1)
+  {
+    if (is_busy(flash))
+      report_violation(flash, Flash_ACCVIFG);
+    else
+    {
+      flash->registers[0] = value & 0x00FF;
+      flash->erasing = false;
+      if (!(value & Flash_BLKWRT))
+        flash->blockStarted = false;
+    }
+  }
+  else if (reg == FCTL2)
+  {
+    flash->registers[1] = value & 0x00FF;
+  }
+  else
+  {
+    // LOCKA toggles when written with 1
+    const uint16_t locka = (flash->registers[2] ^ value) & Flash_LOCKA;
+    flash->registers[2] = (value & Flash_WritableBits) | locka;
+    if (value & Flash_EMEX)
+      flash->busyUntil = flash->emu->cpu->cycles;
+  }
+
+  sync_registers(flash, virt_addr, size);
+}
+
+/**
+ * @brief Start an operation of the given number of flash timing generator
+ * cycles, holding the CPU if it runs from flash
+ */
+static void start_operation(FlashController* const flash, const uint32_t ftgCycles)
+{
+  Cpu* const cpu = flash->emu->cpu;
+  const DeviceProfile* const device = flash->emu->device;
+  const uint16_t fctl2 = flash->registers[1];
+  const uint64_t cyclesPerTick =
+    ((fctl2 & Flash_FSSEL) == 0 ? Clock_AclkCycles : 1) *
+    (uint64_t)((fctl2 & Flash_FN) + 1);
+  const bool fromInfo = cpu->pc >= device->infoStart &&
+    cpu->pc < device->infoStart + device->infoSize;
+
+  flash->busyUntil = cpu->cycles + ftgCycles * cyclesPerTick;
+  if (cpu->pc >= device->flashStart || fromInfo)
+    cpu->cycles = flash->busyUntil;
+}
+
+static bool is_info_address(const DeviceProfile* const device,
+                            const uint16_t virt_addr)
+{
+  return virt_addr >= device->infoStart &&
+    virt_addr < device->infoStart + device->infoSize;
+}
+
+static bool is_segment_a(const DeviceProfile* const device,
+                         const uint16_t virt_addr)
+{
+  return is_info_address(device, virt_addr) &&
+    virt_addr >= device->infoStart + device->infoSize - Flash_InfoSegmentSize;
+}
+
+static void erase_range(const uint32_t start, const uint32_t size)
+{
+  memory_hook_range((uint16_t)start, size);
+  memset(MEMSPACE + start, 0xFF, size);
+  memory_mark_dirty((uint16_t)start, size);
+}
+
+static void erase(FlashController* const flash, const uint16_t virt_addr)
+{
+  const DeviceProfile* const device = flash->emu->device;
+  const uint16_t fctl1 = flash->registers[0];
+
+  if (fctl1 & Flash_MERAS)
+  {
+    erase_range(device->flashStart, device->flashSize);
+    if (fctl1 & Flash_ERASE)
+    {
+      const bool keepA = (flash->registers[2] & Flash_LOCKA) != 0;
+      erase_range(device->infoStart,
+                  device->infoSize - (keepA ? Flash_InfoSegmentSize : 0));
+    }
+    start_operation(flash, Flash_MassEraseTime);
+  }
+  else
+  {
+    const uint32_t segmentSize = is_info_address(device, virt_addr) ?
+      Flash_InfoSegmentSize : Flash_MainSegmentSize;
+    erase_range(virt_addr & ~(segmentSize - 1), segmentSize);
+    start_operation(flash, Flash_SegmentEraseTime);
+  }
+
+  flash->erasing = true;
+  flash->erases++;
+}
+
+/**
+ * @brief Write filter of the flash memory, see memory_protect()
+ */
+static bool write_flash(void* context, const uint16_t virt_addr,
+                        const uint8_t size, uint16_t* const value)
+{
+  FlashController* const flash = (FlashController*)context;
+  const DeviceProfile* const device = flash->emu->device;
+  const uint16_t fctl1 = flash->registers[0];
+
+  sync_registers(flash, virt_addr, size);
+  if (is_busy(flash) || (flash->registers[2] & Flash_LOCK) ||
+      !(fctl1 & (Flash_ERASE | Flash_MERAS | Flash_WRT)) ||
+      (is_segment_a(device, virt_addr) && (flash->registers[2] & Flash_LOCKA)))
+  {
+    report_violation(flash, Flash_ACCVIFG);
+    sync_registers(flash, virt_addr, size);
+    return false;
+  }
+
+  if (fctl1 & (Flash_ERASE | Flash_MERAS))
+  {
+    erase(flash, virt_addr);
+    sync_registers(flash, virt_addr, size);
+    return false;
+  }
+
+  // Programming only turns ones into zeros
+  if (size == 1)
+    *value &= MEMSPACE[virt_addr];
+  else
+    *value &= *flash_reg(virt_addr);
+
+  if (fctl1 & Flash_BLKWRT)
+  {
+    start_operation(flash, flash->blockStarted ?
+                    Flash_BlockWriteNextTime : Flash_BlockWriteFirstTime);
+    flash->blockStarted = true;
+  }
+  else
+  {
+    start_operation(flash, Flash_WordWriteTime);
+  }
+  flash->words++;
+  sync_registers(flash, virt_addr, size);
+  return true;
+}
+
+void setup_flash(Emulator* const emu)
+{
+  const DeviceProfile* const device = emu->device;
+  FlashController* const flash =
+    (FlashController*) calloc(1, sizeof(FlashController));
+
+  flash->emu = emu;
+  flash->registers[1] = 0x0042;
+  flash->registers[2] = Flash_LOCK | Flash_LOCKA;
+  emu->cpu->flash = flash;
+  sync_registers(flash, FCTL1, Flash_RegisterBytes);
+
+  memory_map_io(FCTL1, Flash_RegisterBytes, sync_registers, write_registers, flash);
+  memory_protect(device->flashStart, device->flashSize, write_flash, flash);
+  memory_protect(device->infoStart, device->infoSize, write_flash, flash);
+}
+
+void uninitialize_flash(Emulator* const emu)
+{
+  FlashController* const flash = emu->cpu->flash;
+
+  if (flash == NULL)
+    return;
+  memory_unmap_io(flash);
+  memory_unprotect(flash);
+  free(flash);
+  emu->cpu->flash = NULL;
+}
+
+/**
+ * @brief Take the registers from memory after the machine state was replaced
+ * by a snapshot. A running operation is considered complete.
+ */
+void flash_resync(Emulator* const emu)
+{
+  FlashController* const flash = emu->cpu->flash;
+
+  if (flash == NULL)
+    return;
+  flash->registers[0] = *flash_reg(FCTL1) & 0x00FF;
+  flash->registers[1] = *flash_reg(FCTL2) & 0x00FF;
+  flash->registers[2] = *flash_reg(FCTL3) & (Flash_WritableBits | Flash_LOCKA);
+  flash->busyUntil = 0;
+  flash->erasing = false;
+  flash->blockStarted = false;
+  sync_registers(flash, FCTL1, Flash_RegisterBytes);
+}
+
+void display_flash(Emulator* const emu)
+{
+  FlashController* const flash = emu->cpu->flash;
+  char buffer[256];
+
+  sync_registers(flash, FCTL1, Flash_RegisterBytes);
+  sprintf(buffer, "FCTL1 %04X  FCTL2 %04X  FCTL3 %04X%s\n"
+          "  %llu writes, %llu erases, %llu violations\n",
+          *flash_reg(FCTL1), *flash_reg(FCTL2), *flash_reg(FCTL3),
+          is_busy(flash) ? "  busy" : "",
+          (unsigned long long)flash->words, (unsigned long long)flash->erases,
+          (unsigned long long)flash->violations);
+  print_console(emu, buffer);
+}
@@ -0,0 +1,86 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FLASH_H_
+#define _FLASH_H_
+
+#include "../../main.h"
+
+// Flash memory controller registers //
+#define FCTL1 0x0128
+#define FCTL2 0x012A
+#define FCTL3 0x012C
+
+enum { Flash_RegisterBytes = 6 };
+enum { Flash_MainSegmentSize = 512 };
+enum { Flash_InfoSegmentSize = 64 };
+enum { Flash_Password = 0xA500 };     // Written in the upper byte
+enum { Flash_ReadPassword = 0x9600 }; // Read back in the upper byte
+
+// Durations in flash timing generator (fFTG) cycles //
+enum {
+  Flash_WordWriteTime = 30,
+  Flash_BlockWriteFirstTime = 25,
+  Flash_BlockWriteNextTime = 18,
+  Flash_SegmentEraseTime = 4819,
+  Flash_MassEraseTime = 10593,
+};
+
+// FCTL1 bits //
+enum {
+  Flash_BLKWRT = 0x80,
+  Flash_WRT = 0x40,
+  Flash_MERAS = 0x04,
+  Flash_ERASE = 0x02,
+};
+
+// FCTL2 bits //
+enum {
+  Flash_FSSEL = 0xC0,
+  Flash_FN = 0x3F,
+};
+
+// FCTL3 bits //
+enum {
+  Flash_FAIL = 0x80,
+  Flash_LOCKA = 0x40,
+  Flash_EMEX = 0x20,
+  Flash_LOCK = 0x10,
+  Flash_WAIT = 0x08,
+  Flash_ACCVIFG = 0x04,
+  Flash_KEYV = 0x02,
+  Flash_BUSY = 0x01,
+};
+
+struct FlashController {
+  Emulator* emu;
+  uint16_t registers[3]; // FCTL1-3 without the password byte
+  uint64_t busyUntil;    // CPU cycle at which the running operation ends
+  bool erasing;          // ERASE/MERAS are reset when the erase completes
+  bool blockStarted;     // A block write has programmed its first word
+  uint64_t words;        // Programmed bytes and words
+  uint64_t erases;       // Segment and mass erases
+  uint64_t violations;   // Accesses which set ACCVIFG
+};
+
+void setup_flash(Emulator* const emu);
+void uninitialize_flash(Emulator* const emu);
+void flash_resync(Emulator* const emu);
+void display_flash(Emulator* const emu);
+
+#endif
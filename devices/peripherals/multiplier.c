@@ -0,0 +1,126 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ MPY16 Hardware Multiplier +++##########
+//# Writing one of the OP1 registers selects the operation and
+//# writing OP2 computes the result with one host multiplication,
+//# available immediately instead of after the hardware's three
+//# cycles. The OP1 registers share one operand, reading any of
+//# them returns it. Byte writes clear the upper operand byte.
+//#####################################################
+
+#include "multiplier.h"
+
+extern uint8_t* MEMSPACE;
+
+static inline uint16_t* mpy_reg(const uint16_t address)
+{
+  return (uint16_t*)(MEMSPACE + address);
+}
+
+static void multiply(Multiplier* const mpy)
+{
+  const uint16_t op1 = *mpy_reg(MPY);
+  const uint16_t op2 = *mpy_reg(OP2);
+  const uint32_t accumulator = ((uint32_t)*mpy_reg(RESHI) << 16) | *mpy_reg(RESLO);
+  uint32_t result;
+
+  switch (mpy->mode)
+  {
+    case Multiplier_Mpy:
+      result = (uint32_t)op1 * op2;
+      mpy->sumext = 0;
+      break;
+    case Multiplier_Mpys:
+      result = (uint32_t)((int32_t)(int16_t)op1 * (int16_t)op2);
+      mpy->sumext = (result & 0x80000000) ? 0xFFFF : 0;
+      break;
+    case Multiplier_Mac:
+    {
+      const uint64_t sum = (uint64_t)accumulator + (uint32_t)op1 * op2;
+      result = (uint32_t)sum;
+      mpy->sumext = (uint16_t)(sum >> 32);
+      break;
+    }
+    default:
+      result = accumulator + (uint32_t)((int32_t)(int16_t)op1 * (int16_t)op2);
+      mpy->sumext = (result & 0x80000000) ? 0xFFFF : 0;
+      break;
+  }
+
+  *mpy_reg(RESLO) = (uint16_t)result;
+  *mpy_reg(RESHI) = (uint16_t)(result >> 16);
+}
+
+static void write_registers(void* context, const uint16_t virt_addr,
+                            const uint8_t size)
+{
+  Multiplier* const mpy = (Multiplier*)context;
+  const uint16_t reg = virt_addr & ~1u;
+
+  if (size == 1 && !(virt_addr & 1))
+    *mpy_reg(reg) &= 0x00FF;
+
+  if (reg <= MACS)
+  {
+    const uint16_t op1 = *mpy_reg(reg);
+    mpy->mode = (MultiplierMode)((reg - MPY) / 2);
+    for (uint16_t address = MPY; address <= MACS; address += 2)
+      *mpy_reg(address) = op1;
+  }
+  else if (reg == OP2)
+  {
+    multiply(mpy);
+  }
+
+  *mpy_reg(SUMEXT) = mpy->sumext;
+}
+
+void setup_multiplier(Emulator* const emu)
+{
+  Multiplier* const mpy = (Multiplier*) calloc(1, sizeof(Multiplier));
+
+  mpy->emu = emu;
+  emu->cpu->mpy = mpy;
+
+  memset(mpy_reg(MPY), 0, Multiplier_RegisterBytes);
+  memory_map_io(MPY, Multiplier_RegisterBytes, NULL, write_registers, mpy);
+}
+
+void uninitialize_multiplier(Emulator* const emu)
+{
+  Multiplier* const mpy = emu->cpu->mpy;
+
+  if (mpy == NULL)
+    return;
+  memory_unmap_io(mpy);
+  free(mpy);
+  emu->cpu->mpy = NULL;
+}
+
+/**
+ * @brief Take SUMEXT from memory after the machine state was replaced by a
+ * snapshot. The operation mode is not part of the registers and is kept.
+ */
+void multiplier_resync(Emulator* const emu)
+{
+  Multiplier* const mpy = emu->cpu->mpy;
+
+  if (mpy != NULL)
+    mpy->sumext = *mpy_reg(SUMEXT);
+}
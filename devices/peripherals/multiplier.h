@@ -0,0 +1,54 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MULTIPLIER_H_
+#define _MULTIPLIER_H_
+
+#include "../../main.h"
+
+// 16x16 hardware multiplier registers //
+#define MPY    0x0130
+#define MPYS   0x0132
+#define MAC    0x0134
+#define MACS   0x0136
+#define OP2    0x0138
+#define RESLO  0x013A
+#define RESHI  0x013C
+#define SUMEXT 0x013E
+
+enum { Multiplier_RegisterBytes = 16 };
+
+// Operation selected by the OP1 register written last //
+typedef enum {
+  Multiplier_Mpy,   // Unsigned multiply
+  Multiplier_Mpys,  // Signed multiply
+  Multiplier_Mac,   // Unsigned multiply and accumulate
+  Multiplier_Macs,  // Signed multiply and accumulate
+} MultiplierMode;
+
+struct Multiplier {
+  Emulator* emu;
+  MultiplierMode mode;
+  uint16_t sumext;  // SUMEXT is read only, restored after writes
+};
+
+void setup_multiplier(Emulator* const emu);
+void uninitialize_multiplier(Emulator* const emu);
+void multiplier_resync(Emulator* const emu);
+
+#endif
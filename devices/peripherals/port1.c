@@ -0,0 +1,307 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Digital I/O Port 1 +++##########
+//# P1IN is kept up to date when the pin levels change, so reads
+//# need no handler. A pin configured as output takes its level
+//# from P1OUT, an input pin the level driven by the host. Every
+//# change of the levels is appended to the change log as a fixed
+//# size PortEvent record, buffered and written in large blocks,
+//# and sets the P1IFG bits of the edges selected by P1IES.
+//#
+//# Host input transitions are read from a stimulus file in the
+//# same record format, so a log recorded from one firmware can be
+//# replayed into another. Each record drives the input pins to
+//# its new levels at its cycle. Pull resistors (P1REN) and the
+//# secondary functions (P1SEL) are not modeled.
+//##############################################
+
+#include "port1.h"
+#include "../cpu/interrupts.h"
+#include "../../debugger/io.h"
+
+extern uint8_t* MEMSPACE;
+
+static inline uint8_t* port_reg(const uint16_t address)
+{
+  return MEMSPACE + address;
+}
+
+/**
+ * @brief Store a register value set by the model, seen by the undo journal
+ * and by snapshot restores through the dirty pages
+ */
+static void set_reg(const uint16_t address, const uint8_t value)
+{
+  if (*port_reg(address) == value)
+    return;
+  memory_hook_range(address, 1);
+  *port_reg(address) = value;
+}
+
+static void update_interrupts(Port_1* const port)
+{
+  if (*port_reg(P1IFG) & *port_reg(P1IE))
+    interrupt_request(port->emu, port->vector);
+  else
+    interrupt_clear(port->emu, port->vector);
+}
+
+static void record_change(Port_1* const port, const PortEventSource source,
+                          const uint8_t oldPins, const uint8_t newPins)
+{
+  const PortEvent event = {
+    .cycle = port->emu->cpu->cycles,
+    .port = 1,
+    .source = (uint8_t)source,
+    .oldPins = oldPins,
+    .newPins = newPins,
+  };
+
+  if (port->log != NULL && fwrite(&event, sizeof event, 1, port->log) != 1)
+  {
+    print_console(port->emu, "Port 1 log write failed, logging stopped\n");
+    fclose(port->log);
+    port->log = NULL;
+  }
+  port->history[port->changes % Port_HistoryLength] = event;
+  port->changes++;
+}
+
+/**
+ * @brief Recompute the pin levels from the direction, the output and the
+ * host inputs, log a change and flag its edges
+ */
+static void update_pins(Port_1* const port, const PortEventSource source)
+{
+  const uint8_t dir = *port_reg(P1DIR);
+  const uint8_t pins = (*port_reg(P1OUT) & dir) | (port->inputLevels & ~dir);
+  const uint8_t changed = pins ^ port->pins;
+
+  if (changed != 0)
+  {
+    const uint8_t rising = changed & pins;
+    const uint8_t falling = changed & ~pins;
+    const uint8_t ies = *port_reg(P1IES);
+
+    record_change(port, source, port->pins, pins);
+    set_reg(P1IFG, *port_reg(P1IFG) | (rising & ~ies) | (falling & ies));
+    port->pins = pins;
+  }
+
+  set_reg(P1IN, port->pins);
+  update_interrupts(port);
+}
+
+static void write_registers(void* context, const uint16_t virt_addr,
+                            const uint8_t size)
+{
+  // P1IN is read only, update_pins() puts it back
+  update_pins((Port_1*)context, PortEvent_Firmware);
+}
+
+/**
+ * @brief P1IFG is shared by all pins, software clears the flags
+ */
+static void ack_interrupt(Emulator* const emu, void* context,
+                          const uint8_t vector)
+{
+  update_interrupts((Port_1*)context);
+}
+
+static void apply_stimulus(Emulator* const emu, void* context);
+
+/**
+ * @brief Schedule the next record of the stimulus file for port 1
+ */
+static void schedule_stimulus(Port_1* const port)
+{
+  Emulator* const emu = port->emu;
+
+  scheduler_cancel(emu->scheduler, apply_stimulus, port);
+  while (port->stimulus != NULL)
+  {
+    if (port->stimulusHead == port->stimulusLength)
+    {
+      port->stimulusHead = 0;
+      port->stimulusLength = (uint32_t)fread(port->stimulusBuffer,
+                                             sizeof(PortEvent),
+                                             Port_BufferedEvents,
+                                             port->stimulus);
+      if (port->stimulusLength == 0)
+      {
+        fclose(port->stimulus);
+        port->stimulus = NULL;
+        return;
+      }
+    }
+
+    const PortEvent* const event = &port->stimulusBuffer[port->stimulusHead];
+    if (event->port == 1)
+    {
+      const uint64_t now = emu->cpu->cycles;
+      scheduler_add(emu->scheduler, event->cycle > now ? event->cycle : now,
+                    apply_stimulus, port);
+      return;
+    }
+    port->stimulusHead++;
+  }
+}
+
+static void apply_stimulus(Emulator* const emu, void* context)
+{
+  Port_1* const port = (Port_1*)context;
+  const PortEvent* const event = &port->stimulusBuffer[port->stimulusHead++];
+
+  port->inputLevels = event->newPins;
+  update_pins(port, PortEvent_Host);
+  schedule_stimulus(port);
+}
+
+void setup_port_1(Emulator* const emu)
+{
+  Port_1* const port = (Port_1*) calloc(1, sizeof(Port_1));
+
+  port->emu = emu;
+  port->vector = emu->device->vectors[DeviceVector_Port1];
+  port->stimulusBuffer = (PortEvent*) malloc(Port_BufferedEvents * sizeof(PortEvent));
+  emu->cpu->p1 = port;
+
+  memset(port_reg(P1IN), 0, Port1_RegisterCount);
+  memory_map_io(P1IN, Port1_RegisterCount, NULL, write_registers, port);
+  interrupt_set_ack_handler(emu, port->vector, ack_interrupt, port);
+}
+
+void uninitialize_port_1(Emulator* const emu)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  if (port == NULL)
+    return;
+
+  scheduler_cancel(emu->scheduler, apply_stimulus, port);
+  memory_unmap_io(port);
+  interrupt_set_ack_handler(emu, port->vector, NULL, NULL);
+
+  if (port->log != NULL)
+    fclose(port->log);
+  if (port->stimulus != NULL)
+    fclose(port->stimulus);
+
+  free(port->stimulusBuffer);
+  free(port);
+  emu->cpu->p1 = NULL;
+}
+
+/**
+ * @brief Take the pin levels from P1IN after the machine state was replaced
+ * by a snapshot. Stimulus records before the restored cycle apply at once.
+ */
+void port_1_resync(Emulator* const emu)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  if (port == NULL)
+    return;
+  port->pins = *port_reg(P1IN);
+  port->inputLevels = port->pins & ~*port_reg(P1DIR);
+  update_interrupts(port);
+  schedule_stimulus(port);
+}
+
+/**
+ * @brief Start writing pin level changes to a file, replacing its contents
+ * @return false if the file could not be created
+ */
+bool port_1_open_log(Emulator* const emu, const char* fileName)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  if (port->log != NULL)
+    fclose(port->log);
+  port->log = fopen(fileName, "wb");
+  if (port->log == NULL)
+    return false;
+  setvbuf(port->log, NULL, _IOFBF, Port_BufferedEvents * sizeof(PortEvent));
+  return true;
+}
+
+/**
+ * @brief Replay the input transitions recorded in a file of PortEvent records
+ * @return false if the file could not be opened
+ */
+bool port_1_open_stimulus(Emulator* const emu, const char* fileName)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  if (port->stimulus != NULL)
+    fclose(port->stimulus);
+  port->stimulus = fopen(fileName, "rb");
+  port->stimulusHead = 0;
+  port->stimulusLength = 0;
+  schedule_stimulus(port);
+  return port->stimulus != NULL;
+}
+
+/**
+ * @brief Write the buffered log records, so other tools see all changes
+ */
+void port_1_flush_log(Emulator* const emu)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  if (port != NULL && port->log != NULL)
+    fflush(port->log);
+}
+
+/**
+ * @brief Drive the input pins from the host, effective immediately
+ */
+void port_1_drive_inputs(Emulator* const emu, const uint8_t levels)
+{
+  Port_1* const port = emu->cpu->p1;
+
+  port->inputLevels = levels;
+  update_pins(port, PortEvent_Host);
+}
+
+void display_port_1(Emulator* const emu)
+{
+  const Port_1* const port = emu->cpu->p1;
+  const uint64_t shown = port->changes < Port_HistoryLength ?
+    port->changes : Port_HistoryLength;
+  char buffer[256];
+
+  sprintf(buffer, "P1IN %02X  P1OUT %02X  P1DIR %02X  P1IFG %02X  P1IES %02X"
+          "  P1IE %02X\n  %llu changes%s%s\n",
+          *port_reg(P1IN), *port_reg(P1OUT), *port_reg(P1DIR),
+          *port_reg(P1IFG), *port_reg(P1IES), *port_reg(P1IE),
+          (unsigned long long)port->changes,
+          port->log != NULL ? ", logging" : "",
+          port->stimulus != NULL ? ", replaying stimulus" : "");
+  print_console(emu, buffer);
+
+  for (uint64_t i = port->changes - shown; i < port->changes; i++)
+  {
+    const PortEvent* const event = &port->history[i % Port_HistoryLength];
+    sprintf(buffer, "  cycle %llu: %02X -> %02X (%s)\n",
+            (unsigned long long)event->cycle, event->oldPins, event->newPins,
+            event->source == PortEvent_Host ? "host" : "firmware");
+    print_console(emu, buffer);
+  }
+}
@@ -0,0 +1,81 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PORT1_H_
+#define _PORT1_H_
+
+#include <stdio.h>
+#include "../../main.h"
+
+// Port 1 registers //
+#define P1IN  0x0020
+#define P1OUT 0x0021
+#define P1DIR 0x0022
+#define P1IFG 0x0023
+#define P1IES 0x0024
+#define P1IE  0x0025
+#define P1SEL 0x0026
+#define P1REN 0x0027
+
+enum { Port1_RegisterCount = 8 };
+enum { Port_BufferedEvents = 4096 };
+enum { Port_HistoryLength = 8 };   // Changes shown by the debugger
+
+// Who changed the pin levels //
+typedef enum {
+  PortEvent_Firmware, // Write to P1OUT or P1DIR
+  PortEvent_Host,     // Input stimulus or debugger command
+} PortEventSource;
+
+// Record of the change log, stored in host byte order //
+typedef struct PortEvent {
+  uint64_t cycle;   // CPU cycle of the change
+  uint8_t port;     // 1 for P1
+  uint8_t source;   // PortEventSource
+  uint8_t oldPins;  // Pin levels before the change, as read from P1IN
+  uint8_t newPins;  // Pin levels after the change
+} __attribute__((packed)) PortEvent;
+
+struct Port_1 {
+  Emulator* emu;
+  uint8_t vector;       // PORT1, 18 (0xFFE4) on the 2xx family
+
+  uint8_t inputLevels;  // Levels driven by the host on the input pins
+  uint8_t pins;         // Current pin levels, mirrored in P1IN
+
+  FILE* log;            // Change log, NULL if not logging
+  FILE* stimulus;       // Input transitions to replay, NULL if none
+  PortEvent* stimulusBuffer;
+  uint32_t stimulusHead;
+  uint32_t stimulusLength;
+
+  PortEvent history[Port_HistoryLength]; // Last changes, oldest overwritten
+  uint64_t changes;     // Number of pin level changes
+};
+
+void setup_port_1(Emulator* const emu);
+void uninitialize_port_1(Emulator* const emu);
+void port_1_resync(Emulator* const emu);
+
+bool port_1_open_log(Emulator* const emu, const char* fileName);
+bool port_1_open_stimulus(Emulator* const emu, const char* fileName);
+void port_1_flush_log(Emulator* const emu);
+void port_1_drive_inputs(Emulator* const emu, const uint8_t levels);
+void display_port_1(Emulator* const emu);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Timer_A +++##########
+//# TAR is not incremented per tick. The model remembers the cycle
+//# up to which the counter was accounted for and advances it on
+//# demand: before an access to a timer register and when the
+//# scheduler fires at the next edge. An edge is the next TAR value
+//# which sets a flag: a TACCRx match, the overflow or the turn
+//# at TACCR0 or 0 in up/down mode, computed from the register
+//# values. Advancing walks from edge to edge, so it costs one
+//# step per edge crossed and not one per tick.
+//#
+//# SMCLK runs at MCLK, ACLK every Clock_AclkCycles cycles. TACLK
+//# and INCLK are not connected and stop the timer. Capture mode
+//# and the output units are not modeled.
+//####################################
+
+#include "timerA.h"
+#include "../cpu/interrupts.h"
+
+extern uint8_t* MEMSPACE;
+
+static inline uint16_t* timer_reg(const uint16_t address)
+{
+  return (uint16_t*)(MEMSPACE + address);
+}
+
+static inline uint16_t* cctl(const uint8_t unit)
+{
+  return timer_reg(TACCTL0 + 2 * unit);
+}
+
+static inline uint16_t* ccr(const uint8_t unit)
+{
+  return timer_reg(TACCR0 + 2 * unit);
+}
+
+/**
+ * @brief Store a register value computed by the model. The write is seen
+ * by the undo journal and marks the page dirty for snapshot restores.
+ */
+static void set_reg(const uint16_t address, const uint16_t value)
+{
+  if (*timer_reg(address) == value)
+    return;
+  memory_hook_range(address, 2);
+  *timer_reg(address) = value;
+}
+
+static TimerA_Mode get_mode()
+{
+  return (TimerA_Mode)((*timer_reg(TACTL) & TimerA_MC) >> 4);
+}
+
+/**
+ * @brief MCLK cycles per timer tick, 0 if the timer does not count
+ */
+static uint32_t cycles_per_tick()
+{
+  const uint16_t tactl = *timer_reg(TACTL);
+  const TimerA_Mode mode = get_mode();
+  const uint32_t divider = 1u << ((tactl & TimerA_ID) >> 6);
+
+  if (mode == TimerA_Mode_Stop)
+    return 0;
+  // Up and up/down mode halt with TACCR0 = 0
+  if (mode != TimerA_Mode_Continuous && *ccr(0) == 0)
+    return 0;
+
+  switch ((tactl & TimerA_TASSEL) >> 8)
+  {
+    case 1: return Clock_AclkCycles * divider;
+    case 2: return divider;
+    default: return 0;
+  }
+}
+
+static bool is_at_end(const Timer_a* const timer, const uint16_t tar)
+{
+  switch (get_mode())
+  {
+    case TimerA_Mode_Up: return tar >= *ccr(0);
+    case TimerA_Mode_UpDown:
+      return timer->countingDown ? tar == 0 : tar >= *ccr(0);
+    default: return tar == 0xFFFF;
+  }
+}
+
+/**
+ * @brief Ticks until TAR reaches the next value which sets a flag
+ */
+static uint32_t ticks_to_edge(const Timer_a* const timer)
+{
+  const uint16_t tar = *timer_reg(TAR);
+  uint32_t distance;
+
+  if (is_at_end(timer, tar))
+    return 1;
+
+  if (timer->countingDown)
+    distance = tar;
+  else if (get_mode() == TimerA_Mode_Continuous)
+    distance = 0xFFFFu - tar;
+  else
+    distance = (uint32_t)*ccr(0) - tar;
+
+  for (uint8_t unit = 0; unit < TimerA_CaptureCompareUnits; unit++)
+  {
+    if (*cctl(unit) & TimerA_CAP)
+      continue;
+    const int32_t d = timer->countingDown ?
+      (int32_t)tar - *ccr(unit) : (int32_t)*ccr(unit) - tar;
+    if (d > 0 && (uint32_t)d < distance)
+      distance = (uint32_t)d;
+  }
+  return distance;
+}
+
+static void set_compare_flags(const uint16_t tar)
+{
+  for (uint8_t unit = 0; unit < TimerA_CaptureCompareUnits; unit++)
+  {
+    if (!(*cctl(unit) & TimerA_CAP) && *ccr(unit) == tar)
+      set_reg(TACCTL0 + 2 * unit, *cctl(unit) | TimerA_CCIFG);
+  }
+}
+
+/**
+ * @brief Count the given number of ticks, at most up to the next edge
+ */
+static void count(Timer_a* const timer, const uint32_t ticks)
+{
+  uint16_t tar = *timer_reg(TAR);
+  const TimerA_Mode mode = get_mode();
+
+  if (ticks == 0)
+    return;
+
+  if (is_at_end(timer, tar))
+  {
+    if (mode == TimerA_Mode_UpDown)
+    {
+      timer->countingDown = !timer->countingDown;
+      tar = timer->countingDown ? tar - 1 : 1;
+    }
+    else
+    {
+      tar = 0;
+      set_reg(TACTL, *timer_reg(TACTL) | TimerA_TAIFG);
+    }
+  }
+  else
+  {
+    tar = timer->countingDown ? tar - ticks : tar + ticks;
+    if (mode == TimerA_Mode_UpDown && timer->countingDown && tar == 0)
+      set_reg(TACTL, *timer_reg(TACTL) | TimerA_TAIFG);
+  }
+
+  set_reg(TAR, tar);
+  set_compare_flags(tar);
+}
+
+/**
+ * @brief Bring TAR and the flags up to the current CPU cycle
+ */
+static void advance(Timer_a* const timer)
+{
+  const uint64_t now = timer->emu->cpu->cycles;
+  const uint32_t cyclesPerTick = cycles_per_tick();
+
+  // Stopped, or the cycle counter went back with a restored snapshot
+  if (cyclesPerTick == 0 || now < timer->lastCycle)
+  {
+    timer->lastCycle = now;
+    return;
+  }
+
+  uint64_t ticks = (now - timer->lastCycle) / cyclesPerTick;
+  timer->lastCycle += ticks * cyclesPerTick;
+
+  while (ticks > 0)
+  {
+    const uint32_t edge = ticks_to_edge(timer);
+    const uint32_t step = ticks < edge ? (uint32_t)ticks : edge;
+    count(timer, step);
+    ticks -= step;
+  }
+}
+
+static uint16_t get_taiv()
+{
+  if ((*cctl(1) & TimerA_CCIE) && (*cctl(1) & TimerA_CCIFG))
+    return 2;
+  if ((*cctl(2) & TimerA_CCIE) && (*cctl(2) & TimerA_CCIFG))
+    return 4;
+  if ((*timer_reg(TACTL) & TimerA_TAIE) && (*timer_reg(TACTL) & TimerA_TAIFG))
+    return 10;
+  return 0;
+}
+
+static void update_interrupts(Timer_a* const timer)
+{
+  Emulator* const emu = timer->emu;
+
+  if ((*cctl(0) & TimerA_CCIE) && (*cctl(0) & TimerA_CCIFG))
+    interrupt_request(emu, timer->vectorCcr0);
+  else
+    interrupt_clear(emu, timer->vectorCcr0);
+
+  set_reg(TAIV, get_taiv());
+  if (*timer_reg(TAIV) != 0)
+    interrupt_request(emu, timer->vectorTaiv);
+  else
+    interrupt_clear(emu, timer->vectorTaiv);
+}
+
+static void handle_edge(Emulator* const emu, void* context);
+
+static void schedule_edge(Timer_a* const timer)
+{
+  Scheduler* const scheduler = timer->emu->scheduler;
+  const uint32_t cyclesPerTick = cycles_per_tick();
+
+  scheduler_cancel(scheduler, handle_edge, timer);
+  if (cyclesPerTick == 0)
+    return;
+
+  scheduler_add(scheduler,
+                timer->lastCycle + (uint64_t)ticks_to_edge(timer) * cyclesPerTick,
+                handle_edge, timer);
+}
+
+static void handle_edge(Emulator* const emu, void* context)
+{
+  Timer_a* const timer = (Timer_a*)context;
+  advance(timer);
+  update_interrupts(timer);
+  schedule_edge(timer);
+}
+
+static void sync_registers(void* context, const uint16_t virt_addr,
+                           const uint8_t size)
+{
+  advance((Timer_a*)context);
+}
+
+static void write_registers(void* context, const uint16_t virt_addr,
+                            const uint8_t size)
+{
+  Timer_a* const timer = (Timer_a*)context;
+  uint16_t* const tactl = timer_reg(TACTL);
+
+  const uint16_t clock = *tactl & (TimerA_TASSEL | TimerA_ID | TimerA_MC);
+
+  // TACLR and a new clock or mode restart the tick phase. TACCRx writes
+  // keep it, an ISR adding to TACCRx must not lose the partial tick.
+  if (*tactl & TimerA_TACLR)
+  {
+    set_reg(TACTL, *tactl & (uint16_t)~TimerA_TACLR);
+    set_reg(TAR, 0);
+    timer->countingDown = false;
+    timer->lastCycle = timer->emu->cpu->cycles;
+  }
+  if (clock != timer->clock)
+  {
+    timer->clock = clock;
+    timer->lastCycle = timer->emu->cpu->cycles;
+  }
+  update_interrupts(timer);
+  schedule_edge(timer);
+}
+
+/**
+ * @brief Reading TAIV clears the flag with the highest priority
+ */
+static void sync_taiv(void* context, const uint16_t virt_addr,
+                      const uint8_t size)
+{
+  Timer_a* const timer = (Timer_a*)context;
+
+  advance(timer);
+  const uint16_t taiv = get_taiv();
+  switch (taiv)
+  {
+    case 2: set_reg(TACCTL0 + 2, *cctl(1) & (uint16_t)~TimerA_CCIFG); break;
+    case 4: set_reg(TACCTL0 + 4, *cctl(2) & (uint16_t)~TimerA_CCIFG); break;
+    case 10: set_reg(TACTL, *timer_reg(TACTL) & (uint16_t)~TimerA_TAIFG); break;
+    default: break;
+  }
+  update_interrupts(timer);
+  // The read returns the value before the flag was cleared
+  set_reg(TAIV, taiv);
+}
+
+static void write_taiv(void* context, const uint16_t virt_addr,
+                       const uint8_t size)
+{
+  update_interrupts((Timer_a*)context);
+}
+
+/**
+ * @brief TACCR0 CCIFG is a single source flag, reset when the CPU accepts it
+ */
+static void ack_ccr0(Emulator* const emu, void* context, const uint8_t vector)
+{
+  set_reg(TACCTL0, *cctl(0) & (uint16_t)~TimerA_CCIFG);
+  update_interrupts((Timer_a*)context);
+}
+
+void setup_timer_a(Emulator* const emu)
+{
+  Cpu* const cpu = emu->cpu;
+  Timer_a* const timer = (Timer_a*) calloc(1, sizeof(Timer_a));
+
+  timer->emu = emu;
+  timer->lastCycle = cpu->cycles;
+  timer->vectorCcr0 = emu->device->vectors[DeviceVector_TimerACcr0];
+  timer->vectorTaiv = emu->device->vectors[DeviceVector_TimerATaiv];
+  cpu->timer_a = timer;
+
+  memset(timer_reg(TACTL), 0, 2 + 2 * TimerA_CaptureCompareUnits);
+  memset(timer_reg(TAR), 0, 2 + 2 * TimerA_CaptureCompareUnits);
+  *timer_reg(TAIV) = 0;
+
+  memory_map_io(TACTL, 2 + 2 * TimerA_CaptureCompareUnits,
+                sync_registers, write_registers, timer);
+  memory_map_io(TAR, 2 + 2 * TimerA_CaptureCompareUnits,
+                sync_registers, write_registers, timer);
+  memory_map_io(TAIV, 2, sync_taiv, write_taiv, timer);
+  interrupt_set_ack_handler(emu, timer->vectorCcr0, ack_ccr0, timer);
+}
+
+void uninitialize_timer_a(Emulator* const emu)
+{
+  Timer_a* const timer = emu->cpu->timer_a;
+
+  if (timer == NULL)
+    return;
+  scheduler_cancel(emu->scheduler, handle_edge, timer);
+  memory_unmap_io(timer);
+  interrupt_set_ack_handler(emu, timer->vectorCcr0, NULL, NULL);
+  free(timer);
+  emu->cpu->timer_a = NULL;
+}
+
+/**
+ * @brief Restart the model from the register contents, after the machine
+ * state was replaced by a snapshot. The up/down direction is not in the
+ * registers, timer_a_set_counting_down() restores it beforehand.
+ */
+void timer_a_resync(Emulator* const emu)
+{
+  Timer_a* const timer = emu->cpu->timer_a;
+
+  if (timer == NULL)
+    return;
+  timer->lastCycle = emu->cpu->cycles;
+  timer->clock = *timer_reg(TACTL) & (TimerA_TASSEL | TimerA_ID | TimerA_MC);
+  if (get_mode() != TimerA_Mode_UpDown)
+    timer->countingDown = false;
+  update_interrupts(timer);
+  schedule_edge(timer);
+}
+
+/**
+ * @brief Bring TAR and the flags up to the current cycle, so that the
+ * undo journal sees the counter as it was at an instruction boundary
+ */
+void timer_a_sync(Emulator* const emu)
+{
+  if (emu->cpu->timer_a != NULL)
+    advance(emu->cpu->timer_a);
+}
+
+/**
+ * @brief Direction of the up/down mode, saved along with the registers
+ */
+bool timer_a_counting_down(const Emulator* const emu)
+{
+  return emu->cpu->timer_a != NULL && emu->cpu->timer_a->countingDown;
+}
+
+void timer_a_set_counting_down(Emulator* const emu, const bool countingDown)
+{
+  if (emu->cpu->timer_a != NULL)
+    emu->cpu->timer_a->countingDown = countingDown;
+}
@@ -0,0 +1,74 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TIMERA_H_
+#define _TIMERA_H_
+
+#include "../../main.h"
+
+// Timer0_A3 registers //
+#define TAIV    0x012E
+#define TACTL   0x0160
+#define TACCTL0 0x0162
+#define TAR     0x0170
+#define TACCR0  0x0172
+
+enum { TimerA_CaptureCompareUnits = 3 };
+
+// TACTL bits //
+enum {
+  TimerA_TASSEL = 0x0300,
+  TimerA_ID = 0x00C0,
+  TimerA_MC = 0x0030,
+  TimerA_TACLR = 0x0004,
+  TimerA_TAIE = 0x0002,
+  TimerA_TAIFG = 0x0001,
+};
+
+// TACCTLx bits //
+enum {
+  TimerA_CAP = 0x0100,
+  TimerA_CCIE = 0x0010,
+  TimerA_CCIFG = 0x0001,
+};
+
+// Mode control //
+typedef enum {
+  TimerA_Mode_Stop,
+  TimerA_Mode_Up,
+  TimerA_Mode_Continuous,
+  TimerA_Mode_UpDown,
+} TimerA_Mode;
+
+struct Timer_a {
+  Emulator* emu;
+  uint64_t lastCycle; // CPU cycle of the last counter tick accounted for
+  uint16_t clock;     // TASSEL, ID and MC of TACTL, a change restarts the phase
+  bool countingDown;  // Up/down mode direction
+  uint8_t vectorCcr0; // TACCR0 CCIFG, 25 (0xFFF2) on the 2xx family
+  uint8_t vectorTaiv; // TACCR1/2 CCIFG and TAIFG, 24 (0xFFF0) on the 2xx family
+};
+
+void setup_timer_a(Emulator* const emu);
+void uninitialize_timer_a(Emulator* const emu);
+void timer_a_resync(Emulator* const emu);
+void timer_a_sync(Emulator* const emu);
+bool timer_a_counting_down(const Emulator* const emu);
+void timer_a_set_counting_down(Emulator* const emu, const bool countingDown);
+
+#endif
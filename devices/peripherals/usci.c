@@ -0,0 +1,600 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ USCI_A0 UART +++##########
+//# The line is not sampled per bit. Writing UCA0TXBUF moves the
+//# byte into the shift register and schedules its completion one
+//# frame later, the frame time following from the clock source,
+//# UCA0BR0/1, UCA0MCTL and the frame format. Received bytes are
+//# scheduled the same way, one frame apart, the next one only
+//# after UCA0RXBUF was read, so the host stream acts as if it had
+//# flow control and no byte is lost to an overrun.
+//#
+//# Transmitted bytes collect in a buffer written to the host in
+//# one call when it fills up, the emulator stops or the firmware
+//# waits for input. Received bytes are read from the host a buffer
+//# at a time. A silent host stream is polled every few cycles, so
+//# timers and interrupts keep running meanwhile. Only a CPU with
+//# nothing else to do, asleep or in an idle loop without another
+//# wake-up source, waits for the host, and only for a moment at a
+//# time so that --timeout still fires. In infinite speed mode
+//# frames take no time at all.
+//#
+//# What the host stream delivered, and when, is recorded for a
+//# replay of the run, which then reads the same bytes from the log.
+//#
+//# A linked UART has no host streams. The co-simulation bridge
+//# queues received bytes between quanta and collects the bytes
+//# transmitted during one, an empty queue waits for the next
+//# quantum instead of blocking.
+//########################################
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "usci.h"
+#include "../cpu/interrupts.h"
+#include "../cpu/idle_loop.h"
+#include "../../debugger/io.h"
+#include "../../debugger/replay.h"
+
+#define UNIX_SOCKET_PREFIX "unix:"
+
+extern uint8_t* MEMSPACE;
+
+static inline uint8_t* usci_reg(const uint16_t address)
+{
+  return MEMSPACE + address;
+}
+
+/**
+ * @brief Store a register value set by the model, seen by the undo journal
+ * and by snapshot restores through the dirty pages
+ */
+static void set_reg(const uint16_t address, const uint8_t value)
+{
+  if (*usci_reg(address) == value)
+    return;
+  memory_hook_range(address, 1);
+  *usci_reg(address) = value;
+}
+
+/**
+ * @brief MCLK cycles per frame: start bit, data, parity and stop bits
+ */
+static uint64_t frame_cycles(const Usci* const usci)
+{
+  const uint8_t ctl0 = *usci_reg(UCA0CTL0);
+  const uint8_t mctl = *usci_reg(UCA0MCTL);
+  const uint32_t br = *usci_reg(UCA0BR0) | (*usci_reg(UCA0BR1) << 8);
+  const uint32_t brclkCycles =
+    ((*usci_reg(UCA0CTL1) & Usci_UCSSEL) >> 6) == 1 ? Clock_AclkCycles : 1;
+  const uint32_t bits = 1 + ((ctl0 & Usci_UC7BIT) ? 7 : 8) +
+    ((ctl0 & Usci_UCPEN) ? 1 : 0) + ((ctl0 & Usci_UCSPB) ? 2 : 1);
+  uint64_t bitEighths; // BRCLK cycles per bit, times 8
+
+  if (usci->infiniteSpeed)
+    return 0;
+
+  if (mctl & Usci_UCOS16)
+    bitEighths = (16 * (uint64_t)br + ((mctl & Usci_UCBRF) >> 4)) * 8;
+  else
+    bitEighths = 8 * (uint64_t)br + ((mctl & Usci_UCBRS) >> 1);
+
+  const uint64_t cycles = bits * bitEighths * brclkCycles / 8;
+  return cycles > 0 ? cycles : 1;
+}
+
+static bool in_reset()
+{
+  return (*usci_reg(UCA0CTL1) & Usci_UCSWRST) != 0;
+}
+
+static void update_interrupts(Usci* const usci)
+{
+  const uint8_t pending = *usci_reg(IE2) & *usci_reg(IFG2);
+
+  if (pending & Usci_UCA0TXIFG)
+    interrupt_request(usci->emu, usci->vectorTx);
+  else
+    interrupt_clear(usci->emu, usci->vectorTx);
+
+  if (pending & Usci_UCA0RXIFG)
+    interrupt_request(usci->emu, usci->vectorRx);
+  else
+    interrupt_clear(usci->emu, usci->vectorRx);
+}
+
+static void update_busy(const Usci* const usci)
+{
+  if (usci->txShifting)
+    set_reg(UCA0STAT, *usci_reg(UCA0STAT) | Usci_UCBUSY);
+  else
+    set_reg(UCA0STAT, *usci_reg(UCA0STAT) & (uint8_t)~Usci_UCBUSY);
+}
+
+static bool write_all(const int fd, const uint8_t* data, uint32_t length)
+{
+  while (length > 0)
+  {
+    const ssize_t written = write(fd, data, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    length -= (uint32_t)written;
+  }
+  return true;
+}
+
+/**
+ * @brief Write the transmitted bytes to the host stream
+ */
+void usci_flush(Emulator* const emu)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  // A link keeps the bytes until the end of the quantum
+  if (usci == NULL || usci->txLength == 0 || usci->linked)
+    return;
+  if (usci->outFd >= 0 && !write_all(usci->outFd, usci->txBuffer, usci->txLength))
+  {
+    print_console(emu, "UART output failed, disconnected\n");
+    usci->outFd = -1;
+  }
+  usci->txLength = 0;
+}
+
+static void emit_byte(Usci* const usci, const uint8_t byte)
+{
+  if (usci->txLength == Usci_BufferSize)
+    usci_flush(usci->emu);
+  if (usci->txLength == Usci_BufferSize)
+    return; // A linked UART sent more than the link takes per quantum
+  usci->txBuffer[usci->txLength++] = byte;
+  usci->bytesTransmitted++;
+}
+
+static void complete_transmission(Emulator* const emu, void* context);
+
+/**
+ * @brief Move UCA0TXBUF into the shift register, freeing the buffer
+ */
+static void start_transmission(Usci* const usci)
+{
+  const uint64_t frame = frame_cycles(usci);
+
+  set_reg(IFG2, *usci_reg(IFG2) | Usci_UCA0TXIFG);
+  if (frame == 0)
+  {
+    emit_byte(usci, *usci_reg(UCA0TXBUF));
+    return;
+  }
+
+  usci->txShift = *usci_reg(UCA0TXBUF);
+  usci->txShifting = true;
+  usci->txDoneCycle = usci->emu->cpu->cycles + frame;
+  scheduler_add(usci->emu->scheduler, usci->txDoneCycle,
+                complete_transmission, usci);
+}
+
+static void complete_transmission(Emulator* const emu, void* context)
+{
+  Usci* const usci = (Usci*)context;
+
+  usci->txShifting = false;
+  emit_byte(usci, usci->txShift);
+
+  // A byte written meanwhile waits in UCA0TXBUF
+  if (!(*usci_reg(IFG2) & Usci_UCA0TXIFG) && !in_reset())
+    start_transmission(usci);
+
+  update_busy(usci);
+  update_interrupts(usci);
+}
+
+static void receive_byte(Emulator* const emu, void* context);
+
+static bool has_input(const Usci* const usci)
+{
+  return usci->inFd >= 0 || usci->replayInput || usci->linked;
+}
+
+/**
+ * @param wait Milliseconds to wait for input, 0 to only poll
+ */
+static bool is_input_ready(const Usci* const usci, const int wait)
+{
+  struct pollfd fd = { .fd = usci->inFd, .events = POLLIN };
+  uint8_t ready = 0;
+
+  if (usci->replayInput)
+  {
+    replay_take(usci->emu, ReplayRecord_UartReady, &ready, 1);
+    return ready;
+  }
+
+  ready = poll(&fd, 1, wait) > 0;
+  replay_record(usci->emu, ReplayRecord_UartReady, &ready, 1);
+  return ready;
+}
+
+static bool fill_rx_buffer(Usci* const usci)
+{
+  ssize_t length;
+
+  if (usci->rxHead < usci->rxLength)
+    return true;
+  if (!has_input(usci) || usci->rxEof || usci->linked)
+    return false;
+
+  // Whatever is available, receive_byte() made sure something is
+  if (usci->replayInput)
+  {
+    length = replay_take(usci->emu, ReplayRecord_UartData,
+                         usci->rxBuffer, Usci_BufferSize);
+  }
+  else
+  {
+    do {
+      length = read(usci->inFd, usci->rxBuffer, Usci_BufferSize);
+    } while (length < 0 && errno == EINTR);
+    replay_record(usci->emu, ReplayRecord_UartData, usci->rxBuffer,
+                  length > 0 ? (uint32_t)length : 0);
+  }
+
+  usci->rxHead = 0;
+  usci->rxLength = length > 0 ? (uint32_t)length : 0;
+  usci->rxEof = length <= 0;
+  return length > 0;
+}
+
+/**
+ * @brief Schedule the next received byte, once UCA0RXBUF is free
+ */
+static void schedule_reception(Usci* const usci)
+{
+  Emulator* const emu = usci->emu;
+  const uint64_t now = emu->cpu->cycles;
+
+  scheduler_cancel(emu->scheduler, receive_byte, usci);
+  if (in_reset() || !has_input(usci) || usci->rxEof ||
+      (*usci_reg(IFG2) & Usci_UCA0RXIFG))
+    return;
+  // An empty link queue must not look like a wake-up source
+  if (usci->linked && usci->rxHead >= usci->rxLength)
+    return;
+
+  scheduler_add(emu->scheduler,
+                usci->rxNextCycle > now ? usci->rxNextCycle : now,
+                receive_byte, usci);
+}
+
+/**
+ * @return true if the CPU sleeps or spins in an idle loop and nothing but
+ * the host can wake it up
+ */
+static bool is_cpu_waiting(Emulator* const emu)
+{
+  const Cpu* const cpu = emu->cpu;
+
+  return ((cpu->sr & StatusRegister_CPUOFF) || idle_loop_spinning(emu)) &&
+    !scheduler_has_wakeup_source(emu->scheduler);
+}
+
+static void receive_byte(Emulator* const emu, void* context)
+{
+  Usci* const usci = (Usci*)context;
+
+  if (usci->rxHead >= usci->rxLength && !usci->rxEof && !usci->linked &&
+      !in_reset())
+  {
+    // The host may wait for the byte being sent before it answers
+    const bool waiting = !usci->txShifting && is_cpu_waiting(emu);
+
+    usci_flush(emu);
+    if (!is_input_ready(usci, waiting ? Usci_InputWaitMilliseconds : 0))
+    {
+      scheduler_add(emu->scheduler, usci->txShifting ? usci->txDoneCycle :
+                    emu->cpu->cycles + Usci_InputPollCycles,
+                    receive_byte, usci);
+      return;
+    }
+  }
+
+  if (in_reset() || !fill_rx_buffer(usci))
+    return;
+
+  set_reg(UCA0RXBUF, usci->rxBuffer[usci->rxHead++]);
+  set_reg(IFG2, *usci_reg(IFG2) | Usci_UCA0RXIFG);
+  usci->rxNextCycle = emu->cpu->cycles + frame_cycles(usci);
+  usci->bytesReceived++;
+  update_interrupts(usci);
+}
+
+static void reset_usci(Usci* const usci)
+{
+  scheduler_cancel(usci->emu->scheduler, complete_transmission, usci);
+  scheduler_cancel(usci->emu->scheduler, receive_byte, usci);
+  usci->txShifting = false;
+  usci->rxNextCycle = 0;
+
+  set_reg(IE2, *usci_reg(IE2) & (uint8_t)~(Usci_UCA0RXIE | Usci_UCA0TXIE));
+  set_reg(IFG2, (*usci_reg(IFG2) & (uint8_t)~Usci_UCA0RXIFG) | Usci_UCA0TXIFG);
+  set_reg(UCA0STAT, 0);
+}
+
+static void write_control(void* context, const uint16_t virt_addr,
+                          const uint8_t size)
+{
+  Usci* const usci = (Usci*)context;
+
+  if (in_reset())
+    reset_usci(usci);
+  else
+    schedule_reception(usci);
+  update_interrupts(usci);
+}
+
+/**
+ * @brief Reading UCA0RXBUF frees it for the next byte
+ */
+static void read_rx_buffer(void* context, const uint16_t virt_addr,
+                           const uint8_t size)
+{
+  Usci* const usci = (Usci*)context;
+
+  if (virt_addr + size <= UCA0RXBUF || !(*usci_reg(IFG2) & Usci_UCA0RXIFG))
+    return;
+  set_reg(IFG2, *usci_reg(IFG2) & (uint8_t)~Usci_UCA0RXIFG);
+  schedule_reception(usci);
+  update_interrupts(usci);
+}
+
+static void write_tx_buffer(void* context, const uint16_t virt_addr,
+                            const uint8_t size)
+{
+  Usci* const usci = (Usci*)context;
+
+  if (virt_addr + size <= UCA0TXBUF || in_reset())
+    return;
+
+  set_reg(IFG2, *usci_reg(IFG2) & (uint8_t)~Usci_UCA0TXIFG);
+  if (!usci->txShifting)
+    start_transmission(usci);
+  update_busy(usci);
+  update_interrupts(usci);
+}
+
+static void write_interrupt_registers(void* context, const uint16_t virt_addr,
+                                      const uint8_t size)
+{
+  Usci* const usci = (Usci*)context;
+
+  // Software may clear UCA0RXIFG instead of reading UCA0RXBUF
+  schedule_reception(usci);
+  update_interrupts(usci);
+}
+
+/**
+ * @brief The flags are cleared by buffer accesses, not by the acceptance
+ */
+static void ack_interrupt(Emulator* const emu, void* context,
+                          const uint8_t vector)
+{
+  update_interrupts((Usci*)context);
+}
+
+void setup_usci(Emulator* const emu)
+{
+  Usci* const usci = (Usci*) calloc(1, sizeof(Usci));
+
+  usci->emu = emu;
+  usci->inFd = -1;
+  usci->outFd = -1;
+  usci->vectorTx = emu->device->vectors[DeviceVector_UsciTx];
+  usci->vectorRx = emu->device->vectors[DeviceVector_UsciRx];
+  usci->txBuffer = (uint8_t*) malloc(Usci_BufferSize);
+  usci->rxBuffer = (uint8_t*) malloc(Usci_BufferSize);
+  emu->cpu->usci = usci;
+
+  memset(usci_reg(UCA0CTL0), 0, UCA0TXBUF - UCA0CTL0 + 1);
+  *usci_reg(UCA0CTL1) = Usci_UCSWRST;
+  reset_usci(usci);
+
+  memory_map_io(UCA0CTL0, UCA0RXBUF - UCA0CTL0, NULL, write_control, usci);
+  memory_map_io(UCA0RXBUF, 1, read_rx_buffer, NULL, usci);
+  memory_map_io(UCA0TXBUF, 1, NULL, write_tx_buffer, usci);
+  memory_map_io(IE2, 1, NULL, write_interrupt_registers, usci);
+  memory_map_io(IFG2, 1, NULL, write_interrupt_registers, usci);
+  interrupt_set_ack_handler(emu, usci->vectorTx, ack_interrupt, usci);
+  interrupt_set_ack_handler(emu, usci->vectorRx, ack_interrupt, usci);
+}
+
+void uninitialize_usci(Emulator* const emu)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  if (usci == NULL)
+    return;
+
+  usci_flush(emu);
+  scheduler_cancel(emu->scheduler, complete_transmission, usci);
+  scheduler_cancel(emu->scheduler, receive_byte, usci);
+  memory_unmap_io(usci);
+  interrupt_set_ack_handler(emu, usci->vectorTx, NULL, NULL);
+  interrupt_set_ack_handler(emu, usci->vectorRx, NULL, NULL);
+
+  if (usci->inFd > STDERR_FILENO)
+    close(usci->inFd);
+  if (usci->outFd > STDERR_FILENO && usci->outFd != usci->inFd)
+    close(usci->outFd);
+
+  free(usci->txBuffer);
+  free(usci->rxBuffer);
+  free(usci);
+  emu->cpu->usci = NULL;
+}
+
+/**
+ * @brief Restart transfers from the register contents, after the machine
+ * state was replaced by a snapshot. A byte being shifted out is lost.
+ */
+void usci_resync(Emulator* const emu)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  if (usci == NULL)
+    return;
+  scheduler_cancel(emu->scheduler, complete_transmission, usci);
+  usci->txShifting = false;
+  usci->rxNextCycle = 0;
+  update_busy(usci);
+  schedule_reception(usci);
+  update_interrupts(usci);
+}
+
+static int connect_unix_socket(const char* path)
+{
+  struct sockaddr_un address;
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return -1;
+
+  memset(&address, 0, sizeof address);
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof address.sun_path - 1);
+  if (connect(fd, (struct sockaddr*)&address, sizeof address) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Open a host stream: "-" for stdin/stdout, "unix:PATH" for a Unix
+ * domain socket, anything else is a file or named pipe
+ */
+static int open_stream(const char* spec, const bool output)
+{
+  if (!strcmp(spec, "-"))
+    return output ? STDOUT_FILENO : STDIN_FILENO;
+  if (!strncmp(spec, UNIX_SOCKET_PREFIX, strlen(UNIX_SOCKET_PREFIX)))
+    return connect_unix_socket(spec + strlen(UNIX_SOCKET_PREFIX));
+  return output ? open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0644) :
+    open(spec, O_RDONLY);
+}
+
+bool usci_connect_input(Emulator* const emu, const char* spec)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  usci->inFd = open_stream(spec, false);
+  usci->inSpec = spec;
+  usci->rxEof = false;
+  schedule_reception(usci);
+  return usci->inFd >= 0;
+}
+
+/**
+ * @brief Feed RX from the replay log, in place of a host stream
+ */
+void usci_replay_input(Emulator* const emu)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  usci->replayInput = true;
+  usci->rxEof = false;
+  schedule_reception(usci);
+}
+
+/**
+ * @brief Exchange bytes with a co-simulation link instead of host streams
+ */
+void usci_link(Emulator* const emu)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  usci->linked = true;
+  usci->rxEof = false;
+}
+
+/**
+ * @brief Queue bytes which arrived over the link, excess bytes are lost
+ */
+void usci_link_receive(Emulator* const emu, const uint8_t* data,
+                       const uint32_t length)
+{
+  Usci* const usci = emu->cpu->usci;
+  const uint32_t queued = usci->rxLength - usci->rxHead;
+  const uint32_t space = Usci_BufferSize - queued;
+  const uint32_t taken = length < space ? length : space;
+
+  memmove(usci->rxBuffer, usci->rxBuffer + usci->rxHead, queued);
+  memcpy(usci->rxBuffer + queued, data, taken);
+  usci->rxHead = 0;
+  usci->rxLength = queued + taken;
+  schedule_reception(usci);
+}
+
+/**
+ * @brief Take the bytes transmitted since the last call
+ * @param data Receives up to Usci_BufferSize bytes
+ * @return The number of bytes
+ */
+uint32_t usci_link_transmitted(Emulator* const emu, uint8_t* const data)
+{
+  Usci* const usci = emu->cpu->usci;
+  const uint32_t length = usci->txLength;
+
+  memcpy(data, usci->txBuffer, length);
+  usci->txLength = 0;
+  return length;
+}
+
+bool usci_connect_output(Emulator* const emu, const char* spec)
+{
+  Usci* const usci = emu->cpu->usci;
+
+  // Both directions over one socket connection
+  if (usci->inFd >= 0 && usci->inSpec != NULL && !strcmp(usci->inSpec, spec) &&
+      !strncmp(spec, UNIX_SOCKET_PREFIX, strlen(UNIX_SOCKET_PREFIX)))
+    usci->outFd = usci->inFd;
+  else
+    usci->outFd = open_stream(spec, true);
+  return usci->outFd >= 0;
+}
+
+void display_usci(Emulator* const emu)
+{
+  const Usci* const usci = emu->cpu->usci;
+  char buffer[256];
+
+  sprintf(buffer, "UART: %s, frame %llu cycles\n"
+          "  TX %llu bytes (%u buffered)  RX %llu bytes (%u buffered%s)\n",
+          in_reset() ? "in reset" : "enabled",
+          (unsigned long long)frame_cycles(usci),
+          (unsigned long long)usci->bytesTransmitted, usci->txLength,
+          (unsigned long long)usci->bytesReceived,
+          usci->rxLength - usci->rxHead, usci->rxEof ? ", end of input" : "");
+  print_console(emu, buffer);
+}
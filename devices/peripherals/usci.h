@@ -0,0 +1,105 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _USCI_H_
+#define _USCI_H_
+
+#include "../../main.h"
+
+// Interrupt enable and flag registers shared with USCI_B0 //
+#define IE2  0x0001
+#define IFG2 0x0003
+
+// USCI_A0 registers //
+#define UCA0CTL0  0x0060
+#define UCA0CTL1  0x0061
+#define UCA0BR0   0x0062
+#define UCA0BR1   0x0063
+#define UCA0MCTL  0x0064
+#define UCA0STAT  0x0065
+#define UCA0RXBUF 0x0066
+#define UCA0TXBUF 0x0067
+
+enum { Usci_BufferSize = 0x10000 };
+enum { Usci_InputPollCycles = 1000 };     // Between polls of a silent host
+enum { Usci_InputWaitMilliseconds = 100 }; // Longest wait of an idle CPU
+
+// IE2 and IFG2 bits //
+enum {
+  Usci_UCA0RXIE = 0x01,
+  Usci_UCA0TXIE = 0x02,
+  Usci_UCA0RXIFG = 0x01,
+  Usci_UCA0TXIFG = 0x02,
+};
+
+// UCA0CTL0, UCA0CTL1, UCA0MCTL and UCA0STAT bits //
+enum {
+  Usci_UCPEN = 0x80,
+  Usci_UC7BIT = 0x10,
+  Usci_UCSPB = 0x08,
+  Usci_UCSSEL = 0xC0,
+  Usci_UCSWRST = 0x01,
+  Usci_UCBRF = 0xF0,
+  Usci_UCBRS = 0x0E,
+  Usci_UCOS16 = 0x01,
+  Usci_UCBUSY = 0x01,
+};
+
+struct Usci {
+  Emulator* emu;
+  uint8_t vectorTx;     // USCIAB0TX, 22 (0xFFEC) on the 2xx family
+  uint8_t vectorRx;     // USCIAB0RX, 23 (0xFFEE) on the 2xx family
+
+  int inFd;             // Host stream feeding RX, -1 if none
+  int outFd;            // Host stream receiving TX, -1 if none
+  const char* inSpec;   // Connection of inFd, shared by a matching outFd
+  bool rxEof;           // inFd reached its end
+  bool replayInput;     // RX is fed from a replay log instead of inFd
+  bool linked;          // Bytes go through a co-simulation link, see cosim.c
+  bool infiniteSpeed;   // Bytes take no time on the line
+
+  uint8_t* txBuffer;    // Transmitted bytes not yet written to outFd
+  uint32_t txLength;
+  uint8_t* rxBuffer;    // Bytes read from inFd not yet received
+  uint32_t rxHead;
+  uint32_t rxLength;
+
+  bool txShifting;      // A byte is in the transmit shift register
+  uint8_t txShift;
+  uint64_t txDoneCycle; // Completion of the byte in the shift register
+  uint64_t rxNextCycle; // Earliest arrival of the next received byte
+
+  uint64_t bytesTransmitted;
+  uint64_t bytesReceived;
+};
+
+void setup_usci(Emulator* const emu);
+void uninitialize_usci(Emulator* const emu);
+void usci_resync(Emulator* const emu);
+
+bool usci_connect_input(Emulator* const emu, const char* spec);
+bool usci_connect_output(Emulator* const emu, const char* spec);
+void usci_replay_input(Emulator* const emu);
+void usci_link(Emulator* const emu);
+void usci_link_receive(Emulator* const emu, const uint8_t* data,
+                       const uint32_t length);
+uint32_t usci_link_transmitted(Emulator* const emu, uint8_t* const data);
+void usci_flush(Emulator* const emu);
+void display_usci(Emulator* const emu);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Discrete event scheduler +++##########
+//# Peripherals register callbacks at the absolute CPU cycle at
+//# which something happens (a timer match, a byte shifted out)
+//# instead of being polled after every instruction. The run loop
+//# executes instructions without looking at any device until
+//# the cycle counter reaches the earliest event.
+//#
+//# Events due at the same cycle run in the order they were added.
+//# A callback may add or cancel events, including itself.
+//#
+//# The heap grows when it is full, a peripheral event is never
+//# dropped for lack of room.
+//#
+//# Observer events (run limits) stop the run loop like any other
+//# event, but do not count as a source which can end a low power
+//# mode or an idle loop.
+//#####################################################
+
+#include "scheduler.h"
+
+Scheduler* scheduler_create()
+{
+  Scheduler* const scheduler = (Scheduler*) calloc(1, sizeof(Scheduler));
+
+  scheduler->capacity = Scheduler_InitialEvents;
+  scheduler->events = (SchedulerEvent*) malloc(scheduler->capacity *
+                                               sizeof(SchedulerEvent));
+  return scheduler;
+}
+
+void scheduler_destroy(Scheduler* const scheduler)
+{
+  if (scheduler == NULL)
+    return;
+  free(scheduler->events);
+  free(scheduler);
+}
+
+static bool event_before(const SchedulerEvent* const a,
+                         const SchedulerEvent* const b)
+{
+  return a->cycle < b->cycle ||
+    (a->cycle == b->cycle && a->sequence < b->sequence);
+}
+
+static void swap_events(SchedulerEvent* const a, SchedulerEvent* const b)
+{
+  const SchedulerEvent tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static void sift_up(Scheduler* const scheduler, uint32_t index)
+{
+  SchedulerEvent* const events = scheduler->events;
+
+  while (index > 0)
+  {
+    const uint32_t parent = (index - 1) / 2;
+    if (!event_before(&events[index], &events[parent]))
+      break;
+    swap_events(&events[index], &events[parent]);
+    index = parent;
+  }
+}
+
+static void sift_down(Scheduler* const scheduler, uint32_t index)
+{
+  SchedulerEvent* const events = scheduler->events;
+
+  for (;;)
+  {
+    const uint32_t left = 2 * index + 1;
+    const uint32_t right = left + 1;
+    uint32_t smallest = index;
+
+    if (left < scheduler->numEvents && event_before(&events[left], &events[smallest]))
+      smallest = left;
+    if (right < scheduler->numEvents && event_before(&events[right], &events[smallest]))
+      smallest = right;
+    if (smallest == index)
+      break;
+    swap_events(&events[index], &events[smallest]);
+    index = smallest;
+  }
+}
+
+static void remove_event(Scheduler* const scheduler, const uint32_t index)
+{
+  scheduler->numEvents--;
+  if (index == scheduler->numEvents)
+    return;
+  scheduler->events[index] = scheduler->events[scheduler->numEvents];
+  sift_up(scheduler, index);
+  sift_down(scheduler, index);
+}
+
+static bool add_event(Scheduler* const scheduler, const uint64_t cycle,
+                      SchedulerCallback callback, void* context,
+                      const bool observer)
+{
+  if (scheduler->numEvents >= scheduler->capacity)
+  {
+    static bool reported = false;
+    SchedulerEvent* const events = (SchedulerEvent*)
+      realloc(scheduler->events, 2 * scheduler->capacity * sizeof(SchedulerEvent));
+
+    if (events == NULL)
+    {
+      if (!reported)
+        printf("Out of memory for scheduler events, events are dropped\n");
+      reported = true;
+      return false;
+    }
+    scheduler->events = events;
+    scheduler->capacity *= 2;
+  }
+
+  SchedulerEvent* const event = &scheduler->events[scheduler->numEvents];
+  event->cycle = cycle;
+  event->sequence = scheduler->sequence++;
+  event->callback = callback;
+  event->context = context;
+  event->observer = observer;
+  sift_up(scheduler, scheduler->numEvents++);
+  return true;
+}
+
+/**
+ * @brief Schedule a callback at an absolute cycle. A cycle which already
+ * passed is run after the current instruction.
+ * @return false if the event queue could not grow
+ */
+bool scheduler_add(Scheduler* const scheduler, const uint64_t cycle,
+                   SchedulerCallback callback, void* context)
+{
+  return add_event(scheduler, cycle, callback, context, false);
+}
+
+/**
+ * @brief Schedule a callback which only watches the run
+ * @return false if the event queue could not grow
+ */
+bool scheduler_add_observer(Scheduler* const scheduler, const uint64_t cycle,
+                            SchedulerCallback callback, void* context)
+{
+  return add_event(scheduler, cycle, callback, context, true);
+}
+
+/**
+ * @brief Remove all events with the given callback and context
+ */
+void scheduler_cancel(Scheduler* const scheduler, SchedulerCallback callback,
+                      void* context)
+{
+  uint32_t i = 0;
+
+  while (i < scheduler->numEvents)
+  {
+    const SchedulerEvent* const event = &scheduler->events[i];
+    if (event->callback == callback && event->context == context)
+      remove_event(scheduler, i);
+    else
+      i++;
+  }
+}
+
+void scheduler_clear(Scheduler* const scheduler)
+{
+  scheduler->numEvents = 0;
+}
+
+/**
+ * @return true if a pending event other than an observer exists
+ */
+bool scheduler_has_wakeup_source(const Scheduler* const scheduler)
+{
+  for (uint32_t i = 0; i < scheduler->numEvents; i++)
+  {
+    if (!scheduler->events[i].observer)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @return The cycle of the earliest event other than an observer,
+ * SCHEDULER_NO_EVENT if there is none
+ */
+uint64_t scheduler_next_wakeup_cycle(const Scheduler* const scheduler)
+{
+  uint64_t cycle = SCHEDULER_NO_EVENT;
+
+  for (uint32_t i = 0; i < scheduler->numEvents; i++)
+  {
+    if (!scheduler->events[i].observer && scheduler->events[i].cycle < cycle)
+      cycle = scheduler->events[i].cycle;
+  }
+  return cycle;
+}
+
+/**
+ * @brief Run the callbacks of all events due at the current cycle
+ */
+void scheduler_run_due(Emulator* const emu)
+{
+  Scheduler* const scheduler = emu->scheduler;
+  const uint64_t now = emu->cpu->cycles;
+
+  while (scheduler->numEvents > 0 && scheduler->events[0].cycle <= now)
+  {
+    const SchedulerEvent event = scheduler->events[0];
+    remove_event(scheduler, 0);
+    event.callback(emu, event.context);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include "../main.h"
+
+enum { Scheduler_InitialEvents = 64 }; // Doubled when full
+enum { Clock_AclkCycles = 32 }; // MCLK cycles per ACLK tick, 1 MHz DCO and 32 kHz crystal
+
+#define SCHEDULER_NO_EVENT UINT64_MAX
+
+typedef void (*SchedulerCallback)(Emulator* const emu, void* context);
+
+// A peripheral event due at an absolute CPU cycle //
+typedef struct SchedulerEvent {
+  uint64_t cycle;     // Due when the cycle counter reaches this value
+  uint64_t sequence;  // Orders events due at the same cycle
+  SchedulerCallback callback;
+  void* context;
+  bool observer;      // Watches the run, cannot wake the CPU up
+} SchedulerEvent;
+
+// Binary min-heap of pending events, ordered by cycle and sequence //
+typedef struct Scheduler {
+  SchedulerEvent* events;
+  uint32_t numEvents;
+  uint32_t capacity;
+  uint64_t sequence;
+} Scheduler;
+
+Scheduler* scheduler_create();
+void scheduler_destroy(Scheduler* const scheduler);
+
+bool scheduler_add(Scheduler* const scheduler, const uint64_t cycle,
+                   SchedulerCallback callback, void* context);
+bool scheduler_add_observer(Scheduler* const scheduler, const uint64_t cycle,
+                            SchedulerCallback callback, void* context);
+void scheduler_cancel(Scheduler* const scheduler, SchedulerCallback callback,
+                      void* context);
+void scheduler_clear(Scheduler* const scheduler);
+
+static inline uint64_t scheduler_next_cycle(const Scheduler* const scheduler)
+{
+  return scheduler->numEvents > 0 ? scheduler->events[0].cycle :
+    SCHEDULER_NO_EVENT;
+}
+
+bool scheduler_has_wakeup_source(const Scheduler* const scheduler);
+uint64_t scheduler_next_wakeup_cycle(const Scheduler* const scheduler);
+void scheduler_run_due(Emulator* const emu);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ Machine state snapshots +++##########
+//# In-memory snapshots copy the CPU, MEMSPACE, MEMSPACE_FLAGS, the
+//# breakpoints and the peripheral state which is not held in a
+//# register, like the Timer_A up/down direction. Memory pages written since the last save or
+//# restore of a snapshot are tracked by memspace.c, so saving or
+//# restoring the same snapshot again only copies the dirty pages.
+//#
+//# On disk a snapshot is the magic, a format version and a list
+//# of tagged sections: [TAG:4][LENGTH:4][DATA:LENGTH], all
+//# numbers little endian. Unknown sections are skipped.
+//####################################################
+
+#include "snapshot.h"
+#include "../debugger/io.h"
+#include "machine.h"
+#include "peripherals/timerA.h"
+
+#define SECTION_TAG(a, b, c, d) \
+  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+enum {
+  Section_Registers = SECTION_TAG('R', 'E', 'G', 'S'),
+  Section_Memory = SECTION_TAG('M', 'E', 'M', ' '),
+  Section_Flags = SECTION_TAG('F', 'L', 'A', 'G'),
+  Section_Breakpoints = SECTION_TAG('B', 'R', 'K', 'P'),
+  Section_Interrupts = SECTION_TAG('I', 'R', 'Q', 'S'),
+  Section_Cycles = SECTION_TAG('C', 'Y', 'C', 'L'),
+  Section_TimerA = SECTION_TAG('T', 'I', 'M', 'A'),
+};
+
+enum { Snapshot_RegisterCount = 16 };
+
+extern uint8_t* MEMSPACE;
+extern uint8_t* MEMSPACE_FLAGS;
+
+/* Snapshot which differs from MEMSPACE only in the dirty pages, if any */
+static const Snapshot* synced_snapshot = NULL;
+
+Snapshot* snapshot_create()
+{
+  return (Snapshot*) calloc(1, sizeof(Snapshot));
+}
+
+void snapshot_destroy(Snapshot* const snapshot)
+{
+  if (synced_snapshot == snapshot)
+    synced_snapshot = NULL;
+  free(snapshot);
+}
+
+static void copy_pages(uint8_t* const dst_memory, uint8_t* const dst_flags,
+                       const uint8_t* const src_memory,
+                       const uint8_t* const src_flags, const bool all)
+{
+  const uint8_t* const dirty = memory_get_dirty_pages();
+
+  for (uint32_t page = 0; page < MEMORY_PAGE_COUNT; page++)
+  {
+    if (!all && !dirty[page])
+      continue;
+    const uint32_t offset = page * MEMORY_PAGE_SIZE;
+    memcpy(dst_memory + offset, src_memory + offset, MEMORY_PAGE_SIZE);
+    memcpy(dst_flags + offset, src_flags + offset, MEMORY_PAGE_SIZE);
+  }
+
+  memory_clear_dirty();
+}
+
+/**
+ * @brief Save the machine state into a snapshot. Saving into the snapshot
+ * which was saved or restored last only copies the pages modified since.
+ */
+void snapshot_save(Emulator* const emu, Snapshot* const snapshot)
+{
+  const bool all = !snapshot->valid || synced_snapshot != snapshot;
+
+  // TAR is only brought up to date when read, resync restarts it there
+  timer_a_sync(emu);
+  snapshot->cpu = *emu->cpu;
+  snapshot->debugger = *emu->debugger;
+  snapshot->timerCountingDown = timer_a_counting_down(emu);
+  copy_pages(snapshot->memory, snapshot->flags, MEMSPACE, MEMSPACE_FLAGS, all);
+
+  snapshot->valid = true;
+  synced_snapshot = snapshot;
+}
+
+static void restore_cpu(Cpu* const cpu, const Cpu* const saved)
+{
+  // Peripheral models stay attached to the live CPU
+  Port_1* const p1 = cpu->p1;
+  Usci* const usci = cpu->usci;
+  Bcm* const bcm = cpu->bcm;
+  Timer_a* const timer_a = cpu->timer_a;
+  Multiplier* const mpy = cpu->mpy;
+  FlashController* const flash = cpu->flash;
+  InterruptController interrupts = cpu->interrupts;
+
+  *cpu = *saved;
+
+  // So do their interrupt handlers, only the pending lines are state
+  interrupts.pending = saved->interrupts.pending;
+  cpu->interrupts = interrupts;
+
+  cpu->p1 = p1;
+  cpu->usci = usci;
+  cpu->bcm = bcm;
+  cpu->timer_a = timer_a;
+  cpu->mpy = mpy;
+  cpu->flash = flash;
+}
+
+static void restore_debugger(Debugger* const debugger,
+                             const Debugger* const saved)
+{
+  const bool quit = debugger->quit;
+  const bool debug_mode = debugger->debug_mode;
+
+  *debugger = *saved;
+
+  debugger->quit = quit;
+  debugger->debug_mode = debug_mode;
+  debugger->disassemble_mode = false;
+}
+
+/**
+ * @brief Restore the machine state from a snapshot. Restoring the snapshot
+ * which was saved or restored last only copies the pages modified since.
+ * @return false if the snapshot does not hold a state
+ */
+bool snapshot_restore(Emulator* const emu, Snapshot* const snapshot)
+{
+  if (!snapshot->valid)
+    return false;
+
+  const bool all = synced_snapshot != snapshot;
+  const bool running = emu->cpu->running;
+
+  restore_cpu(emu->cpu, &snapshot->cpu);
+  emu->cpu->running = running;
+  restore_debugger(emu->debugger, &snapshot->debugger);
+  copy_pages(MEMSPACE, MEMSPACE_FLAGS, snapshot->memory, snapshot->flags, all);
+  timer_a_set_counting_down(emu, snapshot->timerCountingDown);
+  machine_resync(emu);
+
+  synced_snapshot = snapshot;
+  return true;
+}
+
+static void put_u16(uint8_t* const buffer, const uint16_t value)
+{
+  buffer[0] = (uint8_t)value;
+  buffer[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* const buffer, const uint32_t value)
+{
+  put_u16(buffer, (uint16_t)value);
+  put_u16(buffer + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t* const buffer)
+{
+  return (uint16_t)(buffer[0] | (buffer[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* const buffer)
+{
+  return get_u16(buffer) | ((uint32_t)get_u16(buffer + 2) << 16);
+}
+
+static bool write_section(FILE* file, const uint32_t tag,
+                          const void* data, const uint32_t length)
+{
+  uint8_t header[8];
+  put_u32(header, tag);
+  put_u32(header + 4, length);
+  return fwrite(header, sizeof header, 1, file) == 1 &&
+    (length == 0 || fwrite(data, length, 1, file) == 1);
+}
+
+bool snapshot_write_file(Emulator* const emu, const char* path)
+{
+  const Debugger* const deb = emu->debugger;
+  uint8_t registers[Snapshot_RegisterCount * 2];
+  uint8_t breakpoints[8 + 4 * MAX_BREAKPOINTS];
+  uint8_t header[sizeof SNAPSHOT_FILE_MAGIC - 1 + 4];
+  uint8_t interrupts[4];
+  uint8_t cycles[8];
+  uint8_t timer;
+  uint32_t length = 0;
+
+  timer_a_sync(emu);
+  for (uint8_t i = 0; i < Snapshot_RegisterCount; i++)
+    put_u16(registers + 2 * i, *(uint16_t*)get_reg_ptr(emu, i));
+
+  put_u32(breakpoints, deb->num_bps);
+  length = 4;
+  for (uint32_t i = 0; i < deb->num_bps; i++, length += 2)
+    put_u16(breakpoints + length, deb->bp_addresses[i]);
+  put_u32(breakpoints + length, deb->num_memory_bps);
+  length += 4;
+  for (uint32_t i = 0; i < deb->num_memory_bps; i++, length += 2)
+    put_u16(breakpoints + length, deb->memory_bp_addresses[i]);
+
+  put_u32(interrupts, emu->cpu->interrupts.pending);
+  timer = timer_a_counting_down(emu);
+  put_u32(cycles, (uint32_t)emu->cpu->cycles);
+  put_u32(cycles + 4, (uint32_t)(emu->cpu->cycles >> 32));
+
+  memcpy(header, SNAPSHOT_FILE_MAGIC, sizeof SNAPSHOT_FILE_MAGIC - 1);
+  put_u32(header + sizeof SNAPSHOT_FILE_MAGIC - 1, SNAPSHOT_FILE_VERSION);
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+
+  const bool ok = fwrite(header, sizeof header, 1, file) == 1 &&
+    write_section(file, Section_Registers, registers, sizeof registers) &&
+    write_section(file, Section_Memory, MEMSPACE, ADDRESS_SPACE_SIZE) &&
+    write_section(file, Section_Flags, MEMSPACE_FLAGS, ADDRESS_SPACE_SIZE) &&
+    write_section(file, Section_Breakpoints, breakpoints, length) &&
+    write_section(file, Section_Interrupts, interrupts, sizeof interrupts) &&
+    write_section(file, Section_Cycles, cycles, sizeof cycles) &&
+    write_section(file, Section_TimerA, &timer, sizeof timer);
+
+  return (fclose(file) == 0) && ok;
+}
+
+static bool read_breakpoints(Emulator* const emu, const uint8_t* data,
+                             const uint32_t length)
+{
+  Debugger* const deb = emu->debugger;
+  uint32_t offset = 4;
+
+  if (length < 8)
+    return false;
+
+  const uint32_t num_bps = get_u32(data);
+  if (num_bps > MAX_BREAKPOINTS || length < 8 + 2 * num_bps)
+    return false;
+  for (uint32_t i = 0; i < num_bps; i++, offset += 2)
+    deb->bp_addresses[i] = get_u16(data + offset);
+
+  const uint32_t num_memory_bps = get_u32(data + offset);
+  offset += 4;
+  if (num_memory_bps > MAX_BREAKPOINTS ||
+      length < offset + 2 * num_memory_bps)
+    return false;
+  for (uint32_t i = 0; i < num_memory_bps; i++, offset += 2)
+    deb->memory_bp_addresses[i] = get_u16(data + offset);
+
+  deb->num_bps = num_bps;
+  deb->num_memory_bps = (uint16_t)num_memory_bps;
+  return true;
+}
+
+static bool read_section(Emulator* const emu, const uint32_t tag,
+                         const uint8_t* data, const uint32_t length)
+{
+  switch (tag)
+  {
+    case Section_Registers:
+      if (length != Snapshot_RegisterCount * 2)
+        return false;
+      for (uint8_t i = 0; i < Snapshot_RegisterCount; i++)
+        *(uint16_t*)get_reg_ptr(emu, i) = get_u16(data + 2 * i);
+      return true;
+    case Section_Memory:
+      if (length != ADDRESS_SPACE_SIZE)
+        return false;
+      memcpy(MEMSPACE, data, ADDRESS_SPACE_SIZE);
+      return true;
+    case Section_Flags:
+      if (length != ADDRESS_SPACE_SIZE)
+        return false;
+      memcpy(MEMSPACE_FLAGS, data, ADDRESS_SPACE_SIZE);
+      return true;
+    case Section_Breakpoints:
+      return read_breakpoints(emu, data, length);
+    case Section_Interrupts:
+      if (length != 4)
+        return false;
+      emu->cpu->interrupts.pending = get_u32(data);
+      return true;
+    case Section_Cycles:
+      if (length != 8)
+        return false;
+      emu->cpu->cycles = get_u32(data) | ((uint64_t)get_u32(data + 4) << 32);
+      return true;
+    case Section_TimerA:
+      if (length != 1)
+        return false;
+      timer_a_set_counting_down(emu, data[0] != 0);
+      return true;
+    default:
+      return true; // Written by a newer version, not needed
+  }
+}
+
+/**
+ * @brief Load a snapshot written by snapshot_write_file(). The call tracer
+ * and CPU statistics are not part of the file and are reset.
+ * @return false if the file could not be read or has another format version
+ */
+bool snapshot_read_file(Emulator* const emu, const char* path)
+{
+  uint8_t header[sizeof SNAPSHOT_FILE_MAGIC - 1 + 4];
+  uint8_t section[8];
+  bool ok = true;
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  if (fread(header, sizeof header, 1, file) != 1 ||
+      memcmp(header, SNAPSHOT_FILE_MAGIC, sizeof SNAPSHOT_FILE_MAGIC - 1) != 0 ||
+      get_u32(header + sizeof SNAPSHOT_FILE_MAGIC - 1) != SNAPSHOT_FILE_VERSION)
+  {
+    fclose(file);
+    return false;
+  }
+
+  // Files written without a TIMA section count up
+  timer_a_set_counting_down(emu, false);
+
+  while (ok && fread(section, sizeof section, 1, file) == 1)
+  {
+    const uint32_t length = get_u32(section + 4);
+    uint8_t* const data = malloc(length ? length : 1);
+    ok = data != NULL &&
+      (length == 0 || fread(data, length, 1, file) == 1) &&
+      read_section(emu, get_u32(section), data, length);
+    free(data);
+  }
+
+  fclose(file);
+
+  // Nothing is known about what changed, the next save copies everything
+  synced_snapshot = NULL;
+  memory_mark_dirty(0, ADDRESS_SPACE_SIZE);
+  reset_cpu_stats(emu);
+  reset_call_tracer(emu);
+  machine_resync(emu);
+  return ok;
+}
@@ -0,0 +1,48 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "../main.h"
+#include "cpu/registers.h"
+#include "../debugger/debugger.h"
+
+#define SNAPSHOT_FILE_MAGIC "M430SNAP"
+#define SNAPSHOT_FILE_VERSION 1u
+
+// Structure containing a full copy of the machine state //
+typedef struct Snapshot {
+  bool valid;                           // Holds a saved state
+  Cpu cpu;                              // Registers, call tracer and stats
+  Debugger debugger;                    // Breakpoints
+  uint8_t memory[ADDRESS_SPACE_SIZE];   // Copy of MEMSPACE
+  uint8_t flags[ADDRESS_SPACE_SIZE];    // Copy of MEMSPACE_FLAGS
+  bool timerCountingDown;               // Timer_A up/down direction
+} Snapshot;
+
+Snapshot* snapshot_create();
+void snapshot_destroy(Snapshot* const snapshot);
+
+void snapshot_save(Emulator* const emu, Snapshot* const snapshot);
+bool snapshot_restore(Emulator* const emu, Snapshot* const snapshot);
+
+bool snapshot_write_file(Emulator* const emu, const char* path);
+bool snapshot_read_file(Emulator* const emu, const char* path);
+
+#endif
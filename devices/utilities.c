@@ -48,13 +48,26 @@ void load_firmware(Emulator *emu, char *file_name, uint16_t virt_addr)
     size = ftell(fd);
     rewind(fd);
 
+    // Images larger than the space up to 0xFFFF are cut off
+    if (size > ADDRESS_SPACE_SIZE - (uint32_t)virt_addr)
+        size = ADDRESS_SPACE_SIZE - (uint32_t)virt_addr;
+
     uint16_t *real_addr = get_addr_ptr(virt_addr);
 
     result = fread(real_addr, 1, size, fd);
+    memory_mark_dirty(virt_addr, result);
 
     sprintf(str, "Placed %d bytes into flash\n\n", result);
     print_console(emu, str);
 
+    if (emu->num_images < Emulator_MaxFirmwareImages)
+    {
+        FirmwareImage* const image = &emu->images[emu->num_images++];
+        image->file_name = file_name;
+        image->address = virt_addr;
+        image->size = result;
+    }
+
     fclose(fd);
 }
 
@@ -321,6 +334,7 @@ const char* LocalHelpStr =
 "**************************************************\n"\
 "*\t\tMSP430-Emulator\n"\
 "* run\t\t\t[Run Program Until Breakpoint is Hit]\n"\
+"* run N [cycles]\t[Run N Instructions or Cycles]\n"\
 "* step [N]\t\t[Step Into Instruction]\n"\
 "* dump [HEX_ADDR|Rn]\t[Dump Memory direct or at register value]\n"\
 "* set [HEX_ADDR|Rn]\t[Set Memory or Register Location]\n"\
@@ -333,6 +347,16 @@ const char* LocalHelpStr =
 "* reset\t\t\t[Reset Machine]\n"\
 "* stats\t\t\t[Display CPU Statistics]\n"\
 "* trace [ON|OFF]\t\t[Enable/disable instruction trace]\n"\
+"* coverage [lcov|save FILE]\t[Show coverage or write lcov/bitmap file]\n"\
+"* snapshot save|load [FILE]\t[Save/restore machine state, in memory or FILE]\n"\
+"* irq [N]\t\t[Show interrupts or request vector N]\n"\
+"* uart\t\t\t[Show UART state]\n"\
+"* p1 [LEVELS]\t\t[Show port 1 or drive its input pins, hex]\n"\
+"* flash\t\t\t[Show the flash controller state]\n"\
+"* device\t\t[Show the emulated part]\n"\
+"* journal on [N]|off\t[Record the last N steps for reverse execution]\n"\
+"* rs, rstep [N]\t\t[Step N Instructions backward]\n"\
+"* rc, rcontinue\t\t[Run backward to the previous breakpoint]\n"\
 "* quit\t\t\t[Exit program]\n"\
 "**************************************************\n";
 
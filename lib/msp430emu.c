@@ -0,0 +1,304 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+//##########+++ libmsp430emu +++##########
+//# The C API of lib/msp430emu.h on top of the emulator modules.
+//# A Msp430Emu owns an Emulator set up the way main.c sets it up,
+//# minus the host streams, the signal handler and the debugger
+//# console. Internal stop reasons are mapped to the public enum,
+//# whose values are part of the API.
+//########################################
+
+#include "msp430emu.h"
+#include "../main.h"
+#include "../debugger/io.h"
+#include "../devices/machine.h"
+#include "../devices/snapshot.h"
+#include "../devices/cpu/interrupts.h"
+
+extern uint8_t* MEMSPACE;
+
+struct Msp430Emu {
+  Emulator* emu;
+};
+
+struct Msp430Snapshot {
+  Snapshot* snapshot;
+};
+
+static Msp430Emu* instance = NULL; // The machine state is global
+
+int msp430emu_api_version(void)
+{
+  return MSP430EMU_API_VERSION;
+}
+
+Msp430Emu* msp430emu_create(const char* device)
+{
+  const DeviceProfile* const profile =
+    device_find_profile(device != NULL ? device : DEVICE_DEFAULT_NAME);
+
+  if (instance != NULL || profile == NULL)
+    return NULL;
+
+  Emulator* const emu = (Emulator*) calloc(1, sizeof(Emulator));
+  emu->debugger = (Debugger*) calloc(1, sizeof(Debugger));
+  emu->device = profile;
+  emu->quiet = true;
+
+  initialize_msp_memspace(profile);
+  machine_initialize(emu);
+  setup_debugger(emu);
+
+  instance = (Msp430Emu*) calloc(1, sizeof(Msp430Emu));
+  instance->emu = emu;
+  return instance;
+}
+
+void msp430emu_destroy(Msp430Emu* lib)
+{
+  if (lib == NULL)
+    return;
+
+  Emulator* const emu = lib->emu;
+  machine_uninitialize(emu);
+  snapshot_destroy(emu->snapshot);
+  free(emu->debugger);
+  free(emu);
+  free(lib);
+  instance = NULL;
+}
+
+void msp430emu_set_callbacks(Msp430Emu* lib, const Msp430Callbacks* callbacks,
+                             void* context)
+{
+  Emulator* const emu = lib->emu;
+
+  memset(&emu->host_io, 0, sizeof emu->host_io);
+  if (callbacks != NULL)
+  {
+    emu->host_io.console = callbacks->console;
+    emu->host_io.put_char = callbacks->put_char;
+    emu->host_io.get_char = callbacks->get_char;
+  }
+  emu->host_io.context = context;
+  emu->quiet = emu->host_io.console == NULL;
+}
+
+bool msp430emu_load_file(Msp430Emu* lib, const char* path, int32_t address)
+{
+  FILE* const file = fopen(path, "rb");
+  uint8_t* data = (uint8_t*) malloc(ADDRESS_SPACE_SIZE);
+  size_t size = 0;
+
+  if (file != NULL)
+  {
+    // Images larger than the address space are cut off
+    size = fread(data, 1, ADDRESS_SPACE_SIZE, file);
+    fclose(file);
+  }
+
+  const bool ok = file != NULL && msp430emu_load_image(lib, data, size, address);
+  free(data);
+  return ok;
+}
+
+bool msp430emu_load_image(Msp430Emu* lib, const void* data, size_t size,
+                          int32_t address)
+{
+  if (address == MSP430EMU_FLASH_START)
+    address = lib->emu->device->flashStart;
+  if (address < 0 || address >= ADDRESS_SPACE_SIZE)
+    return false;
+
+  if (size > (size_t)(ADDRESS_SPACE_SIZE - address))
+    size = ADDRESS_SPACE_SIZE - address;
+  return msp430emu_write_memory(lib, (uint16_t)address, data, size);
+}
+
+static void clear_exit(Emulator* const emu)
+{
+  Debugger* const deb = emu->debugger;
+
+  emu->exit_code = 0;
+  deb->quit = false;
+  deb->error = 0;
+  deb->stop_reason = StopReason_None;
+}
+
+void msp430emu_reset(Msp430Emu* lib)
+{
+  initialize_msp_registers(lib->emu);
+  reset_interrupts(lib->emu);
+  clear_exit(lib->emu);
+}
+
+static Msp430StopReason public_stop_reason(const StopReason reason)
+{
+  switch (reason)
+  {
+    case StopReason_Exit: return Msp430Stop_Exit;
+    case StopReason_Breakpoint: return Msp430Stop_Breakpoint;
+    case StopReason_Watchpoint: return Msp430Stop_Watchpoint;
+    case StopReason_IllegalInstruction: return Msp430Stop_IllegalInstruction;
+    case StopReason_LowPowerStuck: return Msp430Stop_LowPowerStuck;
+    case StopReason_InstructionLimit: return Msp430Stop_InstructionLimit;
+    case StopReason_CycleLimit: return Msp430Stop_CycleLimit;
+    case StopReason_IdleLoopStuck: return Msp430Stop_IdleLoopStuck;
+    default: return Msp430Stop_None;
+  }
+}
+
+Msp430StopReason msp430emu_run(Msp430Emu* lib, uint64_t max_instructions)
+{
+  return public_stop_reason(machine_run(lib->emu, max_instructions, 0));
+}
+
+Msp430StopReason msp430emu_run_cycles(Msp430Emu* lib, uint64_t cycles)
+{
+  return public_stop_reason(machine_run(lib->emu, 0, cycles));
+}
+
+Msp430StopReason msp430emu_step(Msp430Emu* lib)
+{
+  return msp430emu_run(lib, 1);
+}
+
+void msp430emu_request_interrupt(Msp430Emu* lib, unsigned vector)
+{
+  if (vector < Interrupt_Reset)
+    interrupt_request(lib->emu, (uint8_t)vector);
+}
+
+int msp430emu_exit_code(const Msp430Emu* lib)
+{
+  return lib->emu->exit_code;
+}
+
+uint64_t msp430emu_cycles(const Msp430Emu* lib)
+{
+  return lib->emu->cpu->cycles;
+}
+
+uint64_t msp430emu_instructions(const Msp430Emu* lib)
+{
+  return lib->emu->cpu->stats.instructions.executed;
+}
+
+uint16_t msp430emu_get_register(const Msp430Emu* lib, unsigned reg)
+{
+  return reg < 16 ? (uint16_t)*get_reg_ptr(lib->emu, (uint8_t)reg) : 0;
+}
+
+void msp430emu_set_register(Msp430Emu* lib, unsigned reg, uint16_t value)
+{
+  if (reg < 16)
+    *get_reg_ptr(lib->emu, (uint8_t)reg) = (int16_t)value;
+}
+
+bool msp430emu_read_memory(const Msp430Emu* lib, uint16_t address,
+                           void* data, size_t size)
+{
+  (void)lib;
+  if (size > (size_t)(ADDRESS_SPACE_SIZE - address))
+    return false;
+  memcpy(data, MEMSPACE + address, size);
+  return true;
+}
+
+bool msp430emu_write_memory(Msp430Emu* lib, uint16_t address,
+                            const void* data, size_t size)
+{
+  (void)lib;
+  if (size > (size_t)(ADDRESS_SPACE_SIZE - address))
+    return false;
+  memcpy(MEMSPACE + address, data, size);
+  memory_mark_dirty(address, (uint32_t)size);
+  return true;
+}
+
+bool msp430emu_add_breakpoint(Msp430Emu* lib, uint16_t address)
+{
+  return add_breakpoint(lib->emu, address);
+}
+
+bool msp430emu_remove_breakpoint(Msp430Emu* lib, uint16_t address)
+{
+  return remove_breakpoint(lib->emu, address);
+}
+
+static uint8_t watch_flags(const unsigned accesses)
+{
+  return (accesses & Msp430Watch_Read ? MemoryCell_Flag_Read : 0) |
+    (accesses & Msp430Watch_Write ? MemoryCell_Flag_Written : 0);
+}
+
+bool msp430emu_add_watchpoint(Msp430Emu* lib, uint16_t address,
+                              unsigned accesses)
+{
+  return watch_flags(accesses) != 0 &&
+    add_memory_breakpoint(lib->emu, address, watch_flags(accesses));
+}
+
+bool msp430emu_remove_watchpoint(Msp430Emu* lib, uint16_t address,
+                                 unsigned accesses)
+{
+  return remove_memory_breakpoint(lib->emu, address, watch_flags(accesses));
+}
+
+Msp430Snapshot* msp430emu_save(Msp430Emu* lib)
+{
+  Msp430Snapshot* const snapshot =
+    (Msp430Snapshot*) calloc(1, sizeof(Msp430Snapshot));
+
+  snapshot->snapshot = snapshot_create();
+  snapshot_save(lib->emu, snapshot->snapshot);
+  return snapshot;
+}
+
+/**
+ * @brief Go back to a saved state, which was not stopped by an exit
+ */
+bool msp430emu_restore(Msp430Emu* lib, Msp430Snapshot* snapshot)
+{
+  if (!snapshot_restore(lib->emu, snapshot->snapshot))
+    return false;
+  clear_exit(lib->emu);
+  return true;
+}
+
+void msp430emu_free_snapshot(Msp430Snapshot* snapshot)
+{
+  if (snapshot == NULL)
+    return;
+  snapshot_destroy(snapshot->snapshot);
+  free(snapshot);
+}
+
+bool msp430emu_save_file(Msp430Emu* lib, const char* path)
+{
+  return snapshot_write_file(lib->emu, path);
+}
+
+bool msp430emu_restore_file(Msp430Emu* lib, const char* path)
+{
+  if (!snapshot_read_file(lib->emu, path))
+    return false;
+  clear_exit(lib->emu);
+  return true;
+}
@@ -0,0 +1,157 @@
+/*
+  MSP430 Emulator
+  Copyright (C) 2020 Rudolf Geosits (rgeosits@live.esu.edu)
+
+  "MSP430 Emulator" is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  "MSP430 Emulator" is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MSP430EMU_H_
+#define _MSP430EMU_H_
+
+// libmsp430emu, the emulator as a library for test harnesses and
+// co-simulations. It holds no readline, signal or command line code,
+// and prints nothing unless a console callback is set.
+//
+//   Msp430Emu* emu = msp430emu_create(NULL);
+//   msp430emu_load_file(emu, "firmware.bin", MSP430EMU_FLASH_START);
+//   msp430emu_reset(emu);
+//   if (msp430emu_run(emu, 1000000) == Msp430Stop_Exit)
+//     status = msp430emu_exit_code(emu);
+//   msp430emu_destroy(emu);
+//
+// The machine state lives in process globals, so there is at most one
+// emulator per process at a time. Fork to run tests in parallel, or
+// restore a snapshot between tests.
+//
+// Within an API version functions and types only get added, existing
+// values and signatures do not change.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSP430EMU_API_VERSION 1
+#define MSP430EMU_FLASH_START (-1) // Load at the flash start of the device
+
+#if defined(__GNUC__)
+#define MSP430EMU_API __attribute__((visibility("default")))
+#else
+#define MSP430EMU_API
+#endif
+
+typedef struct Msp430Emu Msp430Emu;
+typedef struct Msp430Snapshot Msp430Snapshot;
+
+// Why msp430emu_run() returned //
+typedef enum {
+  Msp430Stop_None = 0,               // Still running, not returned by run
+  Msp430Stop_Exit = 1,               // Emulator call 0x0000, see exit_code
+  Msp430Stop_Breakpoint = 2,
+  Msp430Stop_Watchpoint = 3,
+  Msp430Stop_IllegalInstruction = 4,
+  Msp430Stop_LowPowerStuck = 5,      // CPU off without a wake-up source
+  Msp430Stop_InstructionLimit = 6,   // Executed the requested instructions
+  Msp430Stop_CycleLimit = 7,         // The requested cycles passed
+  Msp430Stop_IdleLoopStuck = 8,      // Spinning without a wake-up source
+} Msp430StopReason;
+
+// Accesses a watchpoint stops after //
+enum {
+  Msp430Watch_Read = 1,
+  Msp430Watch_Write = 2,
+};
+
+// Host console hooks, NULL keeps the default //
+typedef struct Msp430Callbacks {
+  void (*console)(void* context, const char* text); // Emulator messages, dropped by default
+  void (*put_char)(void* context, uint8_t c);       // Emulator call 0x0001, stdout by default
+  int (*get_char)(void* context);   // Emulator call 0x0002, -1 at the end, stdin by default
+} Msp430Callbacks;
+
+MSP430EMU_API int msp430emu_api_version(void);
+
+// Lifetime, NULL device selects the default part. Returns NULL for an
+// unknown device or while another emulator exists
+MSP430EMU_API Msp430Emu* msp430emu_create(const char* device);
+MSP430EMU_API void msp430emu_destroy(Msp430Emu* emu);
+MSP430EMU_API void msp430emu_set_callbacks(Msp430Emu* emu,
+                                           const Msp430Callbacks* callbacks,
+                                           void* context);
+
+// Firmware, address is MSP430EMU_FLASH_START or a byte address
+MSP430EMU_API bool msp430emu_load_file(Msp430Emu* emu, const char* path,
+                                       int32_t address);
+MSP430EMU_API bool msp430emu_load_image(Msp430Emu* emu, const void* data,
+                                        size_t size, int32_t address);
+
+// Execution. Registers take their power up values, PC the reset vector.
+// Memory and peripherals keep their state
+MSP430EMU_API void msp430emu_reset(Msp430Emu* emu);
+// Run until the CPU stops, for at most max_instructions (0: no limit).
+// A breakpoint at the current PC does not stop the first instruction
+MSP430EMU_API Msp430StopReason msp430emu_run(Msp430Emu* emu,
+                                             uint64_t max_instructions);
+// Run for a quantum of cycles (0: no limit), ending on the first
+// instruction boundary at or past it. A sleeping CPU ends exactly on it
+MSP430EMU_API Msp430StopReason msp430emu_run_cycles(Msp430Emu* emu,
+                                                    uint64_t cycles);
+MSP430EMU_API Msp430StopReason msp430emu_step(Msp430Emu* emu);
+// Raise an edge triggered interrupt, vector 0 - 30 (0xFFC0 - 0xFFFC), one
+// which none of the device's peripherals use
+MSP430EMU_API void msp430emu_request_interrupt(Msp430Emu* emu,
+                                               unsigned vector);
+MSP430EMU_API int msp430emu_exit_code(const Msp430Emu* emu);
+MSP430EMU_API uint64_t msp430emu_cycles(const Msp430Emu* emu);
+MSP430EMU_API uint64_t msp430emu_instructions(const Msp430Emu* emu);
+
+// Registers R0 (PC) to R15
+MSP430EMU_API uint16_t msp430emu_get_register(const Msp430Emu* emu,
+                                              unsigned reg);
+MSP430EMU_API void msp430emu_set_register(Msp430Emu* emu, unsigned reg,
+                                          uint16_t value);
+
+// Memory as the debugger sees it, peripherals do not notice the access
+MSP430EMU_API bool msp430emu_read_memory(const Msp430Emu* emu,
+                                         uint16_t address, void* data,
+                                         size_t size);
+MSP430EMU_API bool msp430emu_write_memory(Msp430Emu* emu, uint16_t address,
+                                          const void* data, size_t size);
+
+// Breakpoints stop before the instruction, watchpoints after the access
+MSP430EMU_API bool msp430emu_add_breakpoint(Msp430Emu* emu, uint16_t address);
+MSP430EMU_API bool msp430emu_remove_breakpoint(Msp430Emu* emu,
+                                               uint16_t address);
+MSP430EMU_API bool msp430emu_add_watchpoint(Msp430Emu* emu, uint16_t address,
+                                            unsigned accesses);
+MSP430EMU_API bool msp430emu_remove_watchpoint(Msp430Emu* emu,
+                                               uint16_t address,
+                                               unsigned accesses);
+
+// Snapshots of the machine state, in memory or in a file
+MSP430EMU_API Msp430Snapshot* msp430emu_save(Msp430Emu* emu);
+MSP430EMU_API bool msp430emu_restore(Msp430Emu* emu,
+                                     Msp430Snapshot* snapshot);
+MSP430EMU_API void msp430emu_free_snapshot(Msp430Snapshot* snapshot);
+MSP430EMU_API bool msp430emu_save_file(Msp430Emu* emu, const char* path);
+MSP430EMU_API bool msp430emu_restore_file(Msp430Emu* emu, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
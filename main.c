@@ -20,8 +20,22 @@
 
 #include "main.h"
 #include <stdio.h>
+#include <readline/readline.h>
+#include <readline/history.h>
 #include <fcntl.h>
 #include "debugger/io.h"
+#include "devices/snapshot.h"
+#include "devices/machine.h"
+#include "devices/cpu/interrupts.h"
+#include "devices/peripherals/usci.h"
+#include "devices/peripherals/port1.h"
+#include "debugger/gdb_stub.h"
+#include "debugger/batch.h"
+#include "debugger/limits.h"
+#include "debugger/fuzz.h"
+#include "debugger/replay.h"
+#include "debugger/cosim.h"
+#include "debugger/network.h"
 
 static void printVersion()
 {
@@ -38,16 +52,203 @@ static void printHelp()
     printf("-v Print program version\n");
     printf("-h Print this help\n");
     printf("-r Run after loading\n");
+    printf("--coverage-lcov FILE Write an lcov tracefile at exit\n");
+    printf("--coverage-bitmap FILE Accumulate coverage bitmaps in FILE\n");
+    printf("--coverage-merge FILE Merge a coverage bitmap file at start\n");
+    printf("--coverage-lines FILE Address to source line map for lcov, e.g.\n"
+           "    the output of msp430-elf-objdump --dwarf=decodedline\n");
+    printf("--snapshot FILE Restore a machine snapshot after loading\n");
+    printf("--journal N Record the last N steps for reverse execution\n");
+    printf("--no-idle-skip Execute idle loops instead of skipping them\n");
+    printf("--uart-in SPEC Feed the UART from a file, pipe, '-' (stdin)\n"
+           "    or unix:PATH (Unix domain socket)\n");
+    printf("--uart-out SPEC Write UART output to a file, pipe, '-' or unix:PATH\n");
+    printf("--uart-fast UART frames take no time\n");
+    printf("--p1-log FILE Log port 1 pin changes as binary records\n");
+    printf("--p1-in FILE Replay port 1 input changes from a log file\n");
+    printf("--device NAME Emulate the given part, 'list' shows the profiles\n"
+           "    (default " DEVICE_DEFAULT_NAME ")\n");
+    printf("--device-file FILE Add device profiles from FILE\n");
+    printf("--batch FILE Read debugger commands from FILE ('-' is stdin)\n"
+           "    instead of prompting, quit at its end\n");
+    printf("--exit-on-stop Quit with status %d when the CPU stops for any\n"
+           "    reason but the firmware's exit call\n", Batch_StoppedExitCode);
+    printf("--status FILE Write the exit code, stop reason, error and PC\n"
+           "    as JSON to FILE ('-' is stdout)\n");
+    printf("--max-instructions N Stop with status %d after N instructions\n",
+           Limits_ExitCode);
+    printf("--max-cycles N Stop with status %d after N CPU cycles\n",
+           Limits_ExitCode);
+    printf("--timeout SECONDS Stop with status %d after SECONDS of host time\n",
+           Limits_ExitCode);
+    printf("--fuzz DIR|FILE Fuzz the harness with the corpus in DIR, or\n"
+           "    replay the input in FILE\n");
+    printf("--fuzz-harness ADDR Entry of void harness(uint8_t* data, uint16_t size)\n");
+    printf("--fuzz-buffer ADDR:SIZE RAM receiving the input, ADDR in hex\n");
+    printf("--fuzz-stack-limit ADDR Lowest stack address, guarded by a canary\n");
+    printf("--fuzz-max-instructions N Inputs running longer hang (default %d)\n",
+           Fuzz_DefaultMaxInstructions);
+    printf("--fuzz-runs N Stop fuzzing after N inputs\n");
+    printf("--afl Run as an AFL fork server from the harness entry, the\n"
+           "    input is the --fuzz FILE (AFL's @@) or stdin\n");
+    printf("--record FILE Log the input the run gets from the host to FILE\n");
+    printf("--replay FILE Take the host input from a --record log instead\n");
+    printf("--cosim SPEC Run in quanta requested by a simulator listening\n"
+           "    on unix:PATH, see debugger/cosim.h\n");
+    printf("--mailbox ADDR:SIZE:FILE Share RAM at ADDR (hex) with the\n"
+           "    simulator through FILE, synchronized at quantum barriers\n");
+    printf("--cosim-uart Exchange the UART bytes with the simulator\n");
+    printf("--network FILE Simulate the nodes and links of FILE, one\n"
+           "    emulator process per node, see debugger/network.c\n");
+    printf("--lookahead N Network link latency in cycles (default %d)\n",
+           Network_DefaultLookahead);
+    printf("--network-cycles N Stop the network after N cycles\n");
+    printf("--gdb SPEC Wait for GDB on a TCP port of the loopback interface\n"
+           "    or on unix:PATH (Unix domain socket)\n");
+}
+
+enum {
+    Option_CoverageLcov = 0x100,
+    Option_CoverageBitmap,
+    Option_CoverageMerge,
+    Option_CoverageLines,
+    Option_Snapshot,
+    Option_Journal,
+    Option_NoIdleSkip,
+    Option_UartIn,
+    Option_UartOut,
+    Option_UartFast,
+    Option_P1Log,
+    Option_P1Stimulus,
+    Option_Device,
+    Option_DeviceFile,
+    Option_Gdb,
+    Option_Batch,
+    Option_ExitOnStop,
+    Option_Status,
+    Option_MaxInstructions,
+    Option_MaxCycles,
+    Option_Timeout,
+    Option_Fuzz,
+    Option_FuzzHarness,
+    Option_FuzzBuffer,
+    Option_FuzzStackLimit,
+    Option_FuzzMaxInstructions,
+    Option_FuzzRuns,
+    Option_Afl,
+    Option_Record,
+    Option_Replay,
+    Option_Cosim,
+    Option_Mailbox,
+    Option_CosimUart,
+    Option_Network,
+    Option_Lookahead,
+    Option_NetworkCycles,
+};
+
+static const struct option LongOptions[] = {
+    { "coverage-lcov", required_argument, NULL, Option_CoverageLcov },
+    { "coverage-bitmap", required_argument, NULL, Option_CoverageBitmap },
+    { "coverage-merge", required_argument, NULL, Option_CoverageMerge },
+    { "coverage-lines", required_argument, NULL, Option_CoverageLines },
+    { "snapshot", required_argument, NULL, Option_Snapshot },
+    { "journal", required_argument, NULL, Option_Journal },
+    { "no-idle-skip", no_argument, NULL, Option_NoIdleSkip },
+    { "uart-in", required_argument, NULL, Option_UartIn },
+    { "uart-out", required_argument, NULL, Option_UartOut },
+    { "uart-fast", no_argument, NULL, Option_UartFast },
+    { "p1-log", required_argument, NULL, Option_P1Log },
+    { "p1-in", required_argument, NULL, Option_P1Stimulus },
+    { "device", required_argument, NULL, Option_Device },
+    { "device-file", required_argument, NULL, Option_DeviceFile },
+    { "gdb", required_argument, NULL, Option_Gdb },
+    { "batch", required_argument, NULL, Option_Batch },
+    { "exit-on-stop", no_argument, NULL, Option_ExitOnStop },
+    { "status", required_argument, NULL, Option_Status },
+    { "max-instructions", required_argument, NULL, Option_MaxInstructions },
+    { "max-cycles", required_argument, NULL, Option_MaxCycles },
+    { "timeout", required_argument, NULL, Option_Timeout },
+    { "fuzz", required_argument, NULL, Option_Fuzz },
+    { "fuzz-harness", required_argument, NULL, Option_FuzzHarness },
+    { "fuzz-buffer", required_argument, NULL, Option_FuzzBuffer },
+    { "fuzz-stack-limit", required_argument, NULL, Option_FuzzStackLimit },
+    { "fuzz-max-instructions", required_argument, NULL, Option_FuzzMaxInstructions },
+    { "fuzz-runs", required_argument, NULL, Option_FuzzRuns },
+    { "afl", no_argument, NULL, Option_Afl },
+    { "record", required_argument, NULL, Option_Record },
+    { "replay", required_argument, NULL, Option_Replay },
+    { "cosim", required_argument, NULL, Option_Cosim },
+    { "mailbox", required_argument, NULL, Option_Mailbox },
+    { "cosim-uart", no_argument, NULL, Option_CosimUart },
+    { "network", required_argument, NULL, Option_Network },
+    { "lookahead", required_argument, NULL, Option_Lookahead },
+    { "network-cycles", required_argument, NULL, Option_NetworkCycles },
+    { NULL, 0, NULL, 0 }
+};
+
+static Coverage* getCoverage(Emulator* const emu)
+{
+    if (emu->coverage == NULL)
+        emu->coverage = coverage_create();
+    return emu->coverage;
+}
+
+// Remember a -b image, loaded once the device profile is known
+static bool requestFirmware(Emulator* const emu, char* file_name, const int offset)
+{
+    if (emu->num_images == Emulator_MaxFirmwareImages)
+    {
+        printf("Too many firmware images, at most %d\n", Emulator_MaxFirmwareImages);
+        return false;
+    }
+
+    FirmwareImage* const image = &emu->images[emu->num_images++];
+    image->file_name = file_name;
+    image->address = (uint16_t)offset;
+    image->at_flash_start = offset < 0;
+    return true;
+}
+
+static bool selectDevice(Emulator* const emu)
+{
+    const char* const name = emu->device_name != NULL ?
+        emu->device_name : DEVICE_DEFAULT_NAME;
+
+    if (!strcmp(name, "list"))
+    {
+        device_list_profiles();
+        return false;
+    }
+
+    emu->device = device_find_profile(name);
+    if (emu->device == NULL)
+    {
+        printf("Unknown device %s, see --device list\n", name);
+        return false;
+    }
+
+    initialize_msp_memspace(emu->device);
+
+    FirmwareImage requested[Emulator_MaxFirmwareImages];
+    const uint8_t count = emu->num_images;
+    memcpy(requested, emu->images, sizeof requested);
+    emu->num_images = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        load_firmware(emu, requested[i].file_name,
+                      requested[i].at_flash_start ?
+                      emu->device->flashStart : requested[i].address);
+    }
+    return true;
 }
 
 static bool setEmulatorConfig(Emulator* const emu, int argc, char *argv[])
 {
     int option;
-    int offset = 0xC000;
+    int offset = -1; // Start of the device's flash
     emu->do_trace = false;
     emu->binary = NULL;
-    initialize_msp_memspace();
-    while ((option = getopt(argc, argv, "hvrm:b:")) != -1)
+    while ((option = getopt_long(argc, argv, "hvrm:b:", LongOptions, NULL)) != -1)
     {
         switch (option)
         {
@@ -61,30 +262,208 @@ static bool setEmulatorConfig(Emulator* const emu, int argc, char *argv[])
                 offset = strtol(optarg, (char **)NULL, 16);
                 break;
             case 'b':
-                load_firmware(emu, optarg, offset);
+                if (!requestFirmware(emu, optarg, offset))
+                    return false;
                 break;
             case 'r':
                 emu->start_running = true;
                 break;
+            case Option_CoverageLcov:
+                getCoverage(emu)->lcovFile = optarg;
+                break;
+            case Option_CoverageBitmap:
+                getCoverage(emu)->bitmapFile = optarg;
+                break;
+            case Option_CoverageLines:
+                getCoverage(emu)->lineMapFile = optarg;
+                break;
+            case Option_Snapshot:
+                emu->snapshot_file = optarg;
+                break;
+            case Option_Journal:
+                journal_enable(emu, (uint32_t)strtoul(optarg, NULL, 0));
+                break;
+            case Option_NoIdleSkip:
+                emu->no_idle_skip = true;
+                break;
+            case Option_UartIn:
+                emu->uart_in = optarg;
+                break;
+            case Option_UartOut:
+                emu->uart_out = optarg;
+                break;
+            case Option_UartFast:
+                emu->uart_fast = true;
+                break;
+            case Option_P1Log:
+                emu->p1_log = optarg;
+                break;
+            case Option_P1Stimulus:
+                emu->p1_stimulus = optarg;
+                break;
+            case Option_Device:
+                emu->device_name = optarg;
+                break;
+            case Option_DeviceFile:
+                if (!device_load_profiles(optarg))
+                {
+                    printf("Could not load device profiles %s\n", optarg);
+                    return false;
+                }
+                break;
+            case Option_Gdb:
+                if (!strncmp(optarg, "unix:", strlen("unix:")))
+                    emu->gdb_socket = optarg + strlen("unix:");
+                else if ((emu->port = atoi(optarg)) <= 0)
+                {
+                    printf("Invalid GDB port %s\n", optarg);
+                    return false;
+                }
+                break;
+            case Option_Batch:
+                if (!batch_open_script(emu, optarg))
+                {
+                    printf("Could not open batch script %s\n", optarg);
+                    return false;
+                }
+                break;
+            case Option_ExitOnStop:
+                emu->exit_on_stop = true;
+                break;
+            case Option_Status:
+                emu->status_file = optarg;
+                break;
+            case Option_MaxInstructions:
+                limits_get(emu)->maxInstructions = strtoull(optarg, NULL, 0);
+                break;
+            case Option_MaxCycles:
+                limits_get(emu)->maxCycles = strtoull(optarg, NULL, 0);
+                break;
+            case Option_Timeout:
+                limits_get(emu)->maxSeconds = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case Option_Fuzz:
+                fuzz_get(emu)->path = optarg;
+                break;
+            case Option_FuzzHarness:
+                fuzz_get(emu)->harnessPc = (uint16_t)strtol(optarg, NULL, 16);
+                break;
+            case Option_FuzzBuffer:
+                if (!fuzz_parse_buffer(fuzz_get(emu), optarg))
+                {
+                    printf("Invalid fuzz buffer %s, expected ADDR:SIZE\n", optarg);
+                    return false;
+                }
+                break;
+            case Option_FuzzStackLimit:
+                fuzz_get(emu)->stackLimit = (uint16_t)strtol(optarg, NULL, 16);
+                break;
+            case Option_FuzzMaxInstructions:
+                fuzz_get(emu)->maxInstructions = strtoull(optarg, NULL, 0);
+                break;
+            case Option_FuzzRuns:
+                fuzz_get(emu)->runs = strtoull(optarg, NULL, 0);
+                break;
+            case Option_Afl:
+                fuzz_get(emu)->forkServer = true;
+                break;
+            case Option_Record:
+            case Option_Replay:
+                replay_get(emu)->path = optarg;
+                emu->replay->recording = option == Option_Record;
+                break;
+            case Option_Cosim:
+                cosim_get(emu)->spec = optarg;
+                break;
+            case Option_Mailbox:
+                if (!cosim_add_mailbox(cosim_get(emu), optarg))
+                {
+                    printf("Invalid mailbox %s, expected ADDR:SIZE:FILE\n", optarg);
+                    return false;
+                }
+                break;
+            case Option_CosimUart:
+                cosim_get(emu)->uartLink = true;
+                break;
+            case Option_Network:
+                network_get(emu)->path = optarg;
+                break;
+            case Option_Lookahead:
+                network_get(emu)->lookahead = strtoull(optarg, NULL, 0);
+                break;
+            case Option_NetworkCycles:
+                network_get(emu)->maxCycles = strtoull(optarg, NULL, 0);
+                break;
+            case Option_CoverageMerge:
+                if (!coverage_merge_bitmap_file(getCoverage(emu), optarg))
+                {
+                    printf("Could not merge coverage bitmap %s\n", optarg);
+                    return false;
+                }
+                break;
             default:
                 printf("Unknown option\n");
                 return false;
         }
     }
-    return true;
+    return selectDevice(emu);
 }
 
-static void initializeMsp430(Emulator* const emu)
+static bool connectHostStreams(Emulator* const emu)
 {
-    emu->cpu       = (Cpu *) calloc(1, sizeof(Cpu));
-    initialize_msp_registers(emu);
+    if ((emu->uart_in != NULL || emu->uart_out != NULL) && emu->cpu->usci == NULL)
+    {
+        printf("%s has no UART\n", emu->device->name);
+        return false;
+    }
+    if ((emu->p1_log != NULL || emu->p1_stimulus != NULL) && emu->cpu->p1 == NULL)
+    {
+        printf("%s has no port 1\n", emu->device->name);
+        return false;
+    }
+    if (replay_has_uart_input(emu))
+    {
+        if (emu->cpu->usci == NULL)
+        {
+            printf("%s has no UART\n", emu->device->name);
+            return false;
+        }
+        usci_replay_input(emu);
+    }
+    else if (emu->uart_in != NULL && !usci_connect_input(emu, emu->uart_in))
+    {
+        printf("Could not open UART input %s\n", emu->uart_in);
+        return false;
+    }
+    if (emu->uart_out != NULL && !usci_connect_output(emu, emu->uart_out))
+    {
+        printf("Could not open UART output %s\n", emu->uart_out);
+        return false;
+    }
+    if (emu->p1_log != NULL && !port_1_open_log(emu, emu->p1_log))
+    {
+        printf("Could not create port 1 log %s\n", emu->p1_log);
+        return false;
+    }
+    if (emu->p1_stimulus != NULL && !port_1_open_stimulus(emu, emu->p1_stimulus))
+    {
+        printf("Could not open port 1 input %s\n", emu->p1_stimulus);
+        return false;
+    }
+    return true;
 }
 
 static void deinitializeMsp430(Emulator* const emu)
 {
-    uninitialize_msp_memspace();
-    Cpu* const cpu = emu->cpu;
-    free(cpu);
+    gdb_close(emu);
+    batch_close_script(emu);
+    coverage_finish(emu);
+    journal_disable(emu);
+    limits_destroy(emu);
+    fuzz_destroy(emu);
+    replay_stop(emu);
+    cosim_destroy(emu);
+    machine_uninitialize(emu);
 }
 
 static void handleCommanding(Emulator* const emu)
@@ -93,7 +472,25 @@ static void handleCommanding(Emulator* const emu)
     // Handle debugger when CPU is not running
     if (!cpu->running)
     {
+        usci_flush(emu);
+        port_1_flush_log(emu);
+        if (gdb_is_attached(emu))
+        {
+            gdb_serve(emu);
+            return;
+        }
+        if (emu->script != NULL || emu->exit_on_stop)
+        {
+            batch_handle_stop(emu);
+            return;
+        }
         char* buffer = readline(NULL);
+        if (buffer == NULL)
+        {
+            // End of input, nobody is left to type commands
+            emu->debugger->quit = true;
+            return;
+        }
         const int bufferLength = strlen(buffer);
         exec_cmd(emu, buffer, bufferLength);
         free(buffer);
@@ -103,13 +500,34 @@ static void handleCommanding(Emulator* const emu)
 static void handleProcessingStep(Emulator* const emu)
 {
     Cpu* const cpu = emu->cpu;
-    if (!cpu->running)
-        return;
-    // Handle Breakpoints
-    if (handle_breakpoints(emu))
-        return;
-    // Instruction Decoder
-    decode(emu, fetch(emu, true), EXECUTE);
+    Debugger* const deb = emu->debugger;
+    const bool wasRunning = cpu->running;
+    // Run without looking at peripherals until the next event is due,
+    // an instruction may schedule an earlier one by writing a register
+    while (cpu->running && !deb->quit &&
+           cpu->cycles < scheduler_next_cycle(emu->scheduler))
+    {
+        service_interrupts(emu);
+        // Handle Breakpoints
+        if (handle_breakpoints(emu))
+            return;
+        // Skip time while in a low power mode
+        const LowPowerState lowPower = handle_low_power_mode(emu);
+        if (lowPower == LowPower_Stuck)
+        {
+            cpu->running = false;
+            deb->debug_mode = true;
+            deb->stop_reason = StopReason_LowPowerStuck;
+            return;
+        }
+        if (lowPower == LowPower_Sleeping)
+            continue;
+        // Instruction Decoder
+        decode(emu, fetch(emu, true), EXECUTE);
+        limits_poll(emu);
+    }
+    scheduler_run_due(emu);
+    replay_note_stop(emu, wasRunning);
 }
 
 int mainInernal(int argc, char *argv[], Emulator* const emu)
@@ -118,14 +536,72 @@ int mainInernal(int argc, char *argv[], Emulator* const emu)
     if (!setEmulatorConfig(emu, argc, argv))
         return 0;
 
-    initializeMsp430(emu);
+    if (emu->network != NULL)
+    {
+        // The nodes run in processes of their own
+        int result = 1;
+        if (emu->network->path == NULL)
+            printf("--lookahead and --network-cycles need --network FILE\n");
+        else
+            result = network_main(emu);
+        network_destroy(emu);
+        uninitialize_msp_memspace();
+        return result;
+    }
+
+    machine_initialize(emu);
     Cpu* const cpu = emu->cpu;
     setup_debugger(emu);
 
     register_signal(SIGINT); // Register Callback for CONTROL-c
 
-    cpu->running = emu->start_running;
-    if (!cpu->running) {
+    if (!replay_start(emu))
+    {
+        printf("Could not %s %s\n", emu->replay->recording ? "create" : "replay",
+               emu->replay->path);
+        deinitializeMsp430(emu);
+        return 1;
+    }
+
+    if (!connectHostStreams(emu))
+    {
+        deinitializeMsp430(emu);
+        return 1;
+    }
+
+    if (emu->snapshot_file != NULL && !snapshot_read_file(emu, emu->snapshot_file))
+    {
+        printf("Could not restore snapshot %s\n", emu->snapshot_file);
+        deinitializeMsp430(emu);
+        return 1;
+    }
+
+    if (emu->fuzz != NULL)
+    {
+        const int result = fuzz_main(emu);
+        deinitializeMsp430(emu);
+        return result;
+    }
+
+    if (emu->cosim != NULL)
+    {
+        const int result = cosim_main(emu);
+        deinitializeMsp430(emu);
+        return result;
+    }
+
+    if ((emu->port != 0 || emu->gdb_socket != NULL) && !gdb_listen(emu))
+    {
+        printf("Could not open the GDB socket\n");
+        deinitializeMsp430(emu);
+        return 1;
+    }
+
+    limits_start(emu);
+
+    // GDB decides when the CPU runs
+    cpu->running = emu->start_running && !gdb_is_attached(emu);
+    if (!cpu->running && !gdb_is_attached(emu)) {
         // display first round of registers
         display_registers(emu);
         disassemble(emu, cpu->pc, 1);
@@ -139,8 +615,11 @@ int mainInernal(int argc, char *argv[], Emulator* const emu)
         handleProcessingStep(emu);
     }
 
+    if (emu->status_file != NULL && !batch_write_status(emu, emu->status_file))
+        printf("Could not write status %s\n", emu->status_file);
+
     deinitializeMsp430(emu);
-    return 0;
+    return emu->exit_code;
 }
 
 int main(int argc, char *argv[])
@@ -150,6 +629,8 @@ int main(int argc, char *argv[])
 
     const int result = mainInernal(argc, argv, emu);
 
+    coverage_destroy(emu->coverage);
+    snapshot_destroy(emu->snapshot);
     free(emu->debugger);
     free(emu);
     return result;
@@ -35,8 +35,6 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <pthread.h>
-#include <readline/readline.h>
-#include <readline/history.h>
 
 typedef struct Emulator Emulator;
 
@@ -45,10 +43,22 @@ typedef struct Port_1 Port_1;
 typedef struct Usci Usci;
 typedef struct Bcm Bcm;
 typedef struct Timer_a Timer_a;
+typedef struct Multiplier Multiplier;
+typedef struct FlashController FlashController;
 typedef struct Status_reg Status_reg;
 
 typedef struct Debugger Debugger;
 typedef struct Packet Packet;
+typedef struct Coverage Coverage;
+typedef struct Snapshot Snapshot;
+typedef struct Journal Journal;
+typedef struct Scheduler Scheduler;
+typedef struct GdbStub GdbStub;
+typedef struct RunLimits RunLimits;
+typedef struct Fuzzer Fuzzer;
+typedef struct Replay Replay;
+typedef struct Cosim Cosim;
+typedef struct Network Network;
 
 #include "devices/cpu/registers.h"
 #include "devices/utilities.h"
@@ -57,13 +67,66 @@ typedef struct Packet Packet;
 #include "debugger/debugger.h"
 #include "debugger/register_display.h"
 #include "debugger/disassembler.h"
+#include "debugger/coverage.h"
+#include "debugger/journal.h"
+#include "devices/scheduler.h"
+#include "devices/device.h"
+
+enum { Emulator_MaxFirmwareImages = 8 };
+
+// Firmware image placed into memory by load_firmware()
+typedef struct FirmwareImage
+{
+    char* file_name;
+    uint16_t address;
+    uint32_t size;
+    bool at_flash_start;       // No -m given, loaded at the device's flash
+} FirmwareImage;
+
+// Host side of the console, replacing stdin and stdout when set //
+typedef struct HostIo
+{
+    void (*console)(void* context, const char* text); // print_console()
+    void (*put_char)(void* context, uint8_t c);       // Emulator call 0x0001
+    int (*get_char)(void* context);   // Emulator call 0x0002, -1 at the end
+    void* context;
+} HostIo;
 
 struct Emulator
 {
     Cpu *cpu;
     Debugger *debugger;
+    Coverage *coverage;
+    Snapshot *snapshot;        // Snapshot used by the debugger commands
+    char* snapshot_file;       // Snapshot loaded at startup
+    Journal *journal;          // Undo journal for reverse execution
+    Scheduler *scheduler;      // Peripheral events keyed on CPU cycles
+    GdbStub *gdb;              // Remote debugger connection, see gdb_stub.c
+    RunLimits *limits;         // Instruction, cycle and time budgets
+    Fuzzer *fuzz;              // In-process fuzzing, see fuzz.c
+    Replay *replay;            // Host input record or replay, see replay.c
+    Cosim *cosim;              // Lock-step external simulator, see cosim.c
+    Network *network;          // Multi-node simulation, see network.c
     char* binary;
-    int port;
+    char* uart_in;             // Host stream feeding the UART, see usci.c
+    char* uart_out;            // Host stream receiving UART output
+    bool uart_fast;            // UART frames take no time
+    char* p1_log;              // Port 1 change log, see port1.c
+    char* p1_stimulus;         // Port 1 input transitions to replay
+    const DeviceProfile *device; // Memory layout and peripheral set
+    char* device_name;         // Profile selected with --device
+    int port;                  // GDB stub TCP port, 0 if not listening
+    char* gdb_socket;          // GDB stub Unix domain socket path
+    FILE* script;              // Batch mode debugger commands, see batch.c
+    bool exit_on_stop;         // Quit when the CPU stops in batch mode
+    char* status_file;         // JSON status written at exit
+    int exit_code;
     bool do_trace;
+    bool quiet;                // print_console() prints nothing
+    HostIo host_io;            // Console callbacks of an embedding program
+    bool no_idle_skip;         // Execute idle loops instead of skipping them
     bool start_running;
+
+    FirmwareImage images[Emulator_MaxFirmwareImages];
+    uint8_t num_images;
 };